@@ -0,0 +1,622 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <fstream>
+#include <sstream>
+
+#include "utils.h"
+#include "EvrManager.h"
+#include "HwInfo.h"
+#include "ConfigJournal.h"
+#include "AllocPlanner.h"
+
+// the 'alloc' command defaults
+#define PLAN_PRESCALER_DEFAULT 0
+#define PLAN_DELAY_DEFAULT     32
+#define PLAN_WIDTH_DEFAULT     16
+
+// the costs of leaving a request out and of an assignment that doesn't fit
+#define PLAN_COST_UNASSIGNED   (1LL << 40)
+#define PLAN_COST_INFEASIBLE   (1LL << 41)
+
+namespace {
+
+typedef std::vector<std::vector<long long> > CostMatrix;
+
+bool fits(const HwPulsegen &pg, int prescalerLength, int delayLength, int widthLength)
+{
+	return pg.prescalerLength >= prescalerLength && pg.delayLength >= delayLength 
+		&& pg.widthLength >= widthLength;
+}
+
+bool fits(const HwPulsegen &pg, const AllocRequest &req)
+{
+	return fits(pg, req.prescalerLength, req.delayLength, req.widthLength);
+}
+
+bool dominates(const HwPulsegen &a, const HwPulsegen &b)
+{
+	return fits(a, b.prescalerLength, b.delayLength, b.widthLength);
+}
+
+int wastedBits(const HwPulsegen &pg, const AllocRequest &req)
+{
+	return pg.prescalerLength - req.prescalerLength + pg.delayLength - req.delayLength 
+		+ pg.widthLength - req.widthLength;
+}
+
+/*
+ * Min-cost assignment of every row to a distinct column, rows <= columns
+ * (the Hungarian algorithm with potentials, O(rows^2 * columns)).
+ * Returns the column of each row.
+ */
+std::vector<int> solveAssignment(const CostMatrix &cost)
+{
+	const long long inf = 1LL << 62;
+	int n = cost.size();
+	int m = n > 0 ? cost[0].size() : 0;
+	
+	// 1-based, column 0 is the virtual start
+	std::vector<long long> u(n + 1, 0), v(m + 1, 0);
+	std::vector<int> p(m + 1, 0), way(m + 1, 0);
+	
+	for(int i = 1; i <= n; i ++) {
+		
+		p[0] = i;
+		int j0 = 0;
+		std::vector<long long> minv(m + 1, inf);
+		std::vector<bool> used(m + 1, false);
+		
+		do {
+			used[j0] = true;
+			int i0 = p[j0];
+			int j1 = 0;
+			long long delta = inf;
+			
+			for(int j = 1; j <= m; j ++) {
+				if(used[j]) {
+					continue;
+				}
+				long long cur = cost[i0 - 1][j - 1] - u[i0] - v[j];
+				if(cur < minv[j]) {
+					minv[j] = cur;
+					way[j] = j0;
+				}
+				if(minv[j] < delta) {
+					delta = minv[j];
+					j1 = j;
+				}
+			}
+			
+			for(int j = 0; j <= m; j ++) {
+				if(used[j]) {
+					u[p[j]] += delta;
+					v[j] -= delta;
+				} else {
+					minv[j] -= delta;
+				}
+			}
+			
+			j0 = j1;
+			
+		} while(p[j0] != 0);
+		
+		do {
+			int j1 = way[j0];
+			p[j0] = p[j1];
+			j0 = j1;
+		} while(j0 != 0);
+	}
+	
+	std::vector<int> column(n, -1);
+	for(int j = 1; j <= m; j ++) {
+		if(p[j] != 0) {
+			column[p[j] - 1] = j - 1;
+		}
+	}
+	
+	return column;
+}
+
+/*
+ * The pulse generator (position in 'pulsegens') for each request,
+ * -1 for the outputs and the requests that can't be satisfied.
+ */
+std::vector<int> planPulsegens(const std::vector<HwPulsegen> &pulsegens, 
+							   const std::vector<AllocRequest> &requests)
+{
+	std::vector<int> rows;
+	for(size_t r = 0; r < requests.size(); r ++) {
+		if(requests[r].pulsegen) {
+			rows.push_back(r);
+		}
+	}
+	
+	std::vector<int> plan(requests.size(), -1);
+	if(rows.empty()) {
+		return plan;
+	}
+	
+	// a "left out" column per row, so there may be more rows than pulse generators
+	size_t m = pulsegens.size();
+	CostMatrix cost(rows.size(), std::vector<long long>(m + rows.size(), PLAN_COST_UNASSIGNED));
+	
+	for(size_t i = 0; i < rows.size(); i ++) {
+		for(size_t j = 0; j < m; j ++) {
+			const AllocRequest &req = requests[rows[i]];
+			// among equal waste the lower ones, closer to what the kernel picks
+			cost[i][j] = fits(pulsegens[j], req) 
+				? (long long)wastedBits(pulsegens[j], req) * 1024 + j 
+				: PLAN_COST_INFEASIBLE;
+		}
+	}
+	
+	std::vector<int> column = solveAssignment(cost);
+	
+	for(size_t i = 0; i < rows.size(); i ++) {
+		if(column[i] >= 0 && column[i] < (int)m && fits(pulsegens[column[i]], requests[rows[i]])) {
+			plan[rows[i]] = column[i];
+		}
+	}
+	
+	/*
+	 * The allocations are issued with the exact properties of the planned
+	 * pulse generator and the kernel takes the first free one with at least
+	 * those. So a lower, unplanned one that has them would be taken instead:
+	 * plan that one, it fits as well.
+	 */
+	bool changed = true;
+	while(changed) {
+		changed = false;
+		std::vector<bool> planned(m, false);
+		for(size_t r = 0; r < plan.size(); r ++) {
+			if(plan[r] >= 0) {
+				planned[plan[r]] = true;
+			}
+		}
+		for(size_t r = 0; r < plan.size() && !changed; r ++) {
+			for(int h = 0; plan[r] >= 0 && h < plan[r]; h ++) {
+				if(!planned[h] && dominates(pulsegens[h], pulsegens[plan[r]])) {
+					plan[r] = h;
+					changed = true;
+					break;
+				}
+			}
+		}
+	}
+	
+	return plan;
+}
+
+/*
+ * The order to issue the planned pulsegen requests in: those on a lower
+ * pulse generator that could also take a higher one's allocation go
+ * first, and each VEVR's requests stay in their (virtual index) order.
+ * 'conflict' is set if both can't hold; the rest is then in file order.
+ */
+std::vector<int> issueOrder(const std::vector<HwPulsegen> &pulsegens, 
+							const std::vector<AllocRequest> &requests, 
+							const std::vector<int> &plan, bool *conflict)
+{
+	std::vector<int> nodes;
+	for(size_t r = 0; r < requests.size(); r ++) {
+		if(plan[r] >= 0) {
+			nodes.push_back(r);
+		}
+	}
+	
+	std::vector<std::vector<int> > before(requests.size());
+	std::map<std::string, int> lastOfVevr;
+	
+	for(size_t a = 0; a < nodes.size(); a ++) {
+		int r = nodes[a];
+		
+		std::map<std::string, int>::iterator it = lastOfVevr.find(requests[r].vevr);
+		if(it != lastOfVevr.end()) {
+			before[r].push_back(it->second);
+		}
+		lastOfVevr[requests[r].vevr] = r;
+		
+		for(size_t b = 0; b < nodes.size(); b ++) {
+			int o = nodes[b];
+			if(plan[o] < plan[r] && dominates(pulsegens[plan[o]], pulsegens[plan[r]])) {
+				before[r].push_back(o);
+			}
+		}
+	}
+	
+	std::vector<int> order;
+	std::vector<bool> done(requests.size(), false);
+	*conflict = false;
+	
+	while(order.size() < nodes.size()) {
+		
+		int next = -1;
+		
+		for(size_t a = 0; a < nodes.size(); a ++) {
+			int r = nodes[a];
+			bool ready = !done[r];
+			for(size_t k = 0; k < before[r].size() && ready; k ++) {
+				ready = done[before[r][k]];
+			}
+			if(ready && (next < 0 || plan[r] < plan[next])) {
+				next = r;
+			}
+		}
+		
+		if(next < 0) {
+			*conflict = true;
+			for(size_t a = 0; a < nodes.size(); a ++) {
+				if(!done[nodes[a]]) {
+					done[nodes[a]] = true;
+					order.push_back(nodes[a]);
+				}
+			}
+			break;
+		}
+		
+		done[next] = true;
+		order.push_back(next);
+	}
+	
+	return order;
+}
+
+// how many pulsegen requests the kernel's first fit in file order would place
+int firstFitPlaced(const std::vector<HwPulsegen> &pulsegens, 
+				   const std::vector<AllocRequest> &requests)
+{
+	std::vector<bool> taken(pulsegens.size(), false);
+	int placed = 0;
+	
+	for(size_t r = 0; r < requests.size(); r ++) {
+		for(size_t j = 0; requests[r].pulsegen && j < pulsegens.size(); j ++) {
+			if(!taken[j] && fits(pulsegens[j], requests[r])) {
+				taken[j] = true;
+				placed ++;
+				break;
+			}
+		}
+	}
+	
+	return placed;
+}
+
+std::string properties(int prescalerLength, int delayLength, int widthLength)
+{
+	char buf[48];
+	snprintf(buf, sizeof(buf), "P%d,D%d,W%d", prescalerLength, delayLength, widthLength);
+	return buf;
+}
+
+std::string properties(const HwPulsegen &pg)
+{
+	return properties(pg.prescalerLength, pg.delayLength, pg.widthLength);
+}
+
+// destroys the VEVRs created by this run, in reverse order
+void rollBack(EvrManager &manager, const std::vector<std::pair<std::string, int> > &created)
+{
+	for(size_t i = created.size(); i -- > 0; ) {
+		if(manager.destroyVirtDev(created[i].second) < 0) {
+			AERR("Can't destroy %s (id %d), errno=%d", created[i].first.c_str(), 
+				 created[i].second, errno);
+		} else {
+			AINFO("Destroyed %s", created[i].first.c_str());
+		}
+	}
+}
+
+} // unnamed namespace
+
+
+
+bool readAllocRequests(const std::string &path, std::vector<AllocRequest> &requests)
+{
+	std::ifstream file(path.c_str());
+	
+	if(!file.is_open()) {
+		AERR("Can't open '%s'", path.c_str());
+		return false;
+	}
+	
+	std::string text;
+	int lineNum = 0;
+	
+	while(std::getline(file, text)) {
+		
+		lineNum ++;
+		
+		size_t hash = text.find('#');
+		if(hash != std::string::npos) {
+			text.erase(hash);
+		}
+		
+		std::istringstream line(text);
+		std::string vevr, resName;
+		
+		if(!(line >> vevr)) {
+			continue;
+		}
+		
+		AllocRequest req;
+		req.vevr = vevr;
+		req.prescalerLength = PLAN_PRESCALER_DEFAULT;
+		req.delayLength = PLAN_DELAY_DEFAULT;
+		req.widthLength = PLAN_WIDTH_DEFAULT;
+		req.absOutputNum = -1;
+		req.line = lineNum;
+		
+		line >> resName;
+		
+		if(resName == "pulsegen") {
+			req.pulsegen = true;
+			int value;
+			if(line >> value) {
+				req.prescalerLength = value;
+				if(line >> value) {
+					req.delayLength = value;
+					if(line >> value) {
+						req.widthLength = value;
+					}
+				}
+			}
+		} else if(resName == "output" && (line >> req.absOutputNum)) {
+			req.pulsegen = false;
+		} else {
+			AERR("%s:%d: expected '<vevr_name> pulsegen [<prescaler> [<delay> [<width>]]]' "
+				 "or '<vevr_name> output <abs_output_num>'", path.c_str(), lineNum);
+			return false;
+		}
+		
+		requests.push_back(req);
+	}
+	
+	return true;
+}
+
+bool planAllocations(EvrManager &manager, const std::string &requestsPath, bool dryRun)
+{
+	std::vector<AllocRequest> requests;
+	HwInfo hw;
+	
+	if(!readAllocRequests(requestsPath, requests)) {
+		return false;
+	}
+	
+	if(!manager.readHwInfo(&hw)) {
+		AERR("Can't read the card's hw_info, errno=%d", errno);
+		return false;
+	}
+	
+	/*
+	 * The kernel's first fit skips the resources already allocated, so
+	 * only the free ones are planned. Those are known from the journal;
+	 * a requested VEVR that exists but isn't in it (created by other
+	 * means, or before a reload) has allocations that can't be known.
+	 */
+	std::vector<ConfigRecord> config;
+	if(!manager.readConfig(&config)) {
+		AERR("Can't read the configuration journal, errno=%d; the resources in use are unknown", 
+			 errno);
+		return false;
+	}
+	
+	std::set<int> pulsegensInUse;
+	std::map<int, std::string> outputOwner;
+	std::map<int, std::string> vevrNames;
+	
+	for(size_t i = 0; i < config.size(); i ++) {
+		const ConfigRecord &rec = config[i];
+		if(rec.type == ConfigRecord::VEVR) {
+			vevrNames[rec.id] = rec.name;
+		} else if(rec.type == ConfigRecord::PULSEGEN) {
+			pulsegensInUse.insert(rec.abs);
+		} else if(rec.type == ConfigRecord::OUTPUT) {
+			outputOwner[rec.abs] = vevrNames[rec.id];
+		}
+	}
+	
+	for(size_t r = 0; r < requests.size(); r ++) {
+		int id = manager.getVirtDevId(requests[r].vevr);
+		if(id > 0 && vevrNames[id] != requests[r].vevr) {
+			AERR("%s exists but isn't in the configuration journal, its allocations are unknown", 
+				 requests[r].vevr.c_str());
+			return false;
+		}
+	}
+	
+	std::vector<HwPulsegen> pulsegens;
+	for(size_t j = 0; j < hw.pulsegens.size(); j ++) {
+		if(!pulsegensInUse.count(hw.pulsegens[j].index)) {
+			pulsegens.push_back(hw.pulsegens[j]);
+		}
+	}
+	
+	if(!pulsegensInUse.empty() || !outputOwner.empty()) {
+		printf("IN USE: pulsegens=%d outputs=%d\n", (int)pulsegensInUse.size(), 
+			   (int)outputOwner.size());
+	}
+	
+	std::vector<int> plan = planPulsegens(pulsegens, requests);
+	
+	// print the plan and check the outputs
+	int failures = 0;
+	int pulsegensUsed = 0;
+	int outputsUsed = 0;
+	int wasted = 0;
+	std::map<std::string, int> pulsegenIndex, outputIndex;
+	std::map<int, int> outputLine;
+	
+	for(size_t r = 0; r < requests.size(); r ++) {
+		
+		const AllocRequest &req = requests[r];
+		
+		if(req.pulsegen) {
+			
+			int vidx = pulsegenIndex[req.vevr] ++;
+			std::string wanted = properties(req.prescalerLength, req.delayLength, req.widthLength);
+			
+			if(plan[r] < 0) {
+				AERR("line %d: no pulse generator left for %s pulsegen[%d] %s", 
+					 req.line, req.vevr.c_str(), vidx, wanted.c_str());
+				failures ++;
+				continue;
+			}
+			
+			const HwPulsegen &pg = pulsegens[plan[r]];
+			printf("PLAN: %s pulsegen[%d] %s -> PULSEGEN[%d] %s\n", req.vevr.c_str(), vidx, 
+				   wanted.c_str(), pg.index, properties(pg).c_str());
+			pulsegensUsed ++;
+			wasted += wastedBits(pg, req);
+			
+		} else {
+			
+			int vidx = outputIndex[req.vevr] ++;
+			bool exists = false;
+			for(size_t i = 0; i < hw.outputs.size(); i ++) {
+				exists = exists || hw.outputs[i] == req.absOutputNum;
+			}
+			
+			if(!exists) {
+				AERR("line %d: the card has no OUT[%d]", req.line, req.absOutputNum);
+				failures ++;
+			} else if(outputOwner.count(req.absOutputNum)) {
+				AERR("line %d: OUT[%d] is already allocated to %s", req.line, 
+					 req.absOutputNum, outputOwner[req.absOutputNum].c_str());
+				failures ++;
+			} else if(outputLine.count(req.absOutputNum)) {
+				AERR("line %d: OUT[%d] is already allocated on line %d", req.line, 
+					 req.absOutputNum, outputLine[req.absOutputNum]);
+				failures ++;
+			} else {
+				outputLine[req.absOutputNum] = req.line;
+				printf("PLAN: %s output[%d] -> OUT[%d]\n", req.vevr.c_str(), vidx, 
+					   req.absOutputNum);
+				outputsUsed ++;
+			}
+		}
+	}
+	
+	int pulsegenRequests = 0;
+	for(size_t r = 0; r < requests.size(); r ++) {
+		pulsegenRequests += requests[r].pulsegen;
+	}
+	
+	printf("UTILIZATION: pulsegens=%d/%d outputs=%d/%d wasted_bits=%d first_fit_placed=%d/%d\n", 
+		   pulsegensUsed, (int)hw.pulsegens.size(), outputsUsed, (int)hw.outputs.size(), 
+		   wasted, firstFitPlaced(pulsegens, requests), pulsegenRequests);
+	
+	// the free pulse generators by their properties
+	std::vector<bool> planned(pulsegens.size(), false);
+	for(size_t r = 0; r < plan.size(); r ++) {
+		if(plan[r] >= 0) {
+			planned[plan[r]] = true;
+		}
+	}
+	std::map<std::string, int> headroom;
+	for(size_t j = 0; j < pulsegens.size(); j ++) {
+		if(!planned[j]) {
+			headroom[properties(pulsegens[j])] ++;
+		}
+	}
+	for(std::map<std::string, int>::iterator it = headroom.begin(); it != headroom.end(); ++ it) {
+		printf("HEADROOM: pulsegen %s free=%d\n", it->first.c_str(), it->second);
+	}
+	printf("HEADROOM: outputs free=%d\n", 
+		   (int)hw.outputs.size() - (int)outputOwner.size() - outputsUsed);
+	
+	if(failures) {
+		AERR("%d request(s) can't be satisfied, nothing allocated", failures);
+		return false;
+	}
+	
+	if(dryRun) {
+		return true;
+	}
+	
+	/*
+	 * Create the VEVRs, then the outputs (they are chosen explicitly), then
+	 * the pulse generators. On the first failure the VEVRs created here are
+	 * destroyed again; the allocations appended to existing ones can't be
+	 * taken back.
+	 */
+	std::map<std::string, int> ids;
+	std::vector<std::pair<std::string, int> > created;
+	
+	for(size_t r = 0; r < requests.size(); r ++) {
+		
+		const std::string &name = requests[r].vevr;
+		if(ids.count(name)) {
+			continue;
+		}
+		
+		int id = manager.getVirtDevId(name);
+		if(id > 0) {
+			AINFO("%s exists, its allocations are appended", name.c_str());
+		} else if(manager.createVirtDev(name, 0) < 0 || (id = manager.getVirtDevId(name)) < 1) {
+			AERR("Can't create %s, errno=%d", name.c_str(), errno);
+			rollBack(manager, created);
+			return false;
+		} else {
+			created.push_back(std::make_pair(name, id));
+		}
+		ids[name] = id;
+	}
+	
+	for(size_t r = 0; r < requests.size(); r ++) {
+		const AllocRequest &req = requests[r];
+		if(!req.pulsegen && manager.allocOutput(ids[req.vevr], req.absOutputNum) < 0) {
+			AERR("line %d: output allocation failed, errno=%d", req.line, errno);
+			rollBack(manager, created);
+			return false;
+		}
+	}
+	
+	bool conflict;
+	std::vector<int> order = issueOrder(pulsegens, requests, plan, &conflict);
+	
+	if(conflict) {
+		AINFO("The VEVR order doesn't allow landing on all the planned pulse generators");
+	}
+	
+	int moved = 0;
+	
+	for(size_t k = 0; k < order.size(); k ++) {
+		
+		const AllocRequest &req = requests[order[k]];
+		const HwPulsegen &pg = pulsegens[plan[order[k]]];
+		
+		// exactly the planned properties, so the first fit is the planned one
+		int abs = manager.allocPulsegen(ids[req.vevr], pg.prescalerLength, pg.delayLength, 
+										pg.widthLength);
+		if(abs < 0) {
+			AERR("line %d: pulsegen allocation failed, errno=%d", req.line, errno);
+			rollBack(manager, created);
+			return false;
+		} else if(abs != pg.index) {
+			AINFO("line %d: got PULSEGEN[%d] instead of the planned PULSEGEN[%d]", 
+				  req.line, abs, pg.index);
+			moved ++;
+		}
+	}
+	
+	printf("ALLOCATED: requests=%d not_as_planned=%d\n", (int)requests.size(), moved);
+	
+	return true;
+}
@@ -0,0 +1,52 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#ifndef __ALLOC_PLANNER_H__
+#define __ALLOC_PLANNER_H__
+
+#include <string>
+#include <vector>
+
+#include "EvrManager.h"
+
+struct AllocRequest {
+	std::string vevr;
+	bool pulsegen;          // else an output
+	int prescalerLength;
+	int delayLength;
+	int widthLength;
+	int absOutputNum;
+	int line;
+};
+
+/*
+ * The requirements file, one allocation per line in the order of the
+ * virtual indexes, with the arguments of the 'alloc' command:
+ * 
+ *   <vevr_name> pulsegen [<prescaler> [<delay> [<width>]]]
+ *   <vevr_name> output <abs_output_num>
+ * 
+ * Empty lines and '#' comments are skipped.
+ */
+bool readAllocRequests(const std::string &path, std::vector<AllocRequest> &requests);
+
+/*
+ * Assigns the free physical pulse generators (from hw_info, less those
+ * allocated according to the ConfigJournal) to all the pulsegen requests
+ * at once, wasting as few prescaler, delay and width bits as possible (a
+ * min-cost assignment), instead of the kernel's first fit in call order.
+ * Unless 'dryRun', creates the missing VEVRs and issues the allocations
+ * in an order in which the kernel's first fit lands on the planned pulse
+ * generators, checking that it did; on a failure the VEVRs it created
+ * are destroyed. Prints the plan, the utilization and the remaining
+ * headroom.
+ */
+bool planAllocations(EvrManager &manager, const std::string &requestsPath, bool dryRun);
+
+#endif // __ALLOC_PLANNER_H__
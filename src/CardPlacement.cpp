@@ -0,0 +1,256 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include <string>
+
+#include "utils.h"
+#include "CardPlacement.h"
+
+// the memory policies of <numaif.h>, without needing libnuma
+#define PLACEMENT_MPOL_DEFAULT   0
+#define PLACEMENT_MPOL_PREFERRED 1
+
+namespace {
+
+std::string readLine(const std::string &path)
+{
+	char buf[1024] = "";
+	
+	FILE *f = fopen(path.c_str(), "r");
+	if(f != NULL) {
+		if(fgets(buf, sizeof(buf), f) == NULL) {
+			buf[0] = '\0';
+		}
+		fclose(f);
+	}
+	buf[strcspn(buf, "\n")] = '\0';
+	
+	return buf;
+}
+
+void onlineCpus(cpu_set_t *cpus)
+{
+	if(!parseCpuList(readLine("/sys/devices/system/cpu/online"), cpus)) {
+		sched_getaffinity(0, sizeof(*cpus), cpus);
+	}
+}
+
+// the maxnode of the memory policy calls for a mask of 'bytes' (one more
+// bit than it has, as libnuma passes it)
+unsigned long maxNode(size_t bytes)
+{
+	return bytes * 8 + 1;
+}
+
+} // unnamed namespace
+
+
+
+CardLocality::CardLocality(void)
+	: numaNode(-1)
+{
+	onlineCpus(&localCpus);
+	CPU_ZERO(&remoteCpus);
+}
+
+bool CardLocality::find(const std::string &mngDevNodeName)
+{
+	std::string base = mngDevNodeName.substr(mngDevNodeName.rfind('/') + 1);
+	std::string link = "/sys/class/modac-mng/" + base + "/device";
+	char path[PATH_MAX];
+	
+	if(realpath(link.c_str(), path) == NULL) {
+		return false;
+	}
+	
+	std::string dev = path;
+	pciDevice = dev.substr(dev.rfind('/') + 1);
+	
+	// -1 on the machines with one node, or no ACPI proximity info
+	std::string node = readLine(dev + "/numa_node");
+	numaNode = node.empty() ? -1 : ::atoi(node.c_str());
+	
+	cpu_set_t online;
+	onlineCpus(&online);
+	
+	cpu_set_t local;
+	if(parseCpuList(readLine(dev + "/local_cpulist"), &local)) {
+		CPU_AND(&localCpus, &local, &online);
+	}
+	if(CPU_COUNT(&localCpus) == 0) {
+		localCpus = online;
+	}
+	
+	CPU_XOR(&remoteCpus, &online, &localCpus);
+	
+	return true;
+}
+
+std::string CardLocality::describe(void) const
+{
+	char buf[32];
+	
+	if(numaNode >= 0) {
+		snprintf(buf, sizeof(buf), "node %d, CPUs ", numaNode);
+	} else {
+		snprintf(buf, sizeof(buf), "CPUs ");
+	}
+	
+	return buf + formatCpuList(localCpus);
+}
+
+bool parseCpuList(const std::string &text, cpu_set_t *cpus)
+{
+	const char *p = text.c_str();
+	
+	CPU_ZERO(cpus);
+	
+	while(*p != '\0') {
+		
+		char *end;
+		long first = strtol(p, &end, 10);
+		long last = first;
+		
+		if(end == p || first < 0) {
+			return false;
+		}
+		p = end;
+		
+		if(*p == '-') {
+			last = strtol(p + 1, &end, 10);
+			if(end == p + 1 || last < first) {
+				return false;
+			}
+			p = end;
+		}
+		
+		for(long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu ++) {
+			CPU_SET(cpu, cpus);
+		}
+		
+		if(*p == ',') {
+			p ++;
+		} else if(*p != '\0') {
+			return false;
+		}
+	}
+	
+	return CPU_COUNT(cpus) > 0;
+}
+
+std::string formatCpuList(const cpu_set_t &cpus)
+{
+	std::string text;
+	char buf[32];
+	
+	for(int cpu = 0; cpu < CPU_SETSIZE; cpu ++) {
+		
+		if(!CPU_ISSET(cpu, &cpus)) {
+			continue;
+		}
+		
+		int last = cpu;
+		while(last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, &cpus)) {
+			last ++;
+		}
+		
+		if(last > cpu) {
+			snprintf(buf, sizeof(buf), "%s%d-%d", text.empty() ? "" : ",", cpu, last);
+		} else {
+			snprintf(buf, sizeof(buf), "%s%d", text.empty() ? "" : ",", cpu);
+		}
+		text += buf;
+		cpu = last;
+	}
+	
+	return text.empty() ? "none" : text;
+}
+
+bool parsePlacement(const std::string &text, Placement *placement)
+{
+	if(text == "none") {
+		*placement = PLACEMENT_NONE;
+	} else if(text == "local") {
+		*placement = PLACEMENT_LOCAL;
+	} else if(text == "remote") {
+		*placement = PLACEMENT_REMOTE;
+	} else {
+		return false;
+	}
+	
+	return true;
+}
+
+PlacementScope::PlacementScope(const CardLocality &loc, Placement placement)
+	: savedPolicy(PLACEMENT_MPOL_DEFAULT)
+	, affinitySet(false)
+	, policySet(false)
+{
+	if(placement == PLACEMENT_NONE) {
+		return;
+	}
+	
+	const cpu_set_t &cpus = placement == PLACEMENT_LOCAL ? loc.localCpus : loc.remoteCpus;
+	
+	if(CPU_COUNT(&cpus) == 0) {
+		AERR("No CPUs away from the card to run on");
+		return;
+	}
+	
+	if(sched_getaffinity(0, sizeof(savedAffinity), &savedAffinity) == 0) {
+		affinitySet = sched_setaffinity(0, sizeof(cpus), &cpus) == 0;
+	}
+	if(!affinitySet) {
+		AERR("Can't run on CPUs %s, errno=%d", formatCpuList(cpus).c_str(), errno);
+	}
+	
+	// the remote memory comes with the remote CPUs (first touch)
+	if(placement != PLACEMENT_LOCAL || loc.numaNode < 0 
+	   || loc.numaNode >= (int)sizeof(savedNodes) * 8) {
+		return;
+	}
+	
+	memset(savedNodes, 0, sizeof(savedNodes));
+	if(syscall(SYS_get_mempolicy, &savedPolicy, savedNodes, 
+			   maxNode(sizeof(savedNodes)), NULL, 0) != 0) {
+		AERR("Can't get the memory policy, errno=%d", errno);
+		return;
+	}
+	
+	unsigned long nodes[sizeof(savedNodes) / sizeof(savedNodes[0])];
+	memset(nodes, 0, sizeof(nodes));
+	nodes[loc.numaNode / (sizeof(nodes[0]) * 8)] |= 1UL << (loc.numaNode % (sizeof(nodes[0]) * 8));
+	
+	policySet = syscall(SYS_set_mempolicy, PLACEMENT_MPOL_PREFERRED, nodes, 
+						maxNode(sizeof(nodes))) == 0;
+	if(!policySet) {
+		AERR("Can't prefer the memory of node %d, errno=%d", loc.numaNode, errno);
+	}
+}
+
+PlacementScope::~PlacementScope()
+{
+	if(policySet) {
+		syscall(SYS_set_mempolicy, savedPolicy, 
+				savedPolicy == PLACEMENT_MPOL_DEFAULT ? NULL : savedNodes, 
+				maxNode(sizeof(savedNodes)));
+	}
+	
+	if(affinitySet) {
+		sched_setaffinity(0, sizeof(savedAffinity), &savedAffinity);
+	}
+}
@@ -0,0 +1,81 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#ifndef __CARD_PLACEMENT_H__
+#define __CARD_PLACEMENT_H__
+
+#include <sched.h>
+
+#include <string>
+
+/*
+ * Where a card is in the PCIe topology: its PCI device behind
+ * /sys/class/modac-mng/<evrXmng>/device, the NUMA node of its root
+ * complex and the CPUs local to it. Every uncached MMIO read of a
+ * thread on another socket crosses the interconnect both ways.
+ */
+struct CardLocality {
+	
+	std::string pciDevice; // e.g. "0000:05:00.0"
+	int numaNode;          // -1 if the platform doesn't tell
+	cpu_set_t localCpus;   // all the online CPUs if it doesn't
+	cpu_set_t remoteCpus;  // the online CPUs not local, may be none
+	
+	CardLocality(void);
+	
+	// false if the node has no PCI device (e.g. the emulator)
+	bool find(const std::string &mngDevNodeName);
+	
+	// e.g. "node 1, CPUs 8-15,24-31"
+	std::string describe(void) const;
+};
+
+// "0-3,8,10-11" as in local_cpulist; false if invalid
+bool parseCpuList(const std::string &text, cpu_set_t *cpus);
+
+std::string formatCpuList(const cpu_set_t &cpus);
+
+enum Placement {
+	PLACEMENT_NONE,   // wherever the scheduler puts it
+	PLACEMENT_LOCAL,  // the CPUs and the memory of the card's node
+	PLACEMENT_REMOTE, // the CPUs away from the card, to compare
+};
+
+// "none", "local" or "remote"; false if none of these
+bool parsePlacement(const std::string &text, Placement *placement);
+
+/*
+ * Runs the calling thread on the CPUs of 'placement' for the lifetime
+ * of the object; with PLACEMENT_LOCAL the memory the thread allocates
+ * from then on also prefers the card's node. The previous affinity and
+ * memory policy are restored at the end. What can't be set is reported
+ * and skipped.
+ */
+class PlacementScope {
+public:
+	
+	PlacementScope(const CardLocality &loc, Placement placement);
+	~PlacementScope();
+	
+	bool isPlaced(void) const { return affinitySet; }
+
+private:
+	
+	cpu_set_t savedAffinity;
+	int savedPolicy;
+	unsigned long savedNodes[4];
+	
+	bool affinitySet;
+	bool policySet;
+	
+	PlacementScope(const PlacementScope &);
+	PlacementScope &operator=(const PlacementScope &);
+};
+
+#endif // __CARD_PLACEMENT_H__
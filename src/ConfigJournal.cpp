@@ -0,0 +1,307 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+
+#include "utils.h"
+#include "ConfigJournal.h"
+
+namespace {
+
+/*
+ * What tells the device node instances apart: a node is recreated when
+ * the kernel module is loaded (a new inode, the device number may stay);
+ * the emulator's state lives as long as its file. Nothing that changes
+ * on the same node (its times, e.g. st_ctime on a chmod) is used.
+ */
+std::string nodeIdentity(const std::string &mngDevNodeName)
+{
+	std::string path = mngDevNodeName;
+	if(path.compare(0, 4, "emu:") == 0) {
+		path = path.substr(4);
+	}
+	
+	struct stat st;
+	char buf[96];
+	
+	if(stat(path.c_str(), &st) < 0) {
+		return "";
+	}
+	
+	if(S_ISCHR(st.st_mode)) {
+		snprintf(buf, sizeof(buf), "chr:%llx:%llx:%llx", (unsigned long long)st.st_rdev, 
+				 (unsigned long long)st.st_dev, (unsigned long long)st.st_ino);
+	} else {
+		snprintf(buf, sizeof(buf), "file:%llx:%llx", (unsigned long long)st.st_dev, 
+				 (unsigned long long)st.st_ino);
+	}
+	
+	return buf;
+}
+
+std::string journalHeader(const std::string &mngDevNodeName)
+{
+	return "# evrManager journal " + nodeIdentity(mngDevNodeName);
+}
+
+} // unnamed namespace
+
+
+
+std::string ConfigRecord::format(void) const
+{
+	char buf[128];
+	
+	switch(type) {
+	case VEVR:
+		snprintf(buf, sizeof(buf), "vevr %d %s", id, name.c_str());
+		break;
+	case DESTROY:
+		snprintf(buf, sizeof(buf), "destroy %d", id);
+		break;
+	case PULSEGEN:
+		snprintf(buf, sizeof(buf), "pulsegen %d %d %d %d %d", id, prescalerLength, 
+				 delayLength, widthLength, abs);
+		break;
+	case OUTPUT:
+		snprintf(buf, sizeof(buf), "output %d %d", id, abs);
+		break;
+	case OUTSET:
+		snprintf(buf, sizeof(buf), "outset %d %d %c %d", id, outIdx, 
+				 fromPulsegen ? 'P' : 'S', source);
+		break;
+	}
+	
+	return buf;
+}
+
+bool ConfigRecord::parse(const std::string &line)
+{
+	std::istringstream in(line);
+	std::string word;
+	char pOrS;
+	
+	in >> word >> id;
+	
+	if(word == "vevr") {
+		type = VEVR;
+		in >> name;
+	} else if(word == "destroy") {
+		type = DESTROY;
+	} else if(word == "pulsegen") {
+		type = PULSEGEN;
+		in >> prescalerLength >> delayLength >> widthLength >> abs;
+	} else if(word == "output") {
+		type = OUTPUT;
+		in >> abs;
+	} else if(word == "outset") {
+		type = OUTSET;
+		in >> outIdx >> pOrS >> source;
+		fromPulsegen = pOrS != 'S';
+	} else {
+		return false;
+	}
+	
+	return !in.fail();
+}
+
+
+
+ConfigJournal::ConfigJournal(const std::string &mngDevNodeName)
+	: mngDevNodeName(mngDevNodeName)
+	, fd(-1)
+{
+}
+
+ConfigJournal::~ConfigJournal()
+{
+	if(fd >= 0) {
+		close(fd);
+	}
+}
+
+std::string ConfigJournal::journalPath(const std::string &mngDevNodeName)
+{
+	std::string base = mngDevNodeName;
+	size_t slash = base.rfind('/');
+	
+	if(slash != std::string::npos) {
+		base = base.substr(slash + 1);
+	}
+	
+	const char *dir = "/var/run";
+	if(access(dir, W_OK) != 0) {
+		dir = "/tmp";
+	}
+	
+	return std::string(dir) + "/evrManager." + base + ".journal";
+}
+
+void ConfigJournal::append(const ConfigRecord &rec)
+{
+	std::string header = journalHeader(mngDevNodeName) + "\n";
+	
+	if(fd < 0) {
+		
+		std::string path = journalPath(mngDevNodeName);
+		
+		fd = open(path.c_str(), O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+		if(fd < 0) {
+			AERR("Can't open the journal '%s', errno=%d", path.c_str(), errno);
+			return;
+		}
+		
+		// a journal of an earlier instance of the node doesn't apply any more
+		std::vector<char> first(header.size());
+		if(pread(fd, &first[0], first.size(), 0) != (ssize_t)first.size() 
+		   || memcmp(&first[0], header.data(), first.size()) != 0) {
+			if(ftruncate(fd, 0) < 0 || write(fd, header.data(), header.size()) < 0) {
+				AERR("Can't start the journal '%s', errno=%d", path.c_str(), errno);
+			}
+		}
+	}
+	
+	std::string line = rec.format() + "\n";
+	
+	if(write(fd, line.data(), line.size()) != (ssize_t)line.size()) {
+		AERR("Can't write the journal, errno=%d", errno);
+	}
+}
+
+void ConfigJournal::rewrite(const std::vector<ConfigRecord> &config)
+{
+	if(fd >= 0) {
+		close(fd);
+		fd = -1;
+	}
+	
+	std::string path = journalPath(mngDevNodeName);
+	std::string text = journalHeader(mngDevNodeName) + "\n";
+	
+	for(size_t i = 0; i < config.size(); i ++) {
+		text += config[i].format() + "\n";
+	}
+	
+	fd = open(path.c_str(), O_RDWR | O_APPEND | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if(fd < 0 || write(fd, text.data(), text.size()) != (ssize_t)text.size()) {
+		AERR("Can't rewrite the journal '%s', errno=%d", path.c_str(), errno);
+	}
+}
+
+void ConfigJournal::recordCreate(int id, const std::string &name)
+{
+	ConfigRecord rec = ConfigRecord();
+	rec.type = ConfigRecord::VEVR;
+	rec.id = id;
+	rec.name = name;
+	append(rec);
+}
+
+void ConfigJournal::recordDestroy(int id)
+{
+	ConfigRecord rec = ConfigRecord();
+	rec.type = ConfigRecord::DESTROY;
+	rec.id = id;
+	append(rec);
+}
+
+void ConfigJournal::recordPulsegen(int id, int prescalerLength, int delayLength, 
+								   int widthLength, int abs)
+{
+	ConfigRecord rec = ConfigRecord();
+	rec.type = ConfigRecord::PULSEGEN;
+	rec.id = id;
+	rec.prescalerLength = prescalerLength;
+	rec.delayLength = delayLength;
+	rec.widthLength = widthLength;
+	rec.abs = abs;
+	append(rec);
+}
+
+void ConfigJournal::recordOutput(int id, int abs)
+{
+	ConfigRecord rec = ConfigRecord();
+	rec.type = ConfigRecord::OUTPUT;
+	rec.id = id;
+	rec.abs = abs;
+	append(rec);
+}
+
+void ConfigJournal::recordOutset(int id, int outIdx, bool fromPulsegen, int source)
+{
+	ConfigRecord rec = ConfigRecord();
+	rec.type = ConfigRecord::OUTSET;
+	rec.id = id;
+	rec.outIdx = outIdx;
+	rec.fromPulsegen = fromPulsegen;
+	rec.source = source;
+	append(rec);
+}
+
+bool ConfigJournal::load(const std::string &mngDevNodeName, std::vector<ConfigRecord> &config)
+{
+	std::ifstream file(journalPath(mngDevNodeName).c_str());
+	std::string line;
+	
+	config.clear();
+	
+	if(!file.is_open()) {
+		// nothing was configured through evrManager yet
+		return true;
+	}
+	
+	if(!std::getline(file, line) || line != journalHeader(mngDevNodeName)) {
+		errno = ESTALE;
+		return false;
+	}
+	
+	while(std::getline(file, line)) {
+		
+		ConfigRecord rec;
+		if(!rec.parse(line)) {
+			AERR("Invalid journal line: %s", line.c_str());
+			continue;
+		}
+		
+		if(rec.type == ConfigRecord::DESTROY) {
+			
+			// the id may be reused by a VEVR created later
+			for(size_t i = config.size(); i -- > 0; ) {
+				if(config[i].id == rec.id) {
+					config.erase(config.begin() + i);
+				}
+			}
+			continue;
+		}
+		
+		if(rec.type == ConfigRecord::OUTSET) {
+			for(size_t i = config.size(); i -- > 0; ) {
+				if(config[i].type == ConfigRecord::OUTSET && config[i].id == rec.id 
+				   && config[i].outIdx == rec.outIdx) {
+					config.erase(config.begin() + i);
+				}
+			}
+		}
+		
+		config.push_back(rec);
+	}
+	
+	return true;
+}
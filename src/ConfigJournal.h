@@ -0,0 +1,87 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#ifndef __CONFIG_JOURNAL_H__
+#define __CONFIG_JOURNAL_H__
+
+#include <string>
+#include <vector>
+
+// One configuration step of a card, in the order it was done.
+struct ConfigRecord {
+	
+	enum Type {
+		VEVR,       // created VEVR 'id' named 'name'
+		DESTROY,    // destroyed VEVR 'id' (only in the journal)
+		PULSEGEN,   // allocated pulse generator 'abs' with 'p', 'd', 'w'
+		OUTPUT,     // allocated output 'abs'
+		OUTSET,     // set output 'outIdx' to 'source' (a virtual pulse generator or not)
+	};
+	
+	Type type;
+	int id;
+	std::string name;
+	int prescalerLength;
+	int delayLength;
+	int widthLength;
+	int abs;
+	int outIdx;
+	bool fromPulsegen;
+	int source;
+	
+	// as written to the files, one line
+	std::string format(void) const;
+	bool parse(const std::string &line);
+};
+
+/*
+ * The manager device can't be asked for its configuration, so every
+ * change done through EvrManager is appended to a per-card journal
+ * (/var/run/evrManager.<evrXmng>.journal, /tmp if not writable). The
+ * journal belongs to one instance of the manager device node: after the
+ * kernel module is reloaded (the node is recreated) the first change
+ * starts a new one. Changes done by other means are not seen.
+ */
+class ConfigJournal {
+public:
+	
+	explicit ConfigJournal(const std::string &mngDevNodeName);
+	~ConfigJournal();
+	
+	void recordCreate(int id, const std::string &name);
+	void recordDestroy(int id);
+	void recordPulsegen(int id, int prescalerLength, int delayLength, int widthLength, int abs);
+	void recordOutput(int id, int abs);
+	void recordOutset(int id, int outIdx, bool fromPulsegen, int source);
+	
+	/*
+	 * The live configuration: the journal without the destroyed VEVRs and
+	 * the overwritten output settings, in the original order. False if
+	 * there is no journal of the current device node instance.
+	 */
+	static bool load(const std::string &mngDevNodeName, std::vector<ConfigRecord> &config);
+	bool read(std::vector<ConfigRecord> &config) const { return load(mngDevNodeName, config); }
+	
+	// replaces the journal with 'config' (as returned by load())
+	void rewrite(const std::vector<ConfigRecord> &config);
+	
+	static std::string journalPath(const std::string &mngDevNodeName);
+
+private:
+	
+	std::string mngDevNodeName;
+	int fd;
+	
+	void append(const ConfigRecord &rec);
+	
+	ConfigJournal(const ConfigJournal &);
+	ConfigJournal &operator=(const ConfigJournal &);
+};
+
+#endif // __CONFIG_JOURNAL_H__
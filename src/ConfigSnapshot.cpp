@@ -0,0 +1,224 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#include <stdio.h>
+#include <errno.h>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+
+#include "utils.h"
+#include "EvrManager.h"
+#include "ConfigJournal.h"
+#include "ConfigSnapshot.h"
+#include "LatencyStats.h"
+
+#define SNAPSHOT_HEADER "# evrManager snapshot"
+
+namespace {
+
+struct ConfigCounts {
+	int vevrs;
+	int pulsegens;
+	int outputs;
+	int outsets;
+};
+
+ConfigCounts count(const std::vector<ConfigRecord> &config)
+{
+	ConfigCounts c = { 0, 0, 0, 0 };
+	
+	for(size_t i = 0; i < config.size(); i ++) {
+		switch(config[i].type) {
+		case ConfigRecord::VEVR:     c.vevrs ++; break;
+		case ConfigRecord::PULSEGEN: c.pulsegens ++; break;
+		case ConfigRecord::OUTPUT:   c.outputs ++; break;
+		case ConfigRecord::OUTSET:   c.outsets ++; break;
+		default: break;
+		}
+	}
+	
+	return c;
+}
+
+bool readSnapshot(const std::string &filePath, std::vector<ConfigRecord> &config)
+{
+	std::ifstream file(filePath.c_str());
+	std::string line;
+	
+	if(!file.is_open()) {
+		AERR("Can't open '%s'", filePath.c_str());
+		return false;
+	}
+	
+	if(!std::getline(file, line) || line.compare(0, sizeof(SNAPSHOT_HEADER) - 1, 
+												  SNAPSHOT_HEADER) != 0) {
+		AERR("'%s' is not a snapshot", filePath.c_str());
+		return false;
+	}
+	
+	while(std::getline(file, line)) {
+		ConfigRecord rec;
+		if(!rec.parse(line) || rec.type == ConfigRecord::DESTROY) {
+			AERR("Invalid snapshot line: %s", line.c_str());
+			return false;
+		}
+		config.push_back(rec);
+	}
+	
+	return true;
+}
+
+} // unnamed namespace
+
+
+
+bool snapshotConfig(EvrManager &manager, const std::string &mngDevNodeName, 
+					const std::string &filePath, std::string *summary)
+{
+	std::vector<ConfigRecord> config;
+	
+	if(!manager.readConfig(&config)) {
+		AERR("The journal of %s is from before the kernel module was reloaded", 
+			 mngDevNodeName.c_str());
+		return false;
+	}
+	
+	FILE *f = fopen(filePath.c_str(), "w");
+	if(f == NULL) {
+		AERR("Can't create '%s', errno=%d", filePath.c_str(), errno);
+		return false;
+	}
+	
+	fprintf(f, "%s %s\n", SNAPSHOT_HEADER, mngDevNodeName.c_str());
+	for(size_t i = 0; i < config.size(); i ++) {
+		fprintf(f, "%s\n", config[i].format().c_str());
+	}
+	
+	if(fclose(f) != 0) {
+		AERR("Can't write '%s', errno=%d", filePath.c_str(), errno);
+		return false;
+	}
+	
+	ConfigCounts c = count(config);
+	char buf[160];
+	snprintf(buf, sizeof(buf), "vevrs=%d pulsegens=%d outputs=%d outsets=%d", 
+			 c.vevrs, c.pulsegens, c.outputs, c.outsets);
+	*summary = buf;
+	
+	return true;
+}
+
+bool restoreConfig(EvrManager &manager, const std::string &filePath, std::string *summary)
+{
+	std::vector<ConfigRecord> config;
+	
+	if(!readSnapshot(filePath, config)) {
+		return false;
+	}
+	
+	// on top of an existing configuration the indexes would differ
+	for(size_t i = 0; i < config.size(); i ++) {
+		if(config[i].type == ConfigRecord::VEVR && manager.getVirtDevId(config[i].name) > 0) {
+			AERR("%s already exists, nothing restored", config[i].name.c_str());
+			return false;
+		}
+	}
+	
+	// drops what is left of an earlier instance of the card (a journal of
+	// an earlier instance of the node is restarted by the first change)
+	std::vector<ConfigRecord> live;
+	if(!manager.readConfig(&live) && errno != ESTALE) {
+		AERR("Can't read the journal, errno=%d", errno);
+		return false;
+	}
+	
+	int64_t start = monotonicNowNs();
+	
+	// snapshot id -> the id now, and the virtual indexes given so far
+	std::map<int, int> ids;
+	std::map<int, std::string> names;
+	std::map<int, int> pulsegenCount, outputCount;
+	int failures = 0;
+	int skipped = 0;
+	int mismatches = 0;
+	
+	for(size_t i = 0; i < config.size(); i ++) {
+		
+		const ConfigRecord &rec = config[i];
+		std::map<int, int>::const_iterator found = ids.find(rec.id);
+		int ret = 0;
+		
+		// the steps of a VEVR that couldn't be created
+		if(rec.type != ConfigRecord::VEVR && found == ids.end()) {
+			skipped ++;
+			continue;
+		}
+		int id = rec.type != ConfigRecord::VEVR ? found->second : 0;
+		
+		switch(rec.type) {
+			
+		case ConfigRecord::VEVR:
+			// ask for the same id, the kernel may give another one
+			ret = manager.createVirtDev(rec.name, rec.id);
+			if(ret >= 0 && (id = manager.getVirtDevId(rec.name)) > 0) {
+				ids[rec.id] = id;
+				names[rec.id] = rec.name;
+				if(id != rec.id) {
+					AERR("%s: got id %d instead of %d", rec.name.c_str(), id, rec.id);
+					mismatches ++;
+				}
+			} else if(ret >= 0) {
+				ret = -1;
+			}
+			break;
+			
+		case ConfigRecord::PULSEGEN:
+			ret = manager.allocPulsegen(id, rec.prescalerLength, rec.delayLength, 
+										rec.widthLength);
+			if(ret >= 0 && ret != rec.abs) {
+				AERR("%s pulsegen[%d]: got PULSEGEN[%d] instead of PULSEGEN[%d]", 
+					 names[rec.id].c_str(), pulsegenCount[rec.id], ret, rec.abs);
+				mismatches ++;
+			}
+			pulsegenCount[rec.id] ++;
+			break;
+			
+		case ConfigRecord::OUTPUT:
+			ret = manager.allocOutput(id, rec.abs);
+			outputCount[rec.id] ++;
+			break;
+			
+		case ConfigRecord::OUTSET:
+			ret = manager.setOutput(id, rec.outIdx, rec.fromPulsegen, rec.source);
+			break;
+			
+		default:
+			break;
+		}
+		
+		if(ret < 0) {
+			AERR("Restoring '%s' failed, errno=%d", rec.format().c_str(), errno);
+			failures ++;
+		}
+	}
+	
+	double ms = (monotonicNowNs() - start) / 1e6;
+	
+	ConfigCounts c = count(config);
+	char buf[200];
+	snprintf(buf, sizeof(buf), "vevrs=%d pulsegens=%d outputs=%d outsets=%d in %.1f ms, "
+			 "failed=%d, skipped=%d, indexes %s", c.vevrs, c.pulsegens, c.outputs, c.outsets, 
+			 ms, failures, skipped, mismatches || failures ? "DIFFER" : "match");
+	*summary = buf;
+	
+	return failures == 0 && mismatches == 0;
+}
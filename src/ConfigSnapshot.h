@@ -0,0 +1,33 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#ifndef __CONFIG_SNAPSHOT_H__
+#define __CONFIG_SNAPSHOT_H__
+
+#include <string>
+
+#include "EvrManager.h"
+
+/*
+ * Writes the card's live configuration (the VEVRs, their allocations in
+ * the order they were done and the output settings, see ConfigJournal)
+ * to 'filePath'. 'summary' gets a one line description.
+ */
+bool snapshotConfig(EvrManager &manager, const std::string &mngDevNodeName, 
+					const std::string &filePath, std::string *summary);
+
+/*
+ * Recreates the configuration saved by snapshotConfig() on a card that
+ * has none of its VEVRs, replaying the steps in their original order,
+ * and checks that every allocation got the same physical resource
+ * (so the virtual indexes map as before).
+ */
+bool restoreConfig(EvrManager &manager, const std::string &filePath, std::string *summary);
+
+#endif // __CONFIG_SNAPSHOT_H__
@@ -0,0 +1,46 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#include <pthread.h>
+
+#include "Crc32.h"
+
+namespace {
+
+uint32_t table[256];
+pthread_once_t tableOnce = PTHREAD_ONCE_INIT;
+
+void initTable(void)
+{
+	for(uint32_t i = 0; i < 256; i ++) {
+		uint32_t c = i;
+		for(int k = 0; k < 8; k ++) {
+			c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+		}
+		table[i] = c;
+	}
+}
+
+} // unnamed namespace
+
+
+
+uint32_t crc32Update(uint32_t crc, const void *data, size_t len)
+{
+	const uint8_t *p = (const uint8_t *)data;
+	
+	pthread_once(&tableOnce, initTable);
+	
+	crc = ~crc;
+	for(size_t i = 0; i < len; i ++) {
+		crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+	}
+	
+	return ~crc;
+}
@@ -0,0 +1,22 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#ifndef __CRC32_H__
+#define __CRC32_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * CRC-32 (IEEE 802.3, as zlib's crc32()): start with 0 and feed the data
+ * in any number of pieces, each call returning the CRC so far.
+ */
+uint32_t crc32Update(uint32_t crc, const void *data, size_t len);
+
+#endif // __CRC32_H__
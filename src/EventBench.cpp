@@ -0,0 +1,380 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#include <sys/types.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "utils.h"
+#include "EvrManager.h"
+#include "EvrDevice.h"
+#include "LatencyStats.h"
+#include "EventBench.h"
+
+#define EVENT_BENCH_READ_EVENTS  256  // per read()
+#define EVENT_BENCH_POLL_MS      100  // how soon the threads see the end
+#define EVENT_BENCH_TICK_NS      1000000L
+
+namespace {
+
+// what the synthetic source writes
+struct SyntheticEvent {
+	uint32_t code;
+	uint32_t seq;
+	uint64_t timeNs;
+};
+
+struct EventSource {
+	
+	std::string name;
+	int fd;
+	
+	// synthetic only
+	bool synthetic;
+	int producerFd;
+	int rate;
+	pthread_t producer;
+	uint64_t produced;
+	
+	pthread_t consumer;
+	uint64_t events;
+	uint64_t reads;
+	uint64_t fullReads;
+	uint64_t overflows;
+	uint64_t drops;
+	bool dropsMeasured;     // synthetic only
+	LatencyStats gaps;
+	LatencyStats latency;
+	bool failed;
+	
+	EventSource(void)
+		: fd(-1)
+		, synthetic(false)
+		, producerFd(-1)
+		, rate(EVENT_BENCH_RATE_DEFAULT)
+		, produced(0)
+		, events(0)
+		, reads(0)
+		, fullReads(0)
+		, overflows(0)
+		, drops(0)
+		, dropsMeasured(false)
+		, failed(false)
+	{
+	}
+};
+
+volatile int stopFlag;
+
+bool stopping(void)
+{
+	return __sync_fetch_and_add(&stopFlag, 0) != 0;
+}
+
+void *producerThread(void *arg)
+{
+	EventSource &s = *(EventSource *)arg;
+	
+	std::vector<SyntheticEvent> batch;
+	int64_t start = monotonicNowNs();
+	struct timespec next;
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	
+	uint32_t seq = 0;
+	
+	while(!stopping()) {
+		
+		next.tv_nsec += EVENT_BENCH_TICK_NS;
+		if(next.tv_nsec >= 1000000000L) {
+			next.tv_nsec -= 1000000000L;
+			next.tv_sec ++;
+		}
+		while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR) {
+		}
+		
+		// all that are due by now, so a late tick doesn't lower the rate
+		int64_t now = monotonicNowNs();
+		uint64_t due = (uint64_t)((now - start) * (double)s.rate / 1e9);
+		
+		batch.clear();
+		while(s.produced < due) {
+			SyntheticEvent ev = { 0x7D, seq ++, (uint64_t)now };
+			batch.push_back(ev);
+			s.produced ++;
+		}
+		
+		if(batch.empty()) {
+			continue;
+		}
+		
+		// in whole records, at most PIPE_BUF bytes at a time, which the pipe
+		// takes entirely or not at all; what doesn't fit is dropped, as the
+		// kernel does when the VEVR's queue is full, and the consumer sees
+		// the gap in 'seq'
+		const size_t chunk = PIPE_BUF / sizeof(SyntheticEvent);
+		ssize_t ret = 0;
+		
+		for(size_t done = 0; done < batch.size() && ret >= 0; done += chunk) {
+			size_t count = batch.size() - done < chunk ? batch.size() - done : chunk;
+			ret = write(s.producerFd, &batch[done], count * sizeof(SyntheticEvent));
+		}
+		
+		if(ret < 0 && errno != EAGAIN) {
+			break;
+		}
+	}
+	
+	return NULL;
+}
+
+void *consumerThread(void *arg)
+{
+	EventSource &s = *(EventSource *)arg;
+	
+	size_t recordBytes = s.synthetic ? sizeof(SyntheticEvent) : vevrEventBytes();
+	std::vector<char> buf(EVENT_BENCH_READ_EVENTS * recordBytes);
+	
+	int64_t lastNs = 0;
+	uint32_t nextSeq = 0;
+	
+	while(!stopping()) {
+		
+		struct pollfd pfd = { s.fd, POLLIN, 0 };
+		
+		int ret = poll(&pfd, 1, EVENT_BENCH_POLL_MS);
+		if(ret < 0 && errno != EINTR) {
+			s.failed = true;
+			break;
+		}
+		if(ret <= 0) {
+			continue;
+		}
+		if((pfd.revents & POLLERR) != 0) {
+			s.overflows ++;
+		}
+		if((pfd.revents & POLLIN) == 0) {
+			continue;
+		}
+		
+		ssize_t n = read(s.fd, &buf[0], buf.size());
+		int64_t now = monotonicNowNs();
+		
+		if(n < 0) {
+			if(errno == EOVERFLOW) {
+				s.overflows ++;
+			} else if(errno != EAGAIN && errno != EINTR) {
+				s.failed = true;
+				break;
+			}
+			continue;
+		}
+		
+		size_t count = n / recordBytes;
+		if(count == 0) {
+			continue;
+		}
+		
+		s.reads ++;
+		s.events += count;
+		if((size_t)n == buf.size()) {
+			s.fullReads ++;
+		}
+		if(lastNs != 0) {
+			s.gaps.add(now - lastNs);
+		}
+		lastNs = now;
+		
+		if(s.synthetic) {
+			const SyntheticEvent *ev = (const SyntheticEvent *)&buf[0];
+			for(size_t i = 0; i < count; i ++) {
+				s.drops += ev[i].seq - nextSeq;
+				nextSeq = ev[i].seq + 1;
+				s.latency.add(now - (int64_t)ev[i].timeNs);
+			}
+		}
+	}
+	
+	return NULL;
+}
+
+bool openSource(EvrManager &manager, const std::string &spec, EventSource &s)
+{
+	s.name = spec;
+	s.synthetic = spec.compare(0, strlen(EVENT_BENCH_SYNTHETIC), EVENT_BENCH_SYNTHETIC) == 0;
+	
+	if(s.synthetic) {
+		
+		size_t colon = spec.find(':');
+		if(colon != std::string::npos) {
+			s.rate = ::atoi(spec.c_str() + colon + 1);
+		}
+		if(s.rate <= 0) {
+			AERR("Invalid rate: %s", spec.c_str());
+			return false;
+		}
+		
+		int fds[2];
+		if(pipe2(fds, O_NONBLOCK | O_CLOEXEC) < 0) {
+			AERR("pipe2 failed, errno=%d", errno);
+			return false;
+		}
+		s.fd = fds[0];
+		s.producerFd = fds[1];
+		s.dropsMeasured = true;
+		
+		return true;
+	}
+	
+	if(manager.getVirtDevId(spec) < 1) {
+		AERR("No VEVR '%s'", spec.c_str());
+		return false;
+	}
+	
+	std::string node = manager.getDevice().vevrNodePath(spec);
+	
+	s.fd = open(node.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+	if(s.fd < 0) {
+		AERR("Can't open '%s', errno=%d", node.c_str(), errno);
+		return false;
+	}
+	
+	return true;
+}
+
+void printResult(const std::string &name, EventSource &s, double seconds)
+{
+	char drops[32] = "n/a";
+	if(s.dropsMeasured) {
+		snprintf(drops, sizeof(drops), "%llu", (unsigned long long)s.drops);
+	}
+	
+	printf("EVBENCH vevr=%s,events=%llu,events_per_s=%.0f,events_per_read=%.1f,"
+		   "full_reads=%llu,overflows=%llu,drops=%s,%s", name.c_str(), 
+		   (unsigned long long)s.events, s.events / seconds, 
+		   s.reads ? (double)s.events / s.reads : 0, (unsigned long long)s.fullReads, 
+		   (unsigned long long)s.overflows, drops, s.gaps.keyValues("gap").c_str());
+	
+	if(s.latency.count() > 0) {
+		printf(",%s", s.latency.keyValues("lat").c_str());
+	}
+	printf("\n");
+}
+
+} // unnamed namespace
+
+
+
+bool eventBench(EvrManager &manager, int seconds, 
+				const std::vector<std::string> &virtDevNames)
+{
+	if(seconds <= 0 || virtDevNames.empty()) {
+		AERR("Invalid duration %d or no VEVRs", seconds);
+		return false;
+	}
+	
+	std::vector<EventSource> sources(virtDevNames.size());
+	bool ret = true;
+	
+	for(size_t i = 0; i < sources.size() && ret; i ++) {
+		ret = openSource(manager, virtDevNames[i], sources[i]);
+	}
+	
+	stopFlag = 0;
+	
+	size_t consumers = 0;
+	size_t producers = 0;
+	
+	// the vector is not resized from here on so the addresses are stable
+	for(; ret && consumers < sources.size(); consumers ++) {
+		if(pthread_create(&sources[consumers].consumer, NULL, consumerThread, 
+						  &sources[consumers])) {
+			AERR("pthread_create failed");
+			ret = false;
+			break;
+		}
+	}
+	for(; ret && producers < sources.size(); producers ++) {
+		if(sources[producers].synthetic && pthread_create(&sources[producers].producer, 
+										NULL, producerThread, &sources[producers])) {
+			AERR("pthread_create failed");
+			ret = false;
+			break;
+		}
+	}
+	
+	int64_t start = monotonicNowNs();
+	
+	if(ret) {
+		struct timespec ts = { seconds, 0 };
+		while(nanosleep(&ts, &ts) < 0 && errno == EINTR) {
+		}
+	}
+	
+	__sync_fetch_and_add(&stopFlag, 1);
+	
+	for(size_t i = 0; i < producers; i ++) {
+		if(sources[i].synthetic) {
+			pthread_join(sources[i].producer, NULL);
+		}
+	}
+	for(size_t i = 0; i < consumers; i ++) {
+		pthread_join(sources[i].consumer, NULL);
+	}
+	
+	double elapsed = (monotonicNowNs() - start) / 1e9;
+	
+	EventSource total;
+	total.dropsMeasured = true;
+	
+	for(size_t i = 0; i < sources.size(); i ++) {
+		
+		EventSource &s = sources[i];
+		
+		if(ret) {
+			printResult(s.name, s, elapsed);
+			if(s.failed) {
+				AERR("%s: read failed", s.name.c_str());
+				ret = false;
+			}
+		}
+		
+		total.events += s.events;
+		total.reads += s.reads;
+		total.fullReads += s.fullReads;
+		total.overflows += s.overflows;
+		total.drops += s.drops;
+		total.dropsMeasured = total.dropsMeasured && s.dropsMeasured;
+		total.gaps.merge(s.gaps);
+		total.latency.merge(s.latency);
+		
+		if(s.fd >= 0) {
+			close(s.fd);
+		}
+		if(s.producerFd >= 0) {
+			close(s.producerFd);
+		}
+	}
+	
+	if(ret && sources.size() > 1) {
+		printResult("all", total, elapsed);
+	}
+	
+	return ret;
+}
@@ -0,0 +1,52 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#ifndef __EVENT_BENCH_H__
+#define __EVENT_BENCH_H__
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "EvrManager.h"
+
+#define EVENT_BENCH_SECONDS_DEFAULT  10
+#define EVENT_BENCH_RATE_DEFAULT     10000  // events/s of a synthetic source
+
+// the "<vevr_name>" form for a synthetic source: "synthetic[:<events_per_s>]"
+#define EVENT_BENCH_SYNTHETIC "synthetic"
+
+/*
+ * Consumes the event streams of the VEVRs in 'virtDevNames' for 'seconds',
+ * one thread per VEVR (poll() and read() on /dev/<vevr_name>, as an IOC
+ * does), and prints one line per VEVR and one for all of them:
+ * 
+ *   EVBENCH vevr=<name>,events=<..>,events_per_s=<..>,events_per_read=<..>,
+ *       full_reads=<..>,overflows=<..>,drops=<..>,gap_n=<..>,gap_mean_ns=<..>,...
+ * 
+ * 'gap' is the time between two reads that returned events (the
+ * inter-arrival jitter as the consumer sees it), 'full_reads' the reads
+ * that filled the whole buffer (the consumer is behind), 'overflows'
+ * the reads that failed with EOVERFLOW (or POLLERR) because the kernel
+ * had to drop events.
+ * 
+ * A synthetic source is a producer thread writing records at the given
+ * rate into a pipe, so the consumer side can be profiled without a
+ * timing fiber; its events carry a sequence number and the time they
+ * were produced, which counts 'drops' (events lost because the pipe was
+ * full) and adds 'lat' (from production to read). A VEVR doesn't tell
+ * how many events it dropped, only that it did ('overflows'), so its
+ * drops are not measured: 'drops=n/a' (also for "all" if there is a
+ * VEVR among the sources).
+ */
+bool eventBench(EvrManager &manager, int seconds, 
+				const std::vector<std::string> &virtDevNames);
+
+#endif // __EVENT_BENCH_H__
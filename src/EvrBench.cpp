@@ -0,0 +1,688 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <sys/mman.h>
+#include <sys/utsname.h>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "utils.h"
+#include "EvrManager.h"
+#include "EvrCardG2Prom.h"
+#include "McsRead.h"
+#include "FlashSim.h"
+#include "HwInfo.h"
+#include "LatencyStats.h"
+
+/*
+ * The benchmark runner of 'make bench': times the MCS parser, the PROM
+ * engine on a simulated flash, the IoRegion accessors and the hw_info
+ * parser, repeating each case and reporting the median with its
+ * confidence interval as JSON; the compare mode flags the cases that
+ * got slower between two such files.
+ */
+
+#define BENCH_FORMAT_VERSION     1
+#define BENCH_REPS_DEFAULT       11
+#define BENCH_THRESHOLD_DEFAULT  5.0 // percent
+
+// a full size image of the current firmware, as EvrCardG2Prom assumes
+#define BENCH_IMAGE_BYTES        (0x002DF2FB + 1)
+
+// the PROM the erase cases start with: an earlier image, blank after it
+#define BENCH_OLD_IMAGE_WORDS    (BENCH_IMAGE_BYTES / 2)
+#define BENCH_FLASH_WORDS        0x400000
+
+// the simulated load: 8 read-while-write partitions, erase and program
+// times in bus operations (about 10 us each)
+#define BENCH_PARTITION_WORDS    (BENCH_FLASH_WORDS / 8)
+#define BENCH_ERASE_OPS          40000
+#define BENCH_PROGRAM_OPS        300
+
+#define BENCH_IOREGION_BYTES     0x40000
+#define BENCH_IOREGION_OPS       (4 * 1024 * 1024)
+
+// a large card, parsed this many times per repetition
+#define BENCH_HWINFO_PULSEGENS   64
+#define BENCH_HWINFO_OUTPUTS     64
+#define BENCH_HWINFO_PARSES      1000
+
+namespace {
+
+struct BenchContext {
+	std::string mcsPath;
+	std::string hwInfo;
+	FlashSimProm *programmed; // holds the image, for the verify case
+};
+
+struct BenchCase {
+	const char *name;
+	const char *unit;
+	// one repetition; false if the result is wrong
+	bool (*run)(BenchContext &ctx, double *value);
+};
+
+struct BenchResult {
+	std::string name;
+	std::string unit;
+	int reps;
+	double median;
+	double ciLow;
+	double ciHigh;
+	double min;
+	double max;
+};
+
+double elapsedMs(int64_t startNs)
+{
+	return (monotonicNowNs() - startNs) / 1e6;
+}
+
+// the PROM code's progress reports, not wanted in the timed runs
+class QuietLog {
+public:
+	QuietLog(void) { evrLogConfigure("level=0"); }
+	~QuietLog() { evrLogConfigure(""); }
+};
+
+bool writeRecord(FILE *f, uint8_t type, uint16_t addr, const uint8_t *data, int len)
+{
+	uint8_t sum = len + (addr >> 8) + (addr & 0xFF) + type;
+	
+	fprintf(f, ":%02X%04X%02X", len, addr, type);
+	for(int i = 0; i < len; i ++) {
+		fprintf(f, "%02X", data[i]);
+		sum += data[i];
+	}
+	
+	return fprintf(f, "%02X\n", (uint8_t)-sum) > 0;
+}
+
+// pseudo random but always the same content
+bool generateMcs(const std::string &path, uint32_t bytes)
+{
+	FILE *f = fopen(path.c_str(), "w");
+	if(f == NULL) {
+		AERR("Can't create '%s'", path.c_str());
+		return false;
+	}
+	
+	uint32_t seed = 0x12345678;
+	bool ok = true;
+	
+	for(uint32_t addr = 0; addr < bytes && ok; addr += 16) {
+		
+		if((addr & 0xFFFF) == 0) {
+			uint8_t upper[2] = { (uint8_t)(addr >> 24), (uint8_t)(addr >> 16) };
+			ok = writeRecord(f, 4, 0, upper, 2);
+		}
+		
+		uint8_t data[16];
+		int len = bytes - addr < 16 ? bytes - addr : 16;
+		for(int i = 0; i < len; i ++) {
+			seed = seed * 1103515245 + 12345;
+			data[i] = seed >> 16;
+		}
+		
+		ok = ok && writeRecord(f, 0, addr & 0xFFFF, data, len);
+	}
+	
+	ok = ok && writeRecord(f, 1, 0, NULL, 0);
+	
+	return fclose(f) == 0 && ok;
+}
+
+bool benchMcsParse(BenchContext &ctx, double *value)
+{
+	QuietLog quiet;
+	McsRead reader;
+	McsReadData mem;
+	uint32_t bytes = 0;
+	
+	int64_t start = monotonicNowNs();
+	
+	if(!reader.open(ctx.mcsPath)) {
+		return false;
+	}
+	mem.endOfFile = false;
+	while(!mem.endOfFile) {
+		if(reader.read(&mem) < 0) {
+			reader.close();
+			return false;
+		}
+		bytes ++;
+	}
+	reader.close();
+	
+	*value = elapsedMs(start);
+	
+	// the last read only reports the end of file
+	return bytes - 1 == BENCH_IMAGE_BYTES;
+}
+
+bool benchMcsAddrSize(BenchContext &ctx, double *value)
+{
+	QuietLog quiet;
+	McsRead reader;
+	
+	int64_t start = monotonicNowNs();
+	
+	if(!reader.open(ctx.mcsPath)) {
+		return false;
+	}
+	uint32_t size = reader.addrSize();
+	reader.close();
+	
+	*value = elapsedMs(start);
+	
+	return size == BENCH_IMAGE_BYTES - 1;
+}
+
+bool benchPromErase(BenchContext &ctx, double *value)
+{
+	QuietLog quiet;
+	FlashSimProm prom(ctx.mcsPath, BENCH_FLASH_WORDS);
+	prom.setPromSize(BENCH_IMAGE_BYTES - 1);
+	prom.setContents(BENCH_OLD_IMAGE_WORDS, 0);
+	
+	int64_t start = monotonicNowNs();
+	prom.eraseBootProm();
+	*value = elapsedMs(start);
+	
+	return true;
+}
+
+bool benchPromProgram(BenchContext &ctx, double *value)
+{
+	QuietLog quiet;
+	FlashSimProm prom(ctx.mcsPath, BENCH_FLASH_WORDS);
+	prom.setPromSize(BENCH_IMAGE_BYTES - 1);
+	
+	int64_t start = monotonicNowNs();
+	bool ok = prom.bufferedWriteBootProm();
+	*value = elapsedMs(start);
+	
+	return ok;
+}
+
+// the register accesses (PCIe transactions) to program the image
+bool benchPromProgramMmio(BenchContext &ctx, double *value, bool posted)
+{
+	QuietLog quiet;
+	FlashSimProm prom(ctx.mcsPath, BENCH_FLASH_WORDS);
+	prom.setPromSize(BENCH_IMAGE_BYTES - 1);
+	prom.setPostedBufferLoad(posted);
+	
+	uint64_t before = prom.getMmioWrites() + prom.getMmioReads();
+	bool ok = prom.bufferedWriteBootProm();
+	*value = prom.getMmioWrites() + prom.getMmioReads() - before;
+	
+	return ok;
+}
+
+bool benchPromProgramMmioRead(BenchContext &ctx, double *value)
+{
+	return benchPromProgramMmio(ctx, value, false);
+}
+
+bool benchPromProgramMmioPosted(BenchContext &ctx, double *value)
+{
+	return benchPromProgramMmio(ctx, value, true);
+}
+
+// the simulated time of the erase and program, in bus operations
+bool benchPromLoad(BenchContext &ctx, double *value, bool overlap)
+{
+	QuietLog quiet;
+	FlashSimProm prom(ctx.mcsPath, BENCH_FLASH_WORDS);
+	prom.setPromSize(BENCH_IMAGE_BYTES - 1);
+	prom.setContents(BENCH_OLD_IMAGE_WORDS, 0);
+	prom.setTiming(BENCH_PARTITION_WORDS, BENCH_ERASE_OPS, BENCH_PROGRAM_OPS);
+	if(overlap) {
+		prom.setPartitionWords(BENCH_PARTITION_WORDS);
+	}
+	
+	bool ok = prom.eraseWriteBootProm();
+	*value = prom.getBusOps();
+	
+	return ok && prom.getConflicts() == 0;
+}
+
+bool benchPromLoadSerial(BenchContext &ctx, double *value)
+{
+	return benchPromLoad(ctx, value, false);
+}
+
+bool benchPromLoadOverlap(BenchContext &ctx, double *value)
+{
+	return benchPromLoad(ctx, value, true);
+}
+
+// programming with each buffer read back, instead of prom_program + prom_verify
+bool benchPromProgramVerified(BenchContext &ctx, double *value)
+{
+	QuietLog quiet;
+	FlashSimProm prom(ctx.mcsPath, BENCH_FLASH_WORDS);
+	prom.setPromSize(BENCH_IMAGE_BYTES - 1);
+	prom.setInlineVerify(true);
+	
+	int64_t start = monotonicNowNs();
+	bool ok = prom.bufferedWriteBootProm();
+	*value = elapsedMs(start);
+	
+	return ok;
+}
+
+bool benchPromVerify(BenchContext &ctx, double *value)
+{
+	QuietLog quiet;
+	
+	if(ctx.programmed == NULL) {
+		ctx.programmed = new FlashSimProm(ctx.mcsPath, BENCH_FLASH_WORDS);
+		ctx.programmed->setPromSize(BENCH_IMAGE_BYTES - 1);
+		if(!ctx.programmed->bufferedWriteBootProm()) {
+			return false;
+		}
+	}
+	
+	int64_t start = monotonicNowNs();
+	bool ok = ctx.programmed->verifyBootProm();
+	*value = elapsedMs(start);
+	
+	return ok;
+}
+
+// the register accessors on plain memory: the byte swapping and the volatile accesses
+bool benchIoRegion(double *value, bool write)
+{
+	IoRegion io;
+	
+	io.length = BENCH_IOREGION_BYTES;
+	io.ptr = (uint32_t *)mmap(NULL, io.length, PROT_READ | PROT_WRITE, 
+							  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(io.ptr == MAP_FAILED) {
+		return false;
+	}
+	
+	const int mask = BENCH_IOREGION_BYTES - 4;
+	uint32_t sum = 0;
+	
+	int64_t start = monotonicNowNs();
+	for(int i = 0; i < BENCH_IOREGION_OPS; i ++) {
+		if(write) {
+			io.write32((i * 4) & mask, i);
+		} else {
+			sum += io.read32((i * 4) & mask);
+		}
+	}
+	*value = (double)(monotonicNowNs() - start) / BENCH_IOREGION_OPS;
+	
+	munmap(io.ptr, io.length);
+	
+	return sum == 0;
+}
+
+bool benchIoRegionRead(BenchContext &, double *value)
+{
+	return benchIoRegion(value, false);
+}
+
+bool benchIoRegionWrite(BenchContext &, double *value)
+{
+	return benchIoRegion(value, true);
+}
+
+bool benchHwInfoParse(BenchContext &ctx, double *value)
+{
+	HwInfo hw;
+	bool ok = true;
+	
+	int64_t start = monotonicNowNs();
+	for(int i = 0; i < BENCH_HWINFO_PARSES; i ++) {
+		ok = ok && hw.parse(ctx.hwInfo);
+	}
+	*value = (double)(monotonicNowNs() - start) / 1e3 / BENCH_HWINFO_PARSES;
+	
+	return ok && hw.pulsegens.size() == BENCH_HWINFO_PULSEGENS 
+		&& hw.outputs.size() == BENCH_HWINFO_OUTPUTS;
+}
+
+std::string generateHwInfo(void)
+{
+	char line[64];
+	std::string text = "pulsegen:\n";
+	
+	for(int i = 0; i < BENCH_HWINFO_PULSEGENS; i ++) {
+		snprintf(line, sizeof(line), "PULSEGEN[%d]=P%d,D32,W%d\n", i, i < 8 ? 16 : 0, 
+				 i < 8 ? 32 : 16);
+		text += line;
+	}
+	text += "output:\n";
+	for(int i = 0; i < BENCH_HWINFO_OUTPUTS; i ++) {
+		snprintf(line, sizeof(line), "OUT[%d]=FP_UNIV[%d],MAP=xx\n", i, i);
+		text += line;
+	}
+	
+	return text;
+}
+
+const BenchCase benchCases[] = {
+	{ "mcs_parse",         "ms", benchMcsParse },
+	{ "mcs_addr_size",     "ms", benchMcsAddrSize },
+	{ "prom_erase",        "ms", benchPromErase },
+	{ "prom_program",      "ms", benchPromProgram },
+	{ "prom_program_mmio", "ops", benchPromProgramMmioRead },
+	{ "prom_program_mmio_posted", "ops", benchPromProgramMmioPosted },
+	{ "prom_load_serial",  "ops", benchPromLoadSerial },
+	{ "prom_load_overlap", "ops", benchPromLoadOverlap },
+	{ "prom_verify",       "ms", benchPromVerify },
+	{ "prom_program_verified", "ms", benchPromProgramVerified },
+	{ "ioregion_read",     "ns", benchIoRegionRead },
+	{ "ioregion_write",    "ns", benchIoRegionWrite },
+	{ "hwinfo_parse",      "us", benchHwInfoParse },
+};
+
+/*
+ * The median and its distribution free 95% confidence interval: the
+ * order statistics at n/2 -+ 0.98*sqrt(n) (binomial, normal approximation).
+ */
+BenchResult summarize(const char *name, const char *unit, std::vector<double> values)
+{
+	std::sort(values.begin(), values.end());
+	
+	int n = values.size();
+	double half = 0.98 * sqrt((double)n);
+	int lo = (int)floor(n / 2.0 - half);
+	int hi = (int)ceil(n / 2.0 + half);
+	
+	// 1-based ranks
+	lo = std::max(lo, 1);
+	hi = std::min(hi, n);
+	
+	BenchResult r;
+	r.name = name;
+	r.unit = unit;
+	r.reps = n;
+	r.median = n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+	r.ciLow = values[lo - 1];
+	r.ciHigh = values[hi - 1];
+	r.min = values.front();
+	r.max = values.back();
+	
+	return r;
+}
+
+void writeJson(FILE *f, const std::vector<BenchResult> &results, int reps)
+{
+	struct utsname uts;
+	std::string kernel = uname(&uts) == 0 ? uts.release : "unknown";
+	
+	// one result per line, the compare mode relies on it
+	fprintf(f, "{\n");
+	fprintf(f, "  \"format\": %d,\n", BENCH_FORMAT_VERSION);
+	fprintf(f, "  \"kernel\": \"%s\",\n", kernel.c_str());
+	fprintf(f, "  \"compiler\": \"%s\",\n", __VERSION__);
+	fprintf(f, "  \"reps\": %d,\n", reps);
+	fprintf(f, "  \"results\": [\n");
+	
+	for(size_t i = 0; i < results.size(); i ++) {
+		const BenchResult &r = results[i];
+		fprintf(f, "    {\"name\": \"%s\", \"unit\": \"%s\", \"reps\": %d, \"median\": %.3f, "
+				"\"ci_low\": %.3f, \"ci_high\": %.3f, \"min\": %.3f, \"max\": %.3f}%s\n",
+				r.name.c_str(), r.unit.c_str(), r.reps, r.median, 
+				r.ciLow, r.ciHigh, r.min, r.max, i + 1 < results.size() ? "," : "");
+	}
+	
+	fprintf(f, "  ]\n");
+	fprintf(f, "}\n");
+}
+
+std::string jsonString(const std::string &line, const char *key)
+{
+	std::string k = std::string("\"") + key + "\": \"";
+	size_t pos = line.find(k);
+	if(pos == std::string::npos) {
+		return "";
+	}
+	pos += k.size();
+	return line.substr(pos, line.find('"', pos) - pos);
+}
+
+double jsonNumber(const std::string &line, const char *key)
+{
+	std::string k = std::string("\"") + key + "\": ";
+	size_t pos = line.find(k);
+	if(pos == std::string::npos) {
+		return NAN;
+	}
+	return strtod(line.c_str() + pos + k.size(), NULL);
+}
+
+bool readJson(const char *path, std::vector<BenchResult> &results)
+{
+	FILE *f = fopen(path, "r");
+	if(f == NULL) {
+		AERR("Can't open '%s'", path);
+		return false;
+	}
+	
+	char buf[1024];
+	while(fgets(buf, sizeof(buf), f) != NULL) {
+		std::string line = buf;
+		if(line.find("\"name\": ") == std::string::npos) {
+			continue;
+		}
+		BenchResult r;
+		r.name = jsonString(line, "name");
+		r.unit = jsonString(line, "unit");
+		r.reps = (int)jsonNumber(line, "reps");
+		r.median = jsonNumber(line, "median");
+		r.ciLow = jsonNumber(line, "ci_low");
+		r.ciHigh = jsonNumber(line, "ci_high");
+		r.min = jsonNumber(line, "min");
+		r.max = jsonNumber(line, "max");
+		results.push_back(r);
+	}
+	
+	fclose(f);
+	return true;
+}
+
+/*
+ * A case regressed if its median grew more than 'thresholdPct' and the
+ * confidence intervals don't overlap, so that noise alone doesn't flag it.
+ */
+bool compare(const char *oldPath, const char *newPath, double thresholdPct)
+{
+	std::vector<BenchResult> olds, news;
+	
+	if(!readJson(oldPath, olds) || !readJson(newPath, news)) {
+		return false;
+	}
+	
+	int regressions = 0;
+	
+	printf("%-20s %12s %12s %9s  %s\n", "CASE", "OLD", "NEW", "CHANGE", "STATUS");
+	
+	for(size_t i = 0; i < news.size(); i ++) {
+		
+		const BenchResult &n = news[i];
+		const BenchResult *o = NULL;
+		
+		for(size_t j = 0; j < olds.size(); j ++) {
+			if(olds[j].name == n.name) {
+				o = &olds[j];
+			}
+		}
+		
+		if(o == NULL) {
+			printf("%-20s %12s %9.3f %-2s %9s  new\n", n.name.c_str(), "-", n.median, 
+				   n.unit.c_str(), "");
+			continue;
+		}
+		
+		double change = o->median > 0 ? (n.median / o->median - 1) * 100 : 0;
+		const char *status = "ok";
+		
+		if(change > thresholdPct && n.ciLow > o->ciHigh) {
+			status = "REGRESSION";
+			regressions ++;
+		} else if(change < -thresholdPct && n.ciHigh < o->ciLow) {
+			status = "improved";
+		}
+		
+		printf("%-20s %9.3f %-2s %9.3f %-2s %+8.1f%%  %s\n", n.name.c_str(), 
+			   o->median, o->unit.c_str(), n.median, n.unit.c_str(), change, status);
+	}
+	
+	if(regressions) {
+		AERR("%d case(s) regressed by more than %.1f%%", regressions, thresholdPct);
+	}
+	
+	return regressions == 0;
+}
+
+bool runBench(int reps, const std::string &filter, const std::string &dir, 
+			  const std::string &outPath)
+{
+	BenchContext ctx;
+	ctx.programmed = NULL;
+	ctx.hwInfo = generateHwInfo();
+	ctx.mcsPath = dir + "/evrBench.XXXXXX";
+	
+	std::vector<char> tmpl(ctx.mcsPath.begin(), ctx.mcsPath.end());
+	tmpl.push_back('\0');
+	int fd = mkstemp(&tmpl[0]);
+	if(fd < 0) {
+		AERR("Can't create a file in '%s'", dir.c_str());
+		return false;
+	}
+	close(fd);
+	ctx.mcsPath = &tmpl[0];
+	
+	if(!generateMcs(ctx.mcsPath, BENCH_IMAGE_BYTES)) {
+		unlink(ctx.mcsPath.c_str());
+		return false;
+	}
+	
+	std::vector<BenchResult> results;
+	bool ret = true;
+	
+	for(size_t c = 0; c < sizeof(benchCases) / sizeof(benchCases[0]) && ret; c ++) {
+		
+		const BenchCase &bc = benchCases[c];
+		
+		if(!filter.empty() && strstr(bc.name, filter.c_str()) == NULL) {
+			continue;
+		}
+		
+		// one untimed run to warm the caches (and the page cache for the image)
+		double value;
+		std::vector<double> values;
+		
+		for(int rep = -1; rep < reps; rep ++) {
+			if(!bc.run(ctx, &value)) {
+				AERR("%s: wrong result", bc.name);
+				ret = false;
+				break;
+			}
+			if(rep >= 0) {
+				values.push_back(value);
+			}
+		}
+		
+		if(ret) {
+			results.push_back(summarize(bc.name, bc.unit, values));
+			fprintf(stderr, "%-20s %10.3f %s\n", bc.name, results.back().median, bc.unit);
+		}
+	}
+	
+	delete ctx.programmed;
+	unlink(ctx.mcsPath.c_str());
+	
+	if(!ret) {
+		return false;
+	}
+	
+	FILE *f = outPath.empty() ? stdout : fopen(outPath.c_str(), "w");
+	if(f == NULL) {
+		AERR("Can't create '%s'", outPath.c_str());
+		return false;
+	}
+	
+	writeJson(f, results, reps);
+	
+	return f == stdout || fclose(f) == 0;
+}
+
+void usage(void)
+{
+	printf("usage: evrBench [--reps=N] [--filter=substring] [--dir=tmp_dir] [--out=file.json]\n");
+	printf("       evrBench --compare [--threshold=percent] old.json new.json\n");
+}
+
+} // unnamed namespace
+
+
+int main(int argc, const char *argv[])
+{
+	int reps = BENCH_REPS_DEFAULT;
+	double thresholdPct = BENCH_THRESHOLD_DEFAULT;
+	bool compareMode = false;
+	std::string filter;
+	std::string dir = "/tmp";
+	std::string outPath;
+	std::vector<const char *> files;
+	
+	for(int i = 1; i < argc; i ++) {
+		
+		std::string arg = argv[i];
+		
+		if(arg.compare(0, 7, "--reps=") == 0) {
+			reps = ::atoi(arg.c_str() + 7);
+		} else if(arg.compare(0, 9, "--filter=") == 0) {
+			filter = arg.substr(9);
+		} else if(arg.compare(0, 6, "--dir=") == 0) {
+			dir = arg.substr(6);
+		} else if(arg.compare(0, 6, "--out=") == 0) {
+			outPath = arg.substr(6);
+		} else if(arg == "--compare") {
+			compareMode = true;
+		} else if(arg.compare(0, 12, "--threshold=") == 0) {
+			thresholdPct = ::atof(arg.c_str() + 12);
+		} else if(arg.compare(0, 2, "--") != 0) {
+			files.push_back(argv[i]);
+		} else {
+			usage();
+			return 1;
+		}
+	}
+	
+	if(compareMode) {
+		if(files.size() != 2) {
+			usage();
+			return 1;
+		}
+		return compare(files[0], files[1], thresholdPct) ? 0 : 1;
+	}
+	
+	if(reps < 1 || !files.empty()) {
+		usage();
+		return 1;
+	}
+	
+	return runBench(reps, filter, dir, outPath) ? 0 : 1;
+}
@@ -26,38 +26,120 @@
 #include <string.h>
 #include <stdlib.h>
 #include <iomanip> 
+#include <time.h>
 
 #include "EvrCardG2Prom.h"
 #include "McsRead.h"
+#include "Crc32.h"
+#include "PromCalib.h"
+#include "Trace.h"
+#include "utils.h"
 
 using namespace std;
 
-#define GEN2_PROM_VERSION  0xCED20000
-#define GEN2_MASK          (GEN2_PROM_VERSION >> 12)
-#define PROM_BLOCK_SIZE    0x4000 // Assume the smallest block size of 16-kword/block
-#define READ_MASK          0x80000000
 #define PROM_SIZE          0x002DF2FB
+#define PROM_BUFFER_WORDS_MAX 1024 // The largest write buffer of the layouts
 
-// Configuration: Force default configurations
-#define CONFIG_REG      0xFD4F
+// Blank check: the command of the part, or reading the block back
+#define BLANK_CHECK_UNKNOWN  0
+#define BLANK_CHECK_COMMAND  1
+#define BLANK_CHECK_READBACK 2
+
+// Programming a buffer again after a failed inline verify
+#define PROM_VERIFY_RETRIES   3
+
+// Typical block erase time, when no erase was timed (ns)
+#define PROM_ERASE_TYPICAL_NS 800000000LL
+
+// Register reads timed by measureMmioNs()
+#define MMIO_TIMED_READS 256
+
+// Gaps between bus operations longer than this are counted (ns)
+#define LONG_GAP_NS     100000
 
 // Constructor
 EvrCardG2Prom::EvrCardG2Prom (void volatile *mapStart, string pathToFile ) {   
+   init(mapStart,pathToFile,promLayout<PromGen2>(),true);
+}
+
+// Constructor of the drivers of the other layouts
+EvrCardG2Prom::EvrCardG2Prom (void volatile *mapStart, string pathToFile, 
+                              const PromLayout &layout, bool configure ) {   
+   init(mapStart,pathToFile,layout,configure);
+}
+
+void EvrCardG2Prom::init (void volatile *mapStart, string pathToFile, 
+                          const PromLayout &layout, bool configure ) {   
+   // Set the card generation
+   layout_ = layout;
+   if(layout_.bufferWords > PROM_BUFFER_WORDS_MAX) {
+      layout_.bufferWords = PROM_BUFFER_WORDS_MAX;
+   }
+   
    // Set the file path
    filePath = pathToFile;
    
    // Default PROM size without user data
    promSize_      = PROM_SIZE;   
    
-   // Setup the register Mapping
-   mapVersion = (void volatile *)((uint64_t)mapStart+0x10000);// Firmware version
-   mapBuild   = (void volatile *)((uint64_t)mapStart+0x10800);// Build string
-   mapData    = (void volatile *)((uint64_t)mapStart+0x20000);// Write Cmd/Data Bus
-   mapAddress = (void volatile *)((uint64_t)mapStart+0x20004);// Write/Read CMD + Address Bus
-   mapRead    = (void volatile *)((uint64_t)mapStart+0x20008);// Read Data Bus
+   // No progress reports by default
+   progress_      = NULL;
+   progressArg_   = NULL;
+   
+   // Read the file by default
+   image_         = NULL;
+   
+   // The partitions of the part; without, erase everything, then write
+   partitionWords_  = layout_.partitionWords;
+   overlap_         = false;
+   eraseNext_       = 0;
+   eraseBusy_       = 0;
+   eraseBusyOn_     = false;
+   eraseBlocks_     = 0;
+   eraseOverlapped_ = 0;
+   
+   // Verify after writing by default
+   inlineVerify_    = false;
+   verifyBuffers_   = 0;
+   verifyRetries_   = 0;
+   imageCrc_        = 0;
+   imageWords_      = 0;
+   
+   // Find out on the first block if the part has the blank check command
+   blankCheck_      = BLANK_CHECK_UNKNOWN;
+   resetEraseStats();
+   
+   // Nothing timed yet
+   programNs_       = 0;
+   programsTimed_   = 0;
+   verifyNs_        = 0;
+   verifyWords_     = 0;
+   
+   // No bus timing by default
+   jitterOn_      = false;
+   busOps_        = 0;
+   lastOpNs_      = 0;
+   maxGapNs_      = 0;
+   longGaps_      = 0;
+   
+   // Nothing on the bus yet
+   mmioWrites_    = 0;
+   mmioReads_     = 0;
+   
+   // Each write buffer word read back, see loadBufferWord()
+   postedLoad_    = false;
    
-   // Setup the configuration Register
-   writeToFlash(CONFIG_REG,0x60,0x03);
+   // Setup the register Mapping
+   mapVersion = (void volatile *)((uint64_t)mapStart+layout_.versionReg);// Firmware version
+   mapBuild   = (void volatile *)((uint64_t)mapStart+layout_.buildReg);// Build string
+   mapData    = (void volatile *)((uint64_t)mapStart+layout_.dataReg);// Write Cmd/Data Bus
+   mapAddress = (void volatile *)((uint64_t)mapStart+layout_.addressReg);// Write/Read CMD + Address Bus
+   mapRead    = (void volatile *)((uint64_t)mapStart+layout_.readReg);// Read Data Bus
+   
+   // Setup the configuration Register (not for a plan, which leaves the flash alone)
+   if(configure) {
+      writeToFlash(layout_.configAddr,layout_.configCmd,layout_.configData);
+   }
 }
 
 // Deconstructor
@@ -68,13 +150,82 @@ void EvrCardG2Prom::setPromSize (uint32_t promSize) {
    promSize_ = promSize;
 }
 
+void EvrCardG2Prom::setProgress (PromProgressFunc func, void *arg) {
+   progress_    = func;
+   progressArg_ = arg;
+}
+
+void EvrCardG2Prom::setImage (const string *image) {
+   image_ = image;
+}
+
+void EvrCardG2Prom::setInlineVerify (bool enable) {
+   inlineVerify_ = enable;
+}
+
+void EvrCardG2Prom::setPostedBufferLoad (bool enable) {
+   postedLoad_ = enable;
+}
+
+void EvrCardG2Prom::setPartitionWords (uint32_t words) {
+   // whole blocks only
+   partitionWords_ = words - words % layout_.blockWords;
+}
+
+bool EvrCardG2Prom::openMcs(McsRead &reader) {
+   if(image_ != NULL) {
+      return reader.openImage(*image_);
+   }
+   return reader.open(filePath);
+}
+
+static int64_t monotonicNs() {
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void EvrCardG2Prom::trackJitter (bool enable) {
+   jitterOn_ = enable;
+   busOps_   = 0;
+   lastOpNs_ = 0;
+   maxGapNs_ = 0;
+   longGaps_ = 0;
+}
+
+void EvrCardG2Prom::noteBusOp() {
+   int64_t now = monotonicNs();
+   if(lastOpNs_ != 0) {
+      int64_t gap = now - lastOpNs_;
+      if(gap > maxGapNs_) maxGapNs_ = gap;
+      if(gap > LONG_GAP_NS) longGaps_++;
+   }
+   lastOpNs_ = now;
+   busOps_++;
+}
+
+void EvrCardG2Prom::printJitter (const char *phase) {
+   if(!jitterOn_) return;
+   printf("JITTER: phase=%s bus_ops=%llu max_gap_us=%.1f gaps_over_%dus=%llu\n", phase, 
+          (unsigned long long)busOps_, maxGapNs_ / 1e3, LONG_GAP_NS / 1000, 
+          (unsigned long long)longGaps_);
+   trackJitter(true);
+}
+
+void EvrCardG2Prom::reportProgress(const char *phase, uint32_t done, uint32_t total) {
+   if(progress_ != NULL) {
+      progress_(progressArg_, phase, done < total ? done : total, total);
+   }
+}
+
 uint32_t EvrCardG2Prom::getPromSize (string pathToFile) {
+   TraceSpan span("mcs size");
    McsRead mcsReader;
    uint32_t retVar;
    mcsReader.open(pathToFile);
-   printf("Calculating PROM file (.mcs) Memory Address size ...");    
+   AINFO("Calculating PROM file (.mcs) Memory Address size ...");    
    retVar = mcsReader.addrSize();
-   printf("PROM Size = 0x%08x\n", retVar); 
+   AINFO("PROM Size = 0x%08x", retVar); 
    mcsReader.close();
    return retVar; 
 }
@@ -83,23 +234,41 @@ uint32_t EvrCardG2Prom::getPromSize (string pathToFile) {
 bool EvrCardG2Prom::checkFirmwareVersion ( ) {
    uint32_t firmwareVersion = *((uint32_t*)mapVersion);
    uint32_t EvrCardGen = firmwareVersion >> 12;
+
+   AINFO("Current Firmware Version on the FPGA: 0x%x", firmwareVersion);
+   AINFO("Current BuildStamp: %s", getBuildStamp().c_str());  
+   
+   if(EvrCardGen!=layout_.id){
+      AERR("Not a %s card", layout_.name);
+      return false;
+   } else {
+      return true;
+   }
+}
+
+//! The build string of the firmware (up to 256 characters)
+string EvrCardG2Prom::getBuildStamp ( ) {
    uint32_t i;
    uint32_t BuildStamp[64];
 
-   cout << "*******************************************************************" << endl;
-   cout << "Current Firmware Version on the FPGA: 0x" << hex << firmwareVersion << endl;
    for (i=0; i < 64; i++) {
       BuildStamp[i] = *((volatile uint32_t *)((uint64_t)mapBuild + (4*i) ));
    } 
-   cout << "Current BuildStamp: "   << string((char *)BuildStamp)  << endl;  
+   return string((char *)BuildStamp, strnlen((char *)BuildStamp, sizeof(BuildStamp)));
+}
+
+//! The average time of a firmware version register read (ns)
+double EvrCardG2Prom::measureMmioNs ( ) {
+   uint32_t i;
    
-   if(EvrCardGen!=GEN2_MASK){
-   cout << "*******************************************************************" << endl;
-      cout << "Error: Not a generation 2 EVR card" << endl;
-      return false;
-   } else {
-      return true;
+   // The first read may pay for the TLB and the link power state
+   (void)*((volatile uint32_t *)mapVersion);
+   
+   int64_t start = monotonicNs();
+   for (i=0; i < MMIO_TIMED_READS; i++) {
+      (void)*((volatile uint32_t *)mapVersion);
    }
+   return double(monotonicNs() - start) / MMIO_TIMED_READS;
 }
 
 //! Check if file exist (true=exists)
@@ -110,44 +279,43 @@ bool EvrCardG2Prom::fileExist ( ) {
 
 //! Print Power Cycle Reminder
 void EvrCardG2Prom::rebootReminder ( ) {
-   cout << "\n\n\n\n\n";
-   cout << "***************************************" << endl;
-   cout << "***************************************" << endl;
-   cout << "The new data written in the PROM has " << endl;
-   cout << "has been loaded into the FPGA. " << endl<< endl;
-   cout << "A reboot or power cycle is required " << endl;
-   cout << "to re-enumerate the PCIe card." << endl;
-   cout << "***************************************" << endl;
-   cout << "***************************************" << endl;
-   cout << "\n\n\n\n\n";
+   AINFO("The new data written in the PROM has been loaded into the FPGA.");
+   AINFO("A reboot or power cycle is required to re-enumerate the PCIe card.");
 }
 
 //! Erase the PROM
 void EvrCardG2Prom::eraseBootProm ( ) {
+   TraceSpan span("erase");
 
    uint32_t address = 0;
    double size = double(promSize_);
 
-   cout << "*******************************************************************" << endl;   
-   cout << "Starting Erasing ..." << endl; 
+   AINFO("Starting Erasing ..."); 
+   resetEraseStats();
    while(address<=promSize_) {       
       // Print the status to screen
-      cout << hex << "Erasing PROM from 0x" << address << " to 0x" << (address+PROM_BLOCK_SIZE-1);
-      cout << setprecision(3) << " ( " << ((double(address))/size)*100 << " percent done )" << endl;      
+      AINFO("Erasing PROM from 0x%x to 0x%x ( %.3g percent done )", address, 
+            address+layout_.blockWords-1, ((double(address))/size)*100);      
       
-      // execute the erase command
-      eraseCommand(address);
+      reportProgress("erase", address, promSize_);
+      
+      // execute the erase command, unless already erased
+      if(!blockBlank(address)) {
+         eraseCommand(address);
+      }
       
       //increment the address pointer
-      address += PROM_BLOCK_SIZE;
+      address += layout_.blockWords;
    }   
-   cout << "Erasing completed" << endl;
+   reportProgress("erase", promSize_, promSize_);
+   printEraseStats();
+   AINFO("Erasing completed");
 }
 
 //! Write the .mcs file to the PROM
 bool EvrCardG2Prom::bufferedWriteBootProm ( ) {
-   cout << "*******************************************************************" << endl;
-   cout << "Starting Writing ..." << endl; 
+   TraceSpan span("write");
+   AINFO("Starting Writing ..."); 
    McsRead mcsReader;
    McsReadData mem;
    
@@ -155,8 +323,9 @@ bool EvrCardG2Prom::bufferedWriteBootProm ( ) {
    uint16_t fileData;
    uint16_t i;
    
-   uint32_t bufAddr[256];  
-   uint16_t bufData[256];   
+   // the words of the write buffer, from bufBase on
+   uint32_t bufBase = 0;  
+   uint16_t bufData[PROM_BUFFER_WORDS_MAX];   
    uint16_t bufSize = 0;
    
    double size = double(promSize_);
@@ -165,21 +334,27 @@ bool EvrCardG2Prom::bufferedWriteBootProm ( ) {
    bool   toggle = false;
 
    //check for valid file path
-   if ( !mcsReader.open(filePath) ) {
+   if ( !openMcs(mcsReader) ) {
       mcsReader.close();
-      cout << "mcsReader.close() = file path error" << endl;
+      AERR("mcsReader.close() = file path error");
       return false;
    }  
    
    //reset the flags
    mem.endOfFile = false;      
+   verifyBuffers_ = 0;
+   verifyRetries_ = 0;
+   imageCrc_      = 0;
+   imageWords_    = 0;
+   programNs_     = 0;
+   programsTimed_ = 0;
    
    //read the entire mcs file
    while(!mem.endOfFile) {
    
       //read a line of the mcs file
       if (mcsReader.read(&mem)<0){
-         cout << "mcsReader.close() = line read error" << endl;
+         AERR("mcsReader.close() = line read error");
          mcsReader.close();
          return false;
       }
@@ -191,15 +366,23 @@ bool EvrCardG2Prom::bufferedWriteBootProm ( ) {
       } else {
          toggle = false;
          fileData |= ((uint16_t)mem.data << 8);
+         if(inlineVerify_) {
+            imageCrc_ = crc32Update(imageCrc_,&fileData,sizeof(fileData));
+         }
          
          // Latch the values
-         bufAddr[bufSize] = address;
+         if(bufSize==0) {
+            bufBase = address;
+         }
          bufData[bufSize] = fileData;
          bufSize++;
          
          // Check if we need to send the buffer
-         if(bufSize==256) {
-            bufferedProgramCommand(bufAddr,bufData,bufSize);
+         if(bufSize==layout_.bufferWords) {
+            if(!programBuffer(bufBase,bufData,bufSize)) {
+               mcsReader.close();
+               return false;
+            }
             bufSize = 0;
          }
 
@@ -208,30 +391,186 @@ bool EvrCardG2Prom::bufferedWriteBootProm ( ) {
          percentage *= 2.0;//factor of two from two 8-bit reads for every write 16 bit write
          if(percentage>=skim) {
             skim += 5.0;
-            cout << "Writing the PROM: " << percentage << " percent done" << endl;
+            AINFO("Writing the PROM: %g percent done", percentage);
+            reportProgress("write", address, promSize_/2);
          }         
       }
    }
    
    // Check if we need to send the buffer
    if(bufSize != 0) {
-      // Pad the end of the block with ones
-      for(i=bufSize;i<256;i++){
-         bufData[bufSize] = 0xFFFF;
+      // Pad the end of the block with ones (leaves the erased words as they are)
+      for(i=bufSize;i<layout_.bufferWords;i++){
+         bufData[i] = 0xFFFF;
       }
       // Send the last block program 
-      bufferedProgramCommand(bufAddr,bufData,256);  
+      if(!programBuffer(bufBase,bufData,layout_.bufferWords)) {
+         mcsReader.close();
+         return false;
+      }
    }     
    
    mcsReader.close();   
-   cout << "Writing completed" << endl;   
+   imageWords_ = address;
+   reportProgress("write", promSize_/2, promSize_/2);
+   AINFO("Writing completed");   
+   
+   if(inlineVerify_) {
+      AINFO("Inline verify: %u buffers, %u programmed again",
+            verifyBuffers_, verifyRetries_);
+   }
+   return true;
+}
+
+//! Erase and write the PROM: on parts with read-while-write partitions
+//! the blocks of the other partitions are erased while writing, so the
+//! whole takes about the longer of the two instead of their sum
+bool EvrCardG2Prom::eraseWriteBootProm ( ) {
+   bool ret;
+
+   if(partitionWords_ == 0) {
+      // No partitions: nothing can be written while erasing
+      eraseBootProm();
+      printJitter("erase");
+      return bufferedWriteBootProm();
+   }
+   
+   AINFO("Erasing while writing, partitions of 0x%x words", partitionWords_);
+   TraceSpan span("erase+write");
+   
+   overlap_         = true;
+   eraseNext_       = 0;
+   eraseBusyOn_     = false;
+   eraseBlocks_     = 0;
+   eraseOverlapped_ = 0;
+   resetEraseStats();
+   
+   ret = bufferedWriteBootProm();
+   
+   // Let the background erase finish, then the blocks past the image
+   if(eraseBusyOn_) {
+      while(!eraseDone(eraseBusy_));
+      eraseBusyOn_ = false;
+      eraseBlocks_++;
+   }
+   while(ret && eraseNext_<=promSize_) {
+      eraseThrough(eraseNext_);
+   }
+   overlap_ = false;
+   
+   reportProgress("erase", promSize_, promSize_);
+   AINFO("Erased %u blocks, %u of them while writing", eraseBlocks_, eraseOverlapped_);
+   printEraseStats();
+   return ret;
+}
+
+//! Erase all the blocks up to the end of the partition of 'address'
+void EvrCardG2Prom::eraseThrough(uint32_t address) {
+   uint32_t end = address - address % partitionWords_ + partitionWords_ - 1;
+   
+   // The background erase if it is in that partition
+   if(eraseBusyOn_ && eraseBusy_<=end) {
+      while(!eraseDone(eraseBusy_));
+      eraseBusyOn_ = false;
+      eraseBlocks_++;
+   }
+   
+   while(eraseNext_<=end && eraseNext_<=promSize_) {
+      reportProgress("erase", eraseNext_, promSize_);
+      if(!blockBlank(eraseNext_)) {
+         eraseCommand(eraseNext_);
+         eraseBlocks_++;
+      }
+      eraseNext_ += layout_.blockWords;
+   }
+}
+
+//! Poll the background erase and start the next one in another partition
+void EvrCardG2Prom::serviceErase(uint32_t address) {
+   if(eraseBusyOn_) {
+      if(!eraseDone(eraseBusy_)) {
+         return;
+      }
+      eraseBusyOn_ = false;
+      eraseBlocks_++;
+      eraseOverlapped_++;
+      reportProgress("erase", eraseBusy_, promSize_);
+   }
+   
+   // Never in the partition being written
+   while(eraseNext_<=promSize_ && 
+         eraseNext_/partitionWords_ != address/partitionWords_ &&
+         blockBlank(eraseNext_)) {
+      eraseNext_ += layout_.blockWords;
+   }
+   if(eraseNext_<=promSize_ && 
+      eraseNext_/partitionWords_ != address/partitionWords_) {
+      startErase(eraseNext_);
+      eraseBusy_   = eraseNext_;
+      eraseBusyOn_ = true;
+      eraseNext_  += layout_.blockWords;
+   }
+}
+
+//! Program a buffer, erasing its partition first if still needed
+bool EvrCardG2Prom::programBuffer(uint32_t base, const uint16_t *data, uint16_t words) {
+   if(overlap_) {
+      // Nothing in flight in this partition, everything erased
+      eraseThrough(base);
+      serviceErase(base);
+   }
+   TraceSpan span("program buffer");
+   int64_t start = monotonicNs();
+   bufferedProgramRange(base,data,words);
+   programNs_ += monotonicNs() - start;
+   programsTimed_++;
+   return !inlineVerify_ || verifyBuffer(base,data,words);
+}
+
+//! Read a buffer back right after programming it (true=matches)
+bool EvrCardG2Prom::verifyBuffer(uint32_t base, const uint16_t *data, uint16_t words) {
+   uint16_t promData[PROM_BUFFER_WORDS_MAX];
+   uint16_t i;
+   int retry;
+   
+   verifyBuffers_++;
+   
+   for(retry=0;;retry++) {
+      bool match = true;
+      bool stuck = false;
+      
+      readWords(base,promData,words);
+      for(i=0;i<words;i++) {
+         if(promData[i] != data[i]) {
+            match = false;
+            // Programming only clears bits, a 0 that should be 1 needs an erase
+            stuck = stuck || (~promData[i] & data[i]) != 0;
+         }
+      }
+      
+      if(match) {
+         break;
+      }
+      
+      if(stuck || retry == PROM_VERIFY_RETRIES) {
+         for(i=0;promData[i]==data[i];i++);
+         AERR("verifyBuffer error = invalid read back: address: 0x%x, "
+              "fileData: 0x%x, promData: 0x%x, %d retries", base+i, data[i], promData[i], retry);
+         return false;
+      }
+      
+      // Program the same data again in place
+      verifyRetries_++;
+      bufferedProgramRange(base,data,words);
+   }
+   
    return true;
 }
 
 //! Compare the .mcs file with the PROM (true=matches)
 bool EvrCardG2Prom::verifyBootProm ( ) {
-   cout << "*******************************************************************" << endl;
-   cout << "Starting Verification ..." << endl; 
+   TraceSpan span("verify");
+   AINFO("Starting Verification ..."); 
    McsRead mcsReader;
    McsReadData mem;
    
@@ -241,11 +580,12 @@ bool EvrCardG2Prom::verifyBootProm ( ) {
    double percentage;
    double skim = 5.0; 
    bool   toggle = false;
+   int64_t start = monotonicNs();
 
    //check for valid file path
-   if ( !mcsReader.open(filePath) ) {
+   if ( !openMcs(mcsReader) ) {
       mcsReader.close();
-      cout << "mcsReader.close() = file path error" << endl;
+      AERR("mcsReader.close() = file path error");
       return(1);
    }  
    
@@ -257,7 +597,7 @@ bool EvrCardG2Prom::verifyBootProm ( ) {
    
       //read a line of the mcs file
       if (mcsReader.read(&mem)<0){
-         cout << "mcsReader.close() = line read error" << endl;
+         AERR("mcsReader.close() = line read error");
          mcsReader.close();
          return false;
       }
@@ -271,11 +611,8 @@ bool EvrCardG2Prom::verifyBootProm ( ) {
          fileData |= ((uint16_t)mem.data << 8);
          promData = readWordCommand(address);                
          if(fileData != promData) {
-            cout << "verifyBootProm error = ";
-            cout << "invalid read back" <<  endl;
-            cout << hex << "\taddress: 0x"  << address << endl;
-            cout << hex << "\tfileData: 0x" << fileData << endl;
-            cout << hex << "\tpromData: 0x" << promData << endl;
+            AERR("verifyBootProm error = invalid read back: address: 0x%x, "
+                 "fileData: 0x%x, promData: 0x%x", address, fileData, promData);
             mcsReader.close();
             return false;
          }
@@ -284,21 +621,104 @@ bool EvrCardG2Prom::verifyBootProm ( ) {
          percentage *= 2.0;//factore of two from two 8-bit reads for every write 16 bit write
          if(percentage>=skim) {
             skim += 5.0;
-            cout << "Verifying the PROM: " << percentage << " percent done" << endl;
+            AINFO("Verifying the PROM: %g percent done", percentage);
+            reportProgress("verify", address, promSize_/2);
          }         
       }
    }
    
    mcsReader.close();  
-   cout << "Verification completed" << endl;
-   cout << "*******************************************************************" << endl;   
+   verifyNs_    = monotonicNs() - start;
+   verifyWords_ = address;
+   reportProgress("verify", promSize_/2, promSize_/2);
+   AINFO("Verification completed");
+   return true;
+}
+
+//! Read the image range back and compare its crc with that of the words
+//! parsed (true=matches): a word that never made it into a buffer or was
+//! disturbed after its buffer was checked, without parsing the file again
+bool EvrCardG2Prom::verifyImageCrc ( ) {
+   TraceSpan span("verify crc");
+   uint16_t promData[PROM_BUFFER_WORDS_MAX];
+   uint32_t promCrc = 0;
+   uint32_t address, words;
+   int64_t start = monotonicNs();
+
+   for(address=0;address<imageWords_;address+=words) {
+      words = imageWords_-address < layout_.bufferWords ? imageWords_-address : layout_.bufferWords;
+      readWords(address,promData,words);
+      promCrc = crc32Update(promCrc,promData,words*sizeof(promData[0]));
+   }
+
+   verifyNs_    = monotonicNs() - start;
+   verifyWords_ = imageWords_;
+   AINFO("Inline verify: %u words read back, image crc 0x%08x, PROM crc 0x%08x",
+         imageWords_, imageCrc_, promCrc);
+   if(promCrc != imageCrc_) {
+      AERR("verifyImageCrc error = the PROM crc differs from the image crc");
+      return false;
+   }
    return true;
 }
 
+//! Count what a load would do, without touching the PROM: the blocks
+//! eraseBootProm() checks (and erases at most, the blank ones are not
+//! known without reading them), the buffers programmed, the words
+bool EvrCardG2Prom::planBootProm (uint32_t *blocks, uint32_t *buffers, uint32_t *words) {
+   McsRead mcsReader;
+   McsReadData mem;
+   uint32_t bytes = 0;
+
+   //check for valid file path
+   if ( !openMcs(mcsReader) ) {
+      mcsReader.close();
+      AERR("mcsReader.close() = file path error");
+      return false;
+   }  
+   
+   //count the data bytes of the entire mcs file
+   mem.endOfFile = false;   
+   while(!mem.endOfFile) {
+      if (mcsReader.read(&mem)<0){
+         AERR("mcsReader.close() = line read error");
+         mcsReader.close();
+         return false;
+      }
+      bytes++;
+   }
+   mcsReader.close();  
+   
+   *blocks  = promSize_/layout_.blockWords + 1;
+   *words   = bytes/2;
+   *buffers = (*words + layout_.bufferWords - 1)/layout_.bufferWords;
+   return true;
+}
+
+//! Read the PROM back, e.g. to scrub it (see PromScrub.h)
+void EvrCardG2Prom::readPromWords (uint32_t address, uint16_t *data, uint32_t words) {
+   readWords(address,data,words);
+}
+
+//! The timings of this load per block, buffer and word (0 if not done)
+void EvrCardG2Prom::getCalibration (PromCalibration *calib, const string &card) {
+   calib->key       = promCalibKey(card,getBuildStamp());
+   calib->time      = time(NULL);
+   calib->fwVersion = *((volatile uint32_t *)mapVersion);
+   calib->eraseNs   = erasesTimed_ != 0 ? double(eraseNs_)/erasesTimed_ : 0;
+   calib->blankNs   = blankChecks_ != 0 ? double(blankCheckNs_)/blankChecks_ : 0;
+   calib->programNs = programsTimed_ != 0 ? double(programNs_)/programsTimed_ : 0;
+   calib->verifyNs  = verifyWords_ != 0 ? double(verifyNs_)/verifyWords_ : 0;
+}
+
 //! Erase Command
 void EvrCardG2Prom::eraseCommand(uint32_t address) {
-   uint16_t status = 0;
-   
+   startErase(address);
+   while(!eraseDone(address));
+}
+
+//! Start the erase of a block
+void EvrCardG2Prom::startErase(uint32_t address) {
    // Unlock the Block
    writeToFlash(address,0x60,0xD0);
    
@@ -308,30 +728,104 @@ void EvrCardG2Prom::eraseCommand(uint32_t address) {
    // Send the erase command
    writeToFlash(address,0x20,0xD0);
    
-   while(1) {
-      // Get the status register
-      status = readFlash(address,0x70);
+   eraseStartNs_ = monotonicNs();
+}
+
+//! Poll the erase of a block once (true=finished)
+bool EvrCardG2Prom::eraseDone(uint32_t address) {
+   // Get the status register (of the partition of 'address')
+   uint16_t status = readFlash(address,0x70);
+   
+   // Check for erasing failure
+   if ( (status&0x20) != 0 ) {
+      startErase(address);
+      return false;
+   }
+   
+   // Check for FLASH busy
+   if ( (status&0x80) == 0 ) {
+      return false;
+   }
+
+   // Lock the Block
+   writeToFlash(address,0x60,0x01);   
+   
+   int64_t now = monotonicNs();
+   eraseNs_ += now - eraseStartNs_;
+   erasesTimed_++;
+   if(traceOn) traceAdd("erase block", "", eraseStartNs_, now);
+   return true;
+}
+
+//! Check if a block is still erased (true=blank)
+bool EvrCardG2Prom::blockBlank(uint32_t address) {
+   int64_t start = monotonicNs();
+   uint16_t status = 0;
+   bool blank = true;
+   uint32_t i;
+   
+   if(blankCheck_ != BLANK_CHECK_READBACK) {
+      // Reset the status register
+      writeToFlash(address,0x50,0x50);
       
-      // Check for erasing failure
-      if ( (status&0x20) != 0 ) {
+      // Send the blank check command
+      writeToFlash(address,0xBC,0xD0);
       
-         // Unlock the Block
-         writeToFlash(address,0x60,0xD0);
-         
-         // Reset the status register
-         writeToFlash(address,0x50,0x50);   
-         
-         // Send the erase command
-         writeToFlash(address,0x20,0xD0);      
+      // Wait for FLASH not busy
+      do {
+         status = readFlash(address,0x70);
+      } while ( (status&0x80) == 0 );
       
-      // Check for FLASH not busy
-      } else if ( (status&0x80) != 0 ) {
-         break;
+      // Command sequence error: the part has no blank check
+      if ( (status&0x30) == 0x30 ) {
+         writeToFlash(address,0x50,0x50);
+         AINFO("No blank check command, reading the blocks back instead");
+         blankCheck_ = BLANK_CHECK_READBACK;
+      } else {
+         blankCheck_ = BLANK_CHECK_COMMAND;
+         blank = (status&0x20) == 0;
       }
-   } 
+   }
+   
+   if(blankCheck_ == BLANK_CHECK_READBACK) {
+      uint16_t promData[PROM_BUFFER_WORDS_MAX];
+      for(i=0;i<layout_.blockWords && blank;i+=layout_.bufferWords) {
+         readWords(address+i,promData,layout_.bufferWords);
+         for(uint32_t j=0;j<layout_.bufferWords && blank;j++) {
+            blank = promData[j] == 0xFFFF;
+         }
+      }
+   }
+   
+   int64_t now = monotonicNs();
+   blankCheckNs_ += now - start;
+   blankChecks_++;
+   if(traceOn) traceAdd("blank check", "", start, now);
+   if(blank) {
+      eraseSkipped_++;
+   }
+   return blank;
+}
 
-   // Lock the Block
-   writeToFlash(address,0x60,0x01);   
+void EvrCardG2Prom::resetEraseStats() {
+   eraseSkipped_  = 0;
+   blankCheckNs_  = 0;
+   eraseStartNs_  = 0;
+   eraseNs_       = 0;
+   erasesTimed_   = 0;
+   blankChecks_   = 0;
+}
+
+//! The erases avoided and the time saved, at the average erase time of this run
+void EvrCardG2Prom::printEraseStats() {
+   int64_t perErase = erasesTimed_ != 0 ? eraseNs_ / erasesTimed_ : PROM_ERASE_TYPICAL_NS;
+   
+   AINFO("Blank check (%s): %u erases avoided, %u done, %.1f ms checking, "
+         "%.1f s saved (%s erase time %.1f ms)", 
+         blankCheck_ == BLANK_CHECK_READBACK ? "readback" : "command",
+         eraseSkipped_, erasesTimed_, blankCheckNs_ / 1e6, 
+         (eraseSkipped_ * perErase - blankCheckNs_) / 1e9, 
+         erasesTimed_ != 0 ? "average" : "typical", perErase / 1e6);
 }
 
 //! Program Command
@@ -373,51 +867,46 @@ void EvrCardG2Prom::programCommand(uint32_t address, uint16_t data) {
    writeToFlash(address,0x60,0x01);   
 }
 
-//! Buffered Program Command
-void EvrCardG2Prom::bufferedProgramCommand(uint32_t *address, uint16_t *data, uint16_t size) {
+//! Buffered Program Command: 'words' words at 'base', 'base'+1, ...
+void EvrCardG2Prom::bufferedProgramRange(uint32_t base, const uint16_t *data, uint16_t words) {
    uint16_t status = 0;
-   uint16_t i;
    
    // Unlock the Block
-   writeToFlash(address[0],0x60,0xD0);
+   writeToFlash(base,0x60,0xD0);
    
    // Reset the status register
-   writeToFlash(address[0],0x50,0x50);
+   writeToFlash(base,0x50,0x50);
 
    // Send the buffer program command and size
-   writeToFlash(address[0],0xE8,(size-1));   
+   writeToFlash(base,0xE8,(words-1));   
    
    // Load the buffer
-   for(i=0;i<size;i++) {
-      readFlash(address[i],data[i]);
-   }
+   loadBuffer(base,data,words);
   
    // Confirm buffer programming
-   readFlash(address[0],0xD0);  
+   readFlash(base,0xD0);  
    
    while(1) {
       // Get the status register
-      status = readFlash(address[0],0x70);
+      status = readFlash(base,0x70);
       
       // Check for programming failure
       if ( (status&0x10) != 0 ) {
       
          // Unlock the Block
-         writeToFlash(address[0],0x60,0xD0);
+         writeToFlash(base,0x60,0xD0);
          
          // Reset the status register
-         writeToFlash(address[0],0x50,0x50);   
+         writeToFlash(base,0x50,0x50);   
          
          // Send the buffer program command and size
-         writeToFlash(address[0],0xE8,(size-1));   
+         writeToFlash(base,0xE8,(words-1));   
          
          // Load the buffer
-         for(i=0;i<size;i++) {
-            readFlash(address[i],data[i]);
-         }
+         loadBuffer(base,data,words);
         
          // Confirm buffer programming
-         readFlash(address[0],0xD0);                    
+         readFlash(base,0xD0);                    
       
       // Check for FLASH not busy
       } else if ( (status&0x80) != 0 ) {
@@ -426,7 +915,21 @@ void EvrCardG2Prom::bufferedProgramCommand(uint32_t *address, uint16_t *data, ui
    } 
 
    // Lock the Block
-   writeToFlash(address[0],0x60,0x01);   
+   writeToFlash(base,0x60,0x01);   
+}
+
+//! Load the write buffer after the 0xE8 command
+void EvrCardG2Prom::loadBuffer(uint32_t base, const uint16_t *data, uint16_t words) {
+   for(uint16_t i=0;i<words;i++) {
+      loadBufferWord(base+i,data[i]);
+   }
+}
+
+//! Read the array words from 'address' on
+void EvrCardG2Prom::readWords(uint32_t address, uint16_t *data, uint32_t words) {
+   for(uint32_t i=0;i<words;i++) {
+      data[i] = readWordCommand(address+i);
+   }
 }
 
 //! Read FLASH memory Command
@@ -443,6 +946,9 @@ uint32_t EvrCardG2Prom::genReqWord(uint16_t cmd, uint16_t data) {
 
 //! Generic FLASH write Command 
 void EvrCardG2Prom::writeToFlash(uint32_t address, uint16_t cmd, uint16_t data) {
+   if(jitterOn_) noteBusOp();
+   mmioWrites_ += 2;
+   
    asm("nop");//no operation function     
    
    // Set the data bus
@@ -451,13 +957,45 @@ void EvrCardG2Prom::writeToFlash(uint32_t address, uint16_t cmd, uint16_t data)
    asm("nop");//no operation function     
    
    // Set the address bus and initiate the transfer
-   *((uint32_t*)mapAddress) = (~READ_MASK & address);
+   *((uint32_t*)mapAddress) = (~layout_.readReq & address);
+}
+
+//! Write buffer load: the bus cycle of readFlash() with the data word as
+//! the command. The (meaningless) result is read back, which waits for
+//! the cycle to complete before the next one is started; with
+//! setPostedBufferLoad() it is not, saving a non-posted PCIe read per
+//! word, which is not yet checked on hardware
+void EvrCardG2Prom::loadBufferWord(uint32_t address, uint16_t data) {
+   if(jitterOn_) noteBusOp();
+   mmioWrites_ += 2;
+   
+   asm("nop");//no operation function        
+      
+   // Set the data bus
+   *((uint32_t*)mapData) = genReqWord(data,0xFF);
+   
+   asm("nop");//no operation function     
+   
+   // Set the address bus and initiate the transfer
+   *((uint32_t*)mapAddress) = (layout_.readReq | address);   
+   
+   if(!postedLoad_) {
+      asm("nop");//no operation function     
+      
+      // Read the data register (discarded)
+      mmioReads_++;
+      (void)*((uint32_t volatile*)mapRead);
+   }
 }
 
 //! Generic FLASH read Command
 uint16_t EvrCardG2Prom::readFlash(uint32_t address, uint16_t cmd) {
    uint32_t readReg;
       
+   if(jitterOn_) noteBusOp();
+   mmioWrites_ += 2;
+   mmioReads_++;
+   
    asm("nop");//no operation function        
       
    // Set the data bus
@@ -466,7 +1004,7 @@ uint16_t EvrCardG2Prom::readFlash(uint32_t address, uint16_t cmd) {
    asm("nop");//no operation function     
    
    // Set the address bus and initiate the transfer
-   *((uint32_t*)mapAddress) = (READ_MASK | address);   
+   *((uint32_t*)mapAddress) = (layout_.readReq | address);   
    
    asm("nop");//no operation function     
    
@@ -30,26 +30,63 @@
 
 #include <string.h>
 #include <stdint.h>
+#include <string>
+
+#include "PromGeneration.h"
 
 using namespace std;
 
+class McsRead;
+struct PromCalibration;
+
+//! Progress report: phase ("erase", "write" or "verify"), PROM addresses done and total
+typedef void (*PromProgressFunc)(void *arg, const char *phase, uint32_t done, uint32_t total);
+
 //! Class to contain generic register data.
 class EvrCardG2Prom {
    public:
 
-      //! Constructor
+      //! Constructor (EvrCardG2 layout, generic bus cycles; see PromRegistry for the drivers)
       EvrCardG2Prom (void volatile *mapStart, string pathToFile );
 
       //! Deconstructor
-      ~EvrCardG2Prom ( );
+      virtual ~EvrCardG2Prom ( );
       
       void setPromSize (uint32_t promSize);
       
       uint32_t getPromSize (string pathToFile);       
 
+      //! Report the progress to 'func' (NULL to stop)
+      void setProgress (PromProgressFunc func, void *arg);
+
+      //! Read the .mcs file from memory instead (NULL to stop)
+      void setImage (const string *image);
+
+      //! Read back and compare each buffer as it is written, see verifyBuffer()
+      void setInlineVerify (bool enable);
+
+      //! Load the write buffer without the read-back of each bus cycle, see loadBufferWord()
+      void setPostedBufferLoad (bool enable);
+
+      //! Read-while-write partition size in words (0: no partitions); the
+      //! layout's by default, set otherwise only for the flash simulation
+      void setPartitionWords (uint32_t words);
+
+      //! Time the gaps between the flash bus operations
+      void trackJitter (bool enable);
+
+      //! Print the gaps since the last call (or trackJitter()) and start over
+      void printJitter (const char *phase);
+
       //! Check for a valid firmware version 
       bool checkFirmwareVersion ( );
       
+      //! The build string of the firmware
+      string getBuildStamp ( );
+      
+      //! The time of a register read (a PCIe round trip) in ns
+      double measureMmioNs ( );
+      
       //! Check if file exist
       bool fileExist ( );      
       
@@ -59,11 +96,33 @@ class EvrCardG2Prom {
       //! Write the .mcs file to the PROM
       bool bufferedWriteBootProm ( );       
 
+      //! Erase and write, erasing the next partition while writing the current one
+      bool eraseWriteBootProm ( );
+
       //! Compare the .mcs file with the PROM
       bool verifyBootProm ( );     
 
+      //! After an inline verified write: compare the crc of the image words read back
+      bool verifyImageCrc ( );
+
       //! Print Reminder
       void rebootReminder ( );      
+      
+      //! The work of a load of the .mcs file: blocks to erase, buffers to program, words
+      bool planBootProm (uint32_t *blocks, uint32_t *buffers, uint32_t *words);
+      
+      //! Read 'words' words of the PROM from 'address' on
+      void readPromWords (uint32_t address, uint16_t *data, uint32_t words);
+      
+      //! The timings of the erase, write and verify done (see PromCalib.h)
+      void getCalibration (PromCalibration *calib, const string &card);
+      
+      //! The register accesses of the flash bus so far (each is a PCIe transaction)
+      uint64_t getMmioWrites ( ) const { return mmioWrites_; }
+      uint64_t getMmioReads ( ) const { return mmioReads_; }
+      
+      //! The card generation this is for
+      const PromLayout &getLayout ( ) const { return layout_; }
    
    private:
       // Local Variables
@@ -74,26 +133,128 @@ class EvrCardG2Prom {
       void volatile *mapData;
       void volatile *mapAddress;
       void volatile *mapRead;      
+      PromProgressFunc progress_;
+      void *progressArg_;
+      const string *image_;
+      
+      // erase scheduler of eraseWriteBootProm(), see setPartitionWords()
+      uint32_t partitionWords_;
+      bool     overlap_;
+      uint32_t eraseNext_;       // the next block to erase
+      uint32_t eraseBusy_;       // the block erasing in the background
+      bool     eraseBusyOn_;
+      uint32_t eraseBlocks_;     // blocks erased
+      uint32_t eraseOverlapped_; // of which while writing
+      
+      // inline verify, see verifyBuffer()
+      bool     inlineVerify_;
+      uint32_t verifyBuffers_;
+      uint32_t verifyRetries_;
+      uint32_t imageCrc_;        // of the words parsed
+      uint32_t imageWords_;
+      
+      // blank check before each erase, see blockBlank()
+      int      blankCheck_;      // BLANK_CHECK_xxx of the .cpp
+      uint32_t eraseSkipped_;    // blocks already blank
+      int64_t  blankCheckNs_;
+      int64_t  eraseStartNs_;    // of the erase in progress
+      int64_t  eraseNs_;         // of the erases done
+      uint32_t erasesTimed_;
+      uint32_t blankChecks_;
+      
+      // calibration, see getCalibration()
+      int64_t  programNs_;       // of the buffers programmed
+      uint32_t programsTimed_;
+      int64_t  verifyNs_;        // of verifyBootProm()
+      uint32_t verifyWords_;
+      
+      // flash bus timing, see trackJitter()
+      uint64_t busOps_;
+      int64_t lastOpNs_;
+      int64_t maxGapNs_;
+      uint64_t longGaps_;
+      
+      //! Open the .mcs file or the in-memory image
+      bool openMcs(McsRead &reader);
+      
+      //! Call the progress function if set
+      void reportProgress(const char *phase, uint32_t done, uint32_t total);
       
       //! Erase Command
       void eraseCommand(uint32_t address);
       
+      //! Start the erase of a block, see eraseDone()
+      void startErase(uint32_t address);
+      
+      //! Poll the erase once (true when finished, the block is locked again)
+      bool eraseDone(uint32_t address);
+      
+      //! Check if a block is still erased (true=all ones, no need to erase it)
+      bool blockBlank(uint32_t address);
+      
+      //! Start over / print the erases avoided by blockBlank()
+      void resetEraseStats();
+      void printEraseStats();
+      
+      //! Erase all the blocks up to the end of the partition of 'address'
+      void eraseThrough(uint32_t address);
+      
+      //! Poll and start the background erase while writing at 'address'
+      void serviceErase(uint32_t address);
+      
+      //! Program a buffer, once its blocks are erased
+      bool programBuffer(uint32_t base, const uint16_t *data, uint16_t words);
+      
+      //! Read a programmed buffer back, programming it again on a mismatch
+      bool verifyBuffer(uint32_t base, const uint16_t *data, uint16_t words);
+      
       //! Program Command
       void programCommand(uint32_t address, uint16_t data);
       
-      //! Buffered Program Command
-      void bufferedProgramCommand(uint32_t *address, uint16_t *data, uint16_t size);
-
+      //! Buffered Program Command of the words from 'base' on
+      void bufferedProgramRange(uint32_t base, const uint16_t *data, uint16_t words);
+      
       //! Read FLASH memory Command
       uint16_t readWordCommand(uint32_t address);
 
       //! Generate request word 
       uint32_t genReqWord(uint16_t cmd, uint16_t data);
 
-      //! Generic FLASH write Command
-      void writeToFlash(uint32_t address, uint16_t cmd, uint16_t data);
+   protected:
+      //! Constructor of the drivers of the other layouts; with configure=false the
+      //! flash isn't written to, only the firmware registers can be used then
+      EvrCardG2Prom (void volatile *mapStart, string pathToFile, const PromLayout &layout,
+                     bool configure = true);
+      
+      PromLayout layout_;
+      
+      // register accesses, see getMmioWrites()
+      uint64_t mmioWrites_;
+      uint64_t mmioReads_;
+      bool     postedLoad_;      // see setPostedBufferLoad()
+      
+      //! Account a bus operation for the gaps (if jitterOn_)
+      void noteBusOp();
+      bool jitterOn_;
+      
+      //! Generic FLASH write Command (overridden by the flash simulation)
+      virtual void writeToFlash(uint32_t address, uint16_t cmd, uint16_t data);
 
-      //! Generic FLASH read Command
-      uint16_t readFlash(uint32_t address, uint16_t cmd);        
+      //! Generic FLASH read Command (overridden by the flash simulation)
+      virtual uint16_t readFlash(uint32_t address, uint16_t cmd);        
+      
+      //! One word of the write buffer (overridden by the flash simulation)
+      virtual void loadBufferWord(uint32_t address, uint16_t data);
+      
+      //! Load the write buffer (after the buffered program command)
+      virtual void loadBuffer(uint32_t base, const uint16_t *data, uint16_t words);
+      
+      //! Read 'words' words of the array from 'address' on
+      virtual void readWords(uint32_t address, uint16_t *data, uint32_t words);
+      
+   private:
+      //! Setup of the constructors
+      void init(void volatile *mapStart, string pathToFile, const PromLayout &layout,
+                bool configure);
 };
 #endif
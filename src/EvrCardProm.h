@@ -0,0 +1,123 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#ifndef __EVR_CARD_PROM_H__
+#define __EVR_CARD_PROM_H__
+
+#include <stdint.h>
+
+#include <string>
+
+#include "PromGeneration.h"
+#include "EvrCardG2Prom.h"
+
+/*
+ * The PROM driver of the card generation 'Gen' (see PromGeneration.h):
+ * the erase/program/verify engine of EvrCardG2Prom with the flash bus
+ * cycles compiled for the generation's registers. The word loops of
+ * the write buffer and the read back are specialized too, so there is
+ * no virtual call nor layout lookup per word; with trackJitter() they
+ * take the per word path, which times each cycle.
+ */
+template <class Gen>
+class EvrCardProm : public EvrCardG2Prom {
+public:
+	
+	EvrCardProm(void volatile *mapStart, const std::string &pathToFile, 
+				bool configure = true)
+		: EvrCardG2Prom(mapStart, pathToFile, promLayout<Gen>(), configure)
+		, bar((volatile uint8_t *)mapStart)
+	{
+	}
+	
+protected:
+	
+	virtual void writeToFlash(uint32_t address, uint16_t cmd, uint16_t data)
+	{
+		if(jitterOn_) noteBusOp();
+		mmioWrites_ += 2;
+		cycle(Gen::request(cmd, data), ~Gen::READ_REQ & address);
+	}
+	
+	virtual uint16_t readFlash(uint32_t address, uint16_t cmd)
+	{
+		if(jitterOn_) noteBusOp();
+		mmioWrites_ += 2;
+		mmioReads_ ++;
+		cycle(Gen::request(cmd, 0xFF), Gen::READ_REQ | address);
+		return result();
+	}
+	
+	virtual void loadBufferWord(uint32_t address, uint16_t data)
+	{
+		if(jitterOn_) noteBusOp();
+		mmioWrites_ += 2;
+		cycle(Gen::request(data, 0xFF), Gen::READ_REQ | address);
+		if(!postedLoad_) {
+			mmioReads_ ++;
+			result();
+		}
+	}
+	
+	virtual void loadBuffer(uint32_t base, const uint16_t *data, uint16_t words)
+	{
+		if(jitterOn_) {
+			EvrCardG2Prom::loadBuffer(base, data, words);
+			return;
+		}
+		
+		if(postedLoad_) {
+			for(uint16_t i = 0; i < words; i ++) {
+				cycle(Gen::request(data[i], 0xFF), Gen::READ_REQ | (base + i));
+			}
+		} else {
+			for(uint16_t i = 0; i < words; i ++) {
+				cycle(Gen::request(data[i], 0xFF), Gen::READ_REQ | (base + i));
+				result();
+			}
+			mmioReads_ += words;
+		}
+		mmioWrites_ += 2 * words;
+	}
+	
+	virtual void readWords(uint32_t address, uint16_t *data, uint32_t words)
+	{
+		if(jitterOn_) {
+			EvrCardG2Prom::readWords(address, data, words);
+			return;
+		}
+		
+		for(uint32_t i = 0; i < words; i ++) {
+			cycle(Gen::request(0xFF, 0xFF), Gen::READ_REQ | (address + i));
+			data[i] = result();
+		}
+		mmioWrites_ += 2 * words;
+		mmioReads_ += words;
+	}
+	
+private:
+	
+	volatile uint8_t *bar;
+	
+	// set the data bus, then the address bus, which starts the cycle
+	void cycle(uint32_t request, uint32_t address)
+	{
+		*(volatile uint32_t *)(bar + Gen::DATA_REG) = request;
+		asm("nop");
+		*(volatile uint32_t *)(bar + Gen::ADDRESS_REG) = address;
+	}
+	
+	uint16_t result(void)
+	{
+		asm("nop");
+		return *(volatile uint32_t *)(bar + Gen::READ_REG) & 0xFFFF;
+	}
+};
+
+#endif // __EVR_CARD_PROM_H__
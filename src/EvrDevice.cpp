@@ -0,0 +1,275 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#include <string>
+#include <string.h>
+#include <stdint.h>
+
+#include "linux-evrma.h"
+#include "EvrDevice.h"
+#include "EvrEmulator.h"
+
+namespace {
+
+// The evrma kernel module's manager device.
+class KernelEvrDevice : public EvrDevice {
+public:
+	
+	KernelEvrDevice(int fd, const std::string &devName) : fd(fd), devName(devName) {}
+	
+	virtual ~KernelEvrDevice(void)
+	{
+		close(fd);
+	}
+	
+	virtual int getIoMemoryLength(int *length)
+	{
+		struct mngdev_config mngdev_config;
+		
+		int ret = ioctl(MNG_DEV_IOC_CONFIG, &mngdev_config);
+		if(ret == 0) {
+			*length = mngdev_config.io_memory_length;
+		}
+		return ret;
+	}
+	
+	virtual void *mapIo(int length)
+	{
+		return mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+	
+	virtual void unmapIo(void *ptr, int length)
+	{
+		munmap(ptr, length);
+	}
+	
+	virtual int ioctl(unsigned long request, void *data)
+	{
+		return ::ioctl(fd, request, data);
+	}
+	
+	virtual int findVirtDev(const std::string &name, int *id)
+	{
+		struct mngdev_ioctl_vdev_ids vDevData = {
+			0,
+			"",
+		};
+		
+		strncpy(vDevData.name, name.c_str(), sizeof(vDevData.name));
+		
+		int ret = ioctl(MNG_DEV_IOC_VIRT_DEV_FIND, &vDevData);
+		if(ret == 0) {
+			*id = vDevData.id;
+		}
+		return ret;
+	}
+	
+	virtual int createVirtDev(const std::string &name, int id)
+	{
+		struct mngdev_ioctl_vdev_ids vDevData = {
+			id,
+			"",
+		};
+		
+		strncpy(vDevData.name, name.c_str(), sizeof(vDevData.name));
+		
+		return ioctl(MNG_DEV_IOC_CREATE, &vDevData);
+	}
+	
+	virtual int destroyVirtDev(int id)
+	{
+		struct mngdev_ioctl_destroy vDevData = {
+			id
+		};
+		
+		return ioctl(MNG_DEV_IOC_DESTROY, &vDevData);
+	}
+	
+	virtual int allocPulsegen(int id, int prescalerLength, int delayLength, 
+							  int widthLength)
+	{
+		struct mngdev_ioctl_res vDevData = {
+			id,
+			"pulsegen",
+			-1,
+			{
+				prescalerLength,
+				delayLength,
+				widthLength
+			}
+		};
+		
+		return ioctl(MNG_DEV_IOC_ALLOC, &vDevData);
+	}
+	
+	virtual int allocOutput(int id, int absOutputNum)
+	{
+		struct mngdev_ioctl_res vDevData = {
+			id,
+			"output",
+			absOutputNum,
+		};
+		
+		return ioctl(MNG_DEV_IOC_ALLOC, &vDevData);
+	}
+	
+	virtual int setOutput(int id, int outputIndex, bool fromPulsegen, int source)
+	{
+		struct mngdev_evr_output_set outSetArgs = {
+			{
+				id,
+				{
+					{
+						EVR_RES_TYPE_OUTPUT,
+						outputIndex
+					},
+					{
+						EVR_RES_TYPE_PULSEGEN,
+						source
+					}
+				}
+			},
+			source
+		};
+		
+		if(!fromPulsegen) {
+			outSetArgs.header.vres[1].type = MODAC_RES_TYPE_NONE;
+		}
+		
+		return ioctl(MNG_DEV_EVR_IOC_OUTSET, &outSetArgs);
+	}
+	
+	virtual int evrInit(void)
+	{
+		struct mngdev_ioctl_hw_header dummyHeader = {
+			-1,
+			{
+				{
+					MODAC_RES_TYPE_NONE
+				},
+				{
+					MODAC_RES_TYPE_NONE
+				},
+			}
+		};
+		
+		return ioctl(MNG_DEV_EVR_IOC_INIT, &dummyHeader);
+	}
+	
+	virtual int readHwInfo(std::string *text)
+	{
+		std::string base = devName.substr(devName.rfind('/') + 1);
+		std::string path = "/sys/class/modac-mng/" + base + "/hw_info";
+		
+		int hwFd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if(hwFd < 0) {
+			return -1;
+		}
+		
+		char buf[4096];
+		ssize_t n;
+		
+		text->clear();
+		while((n = read(hwFd, buf, sizeof(buf))) > 0) {
+			text->append(buf, n);
+		}
+		
+		int err = errno;
+		close(hwFd);
+		errno = err;
+		
+		return n < 0 ? -1 : 0;
+	}
+	
+	virtual std::string vevrNodePath(const std::string &name)
+	{
+		// created by evrma's udev rules next to the manager node
+		return devName.substr(0, devName.rfind('/') + 1) + name;
+	}
+
+private:
+	
+	int fd;
+	std::string devName;
+};
+
+} // unnamed namespace
+
+
+
+RegFileEvrDevice::RegFileEvrDevice(int fd)
+	: fd(fd)
+{
+}
+
+RegFileEvrDevice::~RegFileEvrDevice(void)
+{
+	close(fd);
+}
+
+int RegFileEvrDevice::getIoMemoryLength(int *length)
+{
+	struct stat st;
+	
+	if(fstat(fd, &st) < 0) {
+		return -1;
+	}
+	*length = st.st_size;
+	return 0;
+}
+
+void *RegFileEvrDevice::mapIo(int length)
+{
+	return mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+}
+
+void RegFileEvrDevice::unmapIo(void *ptr, int length)
+{
+	munmap(ptr, length);
+}
+
+int RegFileEvrDevice::notSupported(void)
+{
+	errno = ENOTTY;
+	return -1;
+}
+
+
+
+size_t vevrEventBytes(void)
+{
+	return sizeof(struct evr_data_fifo_event);
+}
+
+EvrDevice *openEvrDevice(const std::string &devName)
+{
+	if(devName.compare(0, 4, "emu:") == 0) {
+		return EvrEmulator::open(devName.substr(4));
+	}
+	
+	int fd = open(devName.c_str(), O_RDWR | O_CLOEXEC);
+	if(fd < 0) {
+		return NULL;
+	}
+	
+	struct stat st;
+	if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+		return new RegFileEvrDevice(fd);
+	}
+	
+	return new KernelEvrDevice(fd, devName);
+}
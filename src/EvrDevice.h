@@ -0,0 +1,105 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#ifndef __EVR_DEVICE_H__
+#define __EVR_DEVICE_H__
+
+#include <string>
+
+/*
+ * The backend behind EvrManager: the manager device operations.
+ * 
+ * All the methods return what the corresponding ioctl would: >= 0 on
+ * success, -1 with errno set on failure.
+ */
+class EvrDevice {
+public:
+	
+	virtual ~EvrDevice(void) {}
+	
+	// MNG_DEV_IOC_CONFIG
+	virtual int getIoMemoryLength(int *length) = 0;
+	
+	// MAP_FAILED on error
+	virtual void *mapIo(int length) = 0;
+	virtual void unmapIo(void *ptr, int length) = 0;
+	
+	// the raw ioctl; fails with ENOTTY if there is no kernel behind
+	virtual int ioctl(unsigned long request, void *data) = 0;
+	
+	// MNG_DEV_IOC_VIRT_DEV_FIND
+	virtual int findVirtDev(const std::string &name, int *id) = 0;
+	
+	// MNG_DEV_IOC_CREATE, MNG_DEV_IOC_DESTROY
+	virtual int createVirtDev(const std::string &name, int id) = 0;
+	virtual int destroyVirtDev(int id) = 0;
+	
+	// MNG_DEV_IOC_ALLOC, returns the allocated absolute index
+	virtual int allocPulsegen(int id, int prescalerLength, int delayLength, 
+							  int widthLength) = 0;
+	virtual int allocOutput(int id, int absOutputNum) = 0;
+	
+	// MNG_DEV_EVR_IOC_OUTSET; 'source' is a virtual pulsegen index
+	// if 'fromPulsegen', else the source number
+	virtual int setOutput(int id, int outputIndex, bool fromPulsegen, int source) = 0;
+	
+	// MNG_DEV_EVR_IOC_INIT
+	virtual int evrInit(void) = 0;
+	
+	// the manager's hw_info text (see HwInfo.h)
+	virtual int readHwInfo(std::string *text) = 0;
+	
+	// the node the applications open to use the VEVR 'name' (closed when
+	// they let it go), "" if there is none
+	virtual std::string vevrNodePath(const std::string &name) = 0;
+};
+
+// A regular file mapped as the IO region; there are no ioctls.
+class RegFileEvrDevice : public EvrDevice {
+public:
+	
+	explicit RegFileEvrDevice(int fd);
+	virtual ~RegFileEvrDevice(void);
+	
+	virtual int getIoMemoryLength(int *length);
+	virtual void *mapIo(int length);
+	virtual void unmapIo(void *ptr, int length);
+	
+	virtual int ioctl(unsigned long, void *) { return notSupported(); }
+	virtual int findVirtDev(const std::string &, int *) { return notSupported(); }
+	virtual int createVirtDev(const std::string &, int) { return notSupported(); }
+	virtual int destroyVirtDev(int) { return notSupported(); }
+	virtual int allocPulsegen(int, int, int, int) { return notSupported(); }
+	virtual int allocOutput(int, int) { return notSupported(); }
+	virtual int setOutput(int, int, bool, int) { return notSupported(); }
+	virtual int evrInit(void) { return notSupported(); }
+	virtual int readHwInfo(std::string *) { return notSupported(); }
+	virtual std::string vevrNodePath(const std::string &) { return ""; }
+
+protected:
+	
+	int fd;
+	
+	static int notSupported(void);
+};
+
+// the size of one event record as returned by read() on a VEVR node
+size_t vevrEventBytes(void);
+
+/*
+ * Opens the backend for 'devName':
+ * - "emu:<file>": the user space emulation of the manager device
+ *   (see EvrEmulator.h) with its registers and state in <file>,
+ * - a regular file: mapped as the IO region, no ioctls,
+ * - otherwise the kernel manager device node, e.g. /dev/evr0mng.
+ * Returns NULL (errno set) if it can't be opened.
+ */
+EvrDevice *openEvrDevice(const std::string &devName);
+
+#endif // __EVR_DEVICE_H__
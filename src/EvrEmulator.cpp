@@ -0,0 +1,423 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <stdio.h>
+
+#include <string>
+
+#include "EvrEmulator.h"
+
+#define EVR_EMU_STATE_MAGIC    0x45564D55 // 'EVMU'
+#define EVR_EMU_STATE_VERSION  1
+
+struct EvrEmuPulsegen {
+	int prescalerLength;
+	int delayLength;
+	int widthLength;
+	int owner;                          // VEVR id, 0 if free
+};
+
+struct EvrEmuVevr {
+	int used;
+	char name[EVR_EMU_NAME_LEN];
+	int outputCount;
+	int outputs[EVR_EMU_MAX_RES];       // absolute index per virtual index
+	int outputSource[EVR_EMU_MAX_RES];  // -1 if not set
+	int outputFromPulsegen[EVR_EMU_MAX_RES];
+	int pulsegenCount;
+	int pulsegens[EVR_EMU_MAX_RES];     // absolute index per virtual index
+};
+
+struct EvrEmuState {
+	uint32_t magic;
+	uint32_t version;
+	int outputOwner[EVR_EMU_OUTPUTS];   // VEVR id, 0 if free
+	EvrEmuPulsegen pulsegen[EVR_EMU_PULSEGENS];
+	EvrEmuVevr vevr[EVR_EMU_MAX_VEVR + 1]; // by id, 0 is not used
+};
+
+namespace {
+
+const char *opNames[] = {
+	"config", "find", "create", "destroy", "alloc", "outset", "init"
+};
+
+// like an EVR300: a few pulse generators with a prescaler, the rest without
+void initState(EvrEmuState *state)
+{
+	memset(state, 0, sizeof(*state));
+	
+	for(int i = 0; i < EVR_EMU_PULSEGENS; i ++) {
+		state->pulsegen[i].prescalerLength = i < 4 ? 16 : 0;
+		state->pulsegen[i].delayLength = 32;
+		state->pulsegen[i].widthLength = i < 4 ? 32 : 16;
+	}
+	
+	state->version = EVR_EMU_STATE_VERSION;
+	state->magic = EVR_EMU_STATE_MAGIC;
+}
+
+size_t stateMapLength(void)
+{
+	size_t page = sysconf(_SC_PAGE_SIZE);
+	return (sizeof(EvrEmuState) + page - 1) / page * page;
+}
+
+} // unnamed namespace
+
+
+
+EvrEmulator *EvrEmulator::open(const std::string &filePath)
+{
+	int fd = ::open(filePath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if(fd < 0) {
+		return NULL;
+	}
+	
+	struct stat st;
+	off_t needed = EVR_EMU_IO_LENGTH + stateMapLength();
+	
+	if(fstat(fd, &st) < 0 || (st.st_size < needed && ftruncate(fd, needed) < 0)) {
+		int err = errno;
+		::close(fd);
+		errno = err;
+		return NULL;
+	}
+	
+	EvrEmuState *state = (EvrEmuState *)mmap(NULL, stateMapLength(), 
+						PROT_READ | PROT_WRITE, MAP_SHARED, fd, EVR_EMU_IO_LENGTH);
+	if(state == MAP_FAILED) {
+		int err = errno;
+		::close(fd);
+		errno = err;
+		return NULL;
+	}
+	
+	if(state->magic != EVR_EMU_STATE_MAGIC || state->version != EVR_EMU_STATE_VERSION) {
+		initState(state);
+	}
+	
+	return new EvrEmulator(fd, filePath, state);
+}
+
+EvrEmulator::EvrEmulator(int fd, const std::string &filePath, EvrEmuState *state)
+	: RegFileEvrDevice(fd)
+	, filePath(filePath)
+	, state(state)
+{
+	for(int i = 0; i < OP_COUNT; i ++) {
+		latencyNs[i] = 0;
+	}
+	
+	// "<us>[,<op>=<us>...]"
+	const char *env = getenv("EVR_EMU_LATENCY_US");
+	std::string spec = env != NULL ? env : "";
+	size_t pos = 0;
+	
+	while(pos < spec.size()) {
+		size_t comma = spec.find(',', pos);
+		if(comma == std::string::npos) {
+			comma = spec.size();
+		}
+		
+		std::string item = spec.substr(pos, comma - pos);
+		size_t eq = item.find('=');
+		
+		if(eq == std::string::npos) {
+			for(int i = 0; i < OP_COUNT; i ++) {
+				latencyNs[i] = atol(item.c_str()) * 1000L;
+			}
+		} else {
+			for(int i = 0; i < OP_COUNT; i ++) {
+				if(item.compare(0, eq, opNames[i]) == 0) {
+					latencyNs[i] = atol(item.c_str() + eq + 1) * 1000L;
+				}
+			}
+		}
+		
+		pos = comma + 1;
+	}
+	
+	env = getenv("EVR_EMU_BUSY");
+	if(env != NULL) {
+		busyNames = std::string(",") + env + ",";
+	}
+}
+
+EvrEmulator::~EvrEmulator(void)
+{
+	munmap(state, stateMapLength());
+}
+
+void EvrEmulator::delay(Op op)
+{
+	if(latencyNs[op] > 0) {
+		struct timespec ts = { latencyNs[op] / 1000000000L, latencyNs[op] % 1000000000L };
+		while(nanosleep(&ts, &ts) < 0 && errno == EINTR) {
+		}
+	}
+}
+
+int EvrEmulator::fail(int err)
+{
+	errno = err;
+	return -1;
+}
+
+bool EvrEmulator::isBusy(int id)
+{
+	std::string name = state->vevr[id].name;
+	
+	if(!busyNames.empty() && busyNames.find("," + name + ",") != std::string::npos) {
+		return true;
+	}
+	
+	// opened by an application: its node is flock'ed; looked up in
+	// /proc/locks, opening the node would wake up those watching it
+	struct stat st;
+	if(stat(vevrNodePath(name).c_str(), &st) < 0) {
+		return false;
+	}
+	
+	FILE *locks = fopen("/proc/locks", "r");
+	if(locks == NULL) {
+		return false;
+	}
+	
+	char line[256];
+	bool busy = false;
+	
+	while(!busy && fgets(line, sizeof(line), locks) != NULL) {
+		// "1: FLOCK  ADVISORY  WRITE 1234 08:01:5678 0 EOF"
+		char type[16];
+		unsigned maj, min;
+		unsigned long ino;
+		if(sscanf(line, "%*s %15s %*s %*s %*d %x:%x:%lu", type, &maj, &min, &ino) == 4
+		   && strcmp(type, "FLOCK") == 0 && ino == st.st_ino 
+		   && maj == major(st.st_dev) && min == minor(st.st_dev)) {
+			busy = true;
+		}
+	}
+	fclose(locks);
+	
+	return busy;
+}
+
+EvrEmuVevr *EvrEmulator::vevr(int id)
+{
+	if(id < 1 || id > EVR_EMU_MAX_VEVR || !state->vevr[id].used) {
+		errno = ENODEV;
+		return NULL;
+	}
+	return &state->vevr[id];
+}
+
+int EvrEmulator::getIoMemoryLength(int *length)
+{
+	delay(OP_CONFIG);
+	*length = EVR_EMU_IO_LENGTH;
+	return 0;
+}
+
+int EvrEmulator::findVirtDev(const std::string &name, int *id)
+{
+	delay(OP_FIND);
+	
+	for(int i = 1; i <= EVR_EMU_MAX_VEVR; i ++) {
+		if(state->vevr[i].used && name == state->vevr[i].name) {
+			*id = i;
+			return 0;
+		}
+	}
+	return fail(ENODEV);
+}
+
+int EvrEmulator::createVirtDev(const std::string &name, int)
+{
+	delay(OP_CREATE);
+	
+	if(name.empty() || name.size() >= EVR_EMU_NAME_LEN) {
+		return fail(EINVAL);
+	}
+	
+	int freeId = 0;
+	
+	for(int i = 1; i <= EVR_EMU_MAX_VEVR; i ++) {
+		if(state->vevr[i].used) {
+			if(name == state->vevr[i].name) {
+				return fail(EEXIST);
+			}
+		} else if(freeId == 0) {
+			freeId = i;
+		}
+	}
+	
+	if(freeId == 0) {
+		return fail(ENOSPC);
+	}
+	
+	EvrEmuVevr *v = &state->vevr[freeId];
+	memset(v, 0, sizeof(*v));
+	strncpy(v->name, name.c_str(), EVR_EMU_NAME_LEN - 1);
+	v->used = 1;
+	
+	return 0;
+}
+
+int EvrEmulator::destroyVirtDev(int id)
+{
+	delay(OP_DESTROY);
+	
+	EvrEmuVevr *v = vevr(id);
+	if(v == NULL) {
+		return -1;
+	}
+	if(isBusy(id)) {
+		return fail(EBUSY);
+	}
+	
+	for(int i = 0; i < EVR_EMU_OUTPUTS; i ++) {
+		if(state->outputOwner[i] == id) {
+			state->outputOwner[i] = 0;
+		}
+	}
+	for(int i = 0; i < EVR_EMU_PULSEGENS; i ++) {
+		if(state->pulsegen[i].owner == id) {
+			state->pulsegen[i].owner = 0;
+		}
+	}
+	
+	memset(v, 0, sizeof(*v));
+	return 0;
+}
+
+int EvrEmulator::allocPulsegen(int id, int prescalerLength, int delayLength, 
+							   int widthLength)
+{
+	delay(OP_ALLOC);
+	
+	EvrEmuVevr *v = vevr(id);
+	if(v == NULL) {
+		return -1;
+	}
+	if(isBusy(id)) {
+		return fail(EBUSY);
+	}
+	if(v->pulsegenCount >= EVR_EMU_MAX_RES) {
+		return fail(ENOSPC);
+	}
+	
+	// the first free one that fits, as the kernel does
+	for(int i = 0; i < EVR_EMU_PULSEGENS; i ++) {
+		EvrEmuPulsegen &pg = state->pulsegen[i];
+		if(pg.owner == 0 && pg.prescalerLength >= prescalerLength 
+		   && pg.delayLength >= delayLength && pg.widthLength >= widthLength) {
+			pg.owner = id;
+			v->pulsegens[v->pulsegenCount ++] = i;
+			return i;
+		}
+	}
+	
+	return fail(ENOSPC);
+}
+
+int EvrEmulator::allocOutput(int id, int absOutputNum)
+{
+	delay(OP_ALLOC);
+	
+	EvrEmuVevr *v = vevr(id);
+	if(v == NULL) {
+		return -1;
+	}
+	if(isBusy(id)) {
+		return fail(EBUSY);
+	}
+	if(absOutputNum < 0 || absOutputNum >= EVR_EMU_OUTPUTS) {
+		return fail(EINVAL);
+	}
+	if(state->outputOwner[absOutputNum] != 0) {
+		return fail(EEXIST);
+	}
+	if(v->outputCount >= EVR_EMU_MAX_RES) {
+		return fail(ENOSPC);
+	}
+	
+	state->outputOwner[absOutputNum] = id;
+	v->outputSource[v->outputCount] = -1;
+	v->outputs[v->outputCount ++] = absOutputNum;
+	
+	return absOutputNum;
+}
+
+int EvrEmulator::setOutput(int id, int outputIndex, bool fromPulsegen, int source)
+{
+	delay(OP_OUTSET);
+	
+	EvrEmuVevr *v = vevr(id);
+	if(v == NULL) {
+		return -1;
+	}
+	if(isBusy(id)) {
+		return fail(EBUSY);
+	}
+	if(outputIndex < 0 || outputIndex >= v->outputCount) {
+		return fail(EINVAL);
+	}
+	if(fromPulsegen && (source < 0 || source >= v->pulsegenCount)) {
+		return fail(EINVAL);
+	}
+	
+	v->outputSource[outputIndex] = source;
+	v->outputFromPulsegen[outputIndex] = fromPulsegen;
+	
+	return 0;
+}
+
+int EvrEmulator::evrInit(void)
+{
+	delay(OP_INIT);
+	return 0;
+}
+
+int EvrEmulator::readHwInfo(std::string *text)
+{
+	char line[64];
+	
+	text->assign("pulsegen:\n");
+	for(int i = 0; i < EVR_EMU_PULSEGENS; i ++) {
+		snprintf(line, sizeof(line), "PULSEGEN[%d]=P%d,D%d,W%d\n", i, 
+				 state->pulsegen[i].prescalerLength, state->pulsegen[i].delayLength, 
+				 state->pulsegen[i].widthLength);
+		text->append(line);
+	}
+	
+	text->append("output:\n");
+	for(int i = 0; i < EVR_EMU_OUTPUTS; i ++) {
+		snprintf(line, sizeof(line), "OUT[%d]=FP_UNIV[%d],MAP=xx\n", i, i);
+		text->append(line);
+	}
+	
+	return 0;
+}
+
+std::string EvrEmulator::vevrNodePath(const std::string &name)
+{
+	return filePath + "." + name;
+}
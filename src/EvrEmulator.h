@@ -0,0 +1,101 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#ifndef __EVR_EMULATOR_H__
+#define __EVR_EMULATOR_H__
+
+/*
+ * User space stand-in for the evrma manager device ("emu:<file>" as the
+ * manager device name), so the command paths can be run and profiled
+ * on any Linux machine without the kernel module or a card.
+ * 
+ * <file> is created if needed. It holds the register region
+ * (EVR_EMU_IO_LENGTH bytes, mapped like the card's BAR) followed by the
+ * emulated manager state (the VEVR table and the resource allocations),
+ * so the state lives on across evrManager invocations like the kernel's.
+ * 
+ * Emulated as the kernel module does it: up to EVR_EMU_MAX_VEVR VEVRs,
+ * outputs and pulse generators allocated from a fixed inventory (the
+ * first free pulse generator that fits), and the configuration of a
+ * VEVR that is in use can't be changed (EBUSY).
+ * 
+ * Environment:
+ *   EVR_EMU_LATENCY_US="<us>[,<op>=<us>...]"
+ *       added latency for every operation and per operation, where <op>
+ *       is one of config, find, create, destroy, alloc, outset, init,
+ *   EVR_EMU_BUSY="<vevr_name>[,...]"
+ *       the VEVRs that are considered opened by an application.
+ * 
+ * A VEVR is also in use while a process holds a flock on <file>.<vevr_name>
+ * (e.g. 'flock /tmp/emu0.vevr0 sleep 10'), which is the VEVR node.
+ */
+
+#include <string>
+
+#include "EvrDevice.h"
+
+#define EVR_EMU_IO_LENGTH       0x40000
+#define EVR_EMU_MAX_VEVR        31
+#define EVR_EMU_OUTPUTS         16
+#define EVR_EMU_PULSEGENS       16
+#define EVR_EMU_MAX_RES         32
+#define EVR_EMU_NAME_LEN        32
+
+struct EvrEmuState;
+
+class EvrEmulator : public RegFileEvrDevice {
+public:
+	
+	// NULL (errno set) on failure
+	static EvrEmulator *open(const std::string &filePath);
+	
+	virtual ~EvrEmulator(void);
+	
+	virtual int getIoMemoryLength(int *length);
+	
+	virtual int findVirtDev(const std::string &name, int *id);
+	virtual int createVirtDev(const std::string &name, int id);
+	virtual int destroyVirtDev(int id);
+	virtual int allocPulsegen(int id, int prescalerLength, int delayLength, 
+							  int widthLength);
+	virtual int allocOutput(int id, int absOutputNum);
+	virtual int setOutput(int id, int outputIndex, bool fromPulsegen, int source);
+	virtual int evrInit(void);
+	virtual int readHwInfo(std::string *text);
+	virtual std::string vevrNodePath(const std::string &name);
+
+private:
+	
+	enum Op {
+		OP_CONFIG,
+		OP_FIND,
+		OP_CREATE,
+		OP_DESTROY,
+		OP_ALLOC,
+		OP_OUTSET,
+		OP_INIT,
+		OP_COUNT
+	};
+	
+	std::string filePath;
+	EvrEmuState *state;
+	long latencyNs[OP_COUNT];
+	std::string busyNames;
+	
+	EvrEmulator(int fd, const std::string &filePath, EvrEmuState *state);
+	
+	void delay(Op op);
+	int fail(int err);
+	bool isBusy(int id);
+	
+	// the VEVR's table slot or NULL (errno set)
+	struct EvrEmuVevr *vevr(int id);
+};
+
+#endif // __EVR_EMULATOR_H__
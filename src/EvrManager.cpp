@@ -0,0 +1,551 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#include <string>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdexcept>
+#include <vector>
+#include <set>
+
+#include "utils.h"
+#include "linux-evr-regs.h"
+#include "EvrManager.h"
+#include "EvrDevice.h"
+#include "PromLoad.h"
+#include "PromCalib.h"
+#include "Trace.h"
+
+#ifndef C_EVR_IRQFLAG_VIOLATION
+#define C_EVR_IRQFLAG_VIOLATION 0 // receiver (link) violation
+#endif
+
+// the link must stay free of violations this long to be considered up
+#define EVR_READY_SETTLE_NS 10000000LL
+
+// polls done back-to-back before starting to sleep between them
+#define EVR_READY_SPIN_POLLS 1000
+
+#define EVR_READY_BACKOFF_MIN_NS 10000LL
+#define EVR_READY_BACKOFF_MAX_NS 1000000LL
+
+namespace {
+
+int64_t monotonicNs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+} // unnamed namespace
+
+EvrManager::EvrManager(const std::string &mngDevNodeName)
+	: fileBacked(false)
+	, journal(mngDevNodeName)
+	, readyTimeoutMs(EVR_READY_TIMEOUT_MS_DEFAULT)
+	, readyTimeMs(-1)
+	, readyPolls(0)
+	, calibCard(promCalibCard(mngDevNodeName))
+{
+	TraceSpan span("EvrManager", mngDevNodeName);
+	
+	{
+		TraceSpan span("open");
+		dev = openEvrDevice(mngDevNodeName);
+	}
+	if(dev == NULL) {
+		throw std::runtime_error("failed mng open");
+	}
+	
+	// no real registers behind, see waitReady()
+	fileBacked = dynamic_cast<RegFileEvrDevice *>(dev) != NULL;
+	
+	int ioMemoryLength = 0;
+	
+	int ret;
+	{
+		TraceSpan span("MNG_DEV_IOC_CONFIG");
+		ret = dev->getIoMemoryLength(&ioMemoryLength);
+	}
+	if(ret) {
+		AERR("MNG_DEV_IOC_CONFIG failed with errno=%d", errno);
+		delete dev;
+		throw std::runtime_error("MNG_DEV_IOC_CONFIG failed");
+	}
+	
+	if(ioMemoryLength > 0) {
+		
+		ioRegion.length = ioMemoryLength;
+		
+// 		ADBG("mmaping: %d", ioRegion.length);
+		
+		{
+			TraceSpan span("mmap");
+			ioRegion.ptr = (uint32_t *)dev->mapIo(ioRegion.length);
+		}
+		
+		if(ioRegion.ptr != MAP_FAILED) {
+// 			ADBG("IO mmap-ed pointer: 0x%x", (int)(size_t)ioRegion.ptr);
+		} else {
+			AERR("IO mmap failed with errno=%d", errno);
+			delete dev;
+			throw std::runtime_error("IO mmap failed");
+		}
+	}
+}
+
+EvrManager::~EvrManager()
+{
+	if(ioRegion.ptr != NULL) {
+		dev->unmapIo(ioRegion.ptr, ioRegion.length);
+	}
+
+	delete dev;
+}
+
+int EvrManager::checked(int ret)
+{
+	if(ret < 0) {
+		int err = errno;
+		ADBG("IOCTL failed, errno=%d", err);
+		errno = err;
+	}
+	
+	return ret;
+}
+
+int EvrManager::getVirtDevId(const std::string &virtDevName)
+{
+	TraceSpan span("MNG_DEV_IOC_VIRT_DEV_FIND", virtDevName);
+	int id = 0;
+	
+	// not found is an expected answer here, not worth a message
+	if(dev->findVirtDev(virtDevName, &id) < 0) {
+		return 0;
+	}
+	
+	return id;
+}
+
+int EvrManager::ioctl(unsigned long request, void *data)
+{
+	TraceSpan span("ioctl");
+	return checked(dev->ioctl(request, data));
+}
+
+int EvrManager::createVirtDev(const std::string &virtDevName, int id)
+{
+	int ret;
+	{
+		TraceSpan span("MNG_DEV_IOC_CREATE", virtDevName);
+		ret = checked(dev->createVirtDev(virtDevName, id));
+	}
+	
+	if(ret >= 0) {
+		// the id actually given
+		journal.recordCreate(getVirtDevId(virtDevName), virtDevName);
+	}
+	return ret;
+}
+
+int EvrManager::destroyVirtDev(int id)
+{
+	int ret;
+	{
+		TraceSpan span("MNG_DEV_IOC_DESTROY");
+		ret = checked(dev->destroyVirtDev(id));
+	}
+	
+	if(ret >= 0) {
+		journal.recordDestroy(id);
+	}
+	return ret;
+}
+
+int EvrManager::allocPulsegen(int id, int prescalerLength, int delayLength, int widthLength)
+{
+	int ret;
+	{
+		TraceSpan span("MNG_DEV_IOC_ALLOC pulsegen");
+		ret = checked(dev->allocPulsegen(id, prescalerLength, delayLength, widthLength));
+	}
+	
+	if(ret >= 0) {
+		journal.recordPulsegen(id, prescalerLength, delayLength, widthLength, ret);
+	}
+	return ret;
+}
+
+int EvrManager::allocOutput(int id, int absOutputNum)
+{
+	int ret;
+	{
+		TraceSpan span("MNG_DEV_IOC_ALLOC output");
+		ret = checked(dev->allocOutput(id, absOutputNum));
+	}
+	
+	if(ret >= 0) {
+		journal.recordOutput(id, absOutputNum);
+	}
+	return ret;
+}
+
+int EvrManager::setOutput(int id, int outputIndex, bool fromPulsegen, int source)
+{
+	int ret;
+	{
+		TraceSpan span("MNG_DEV_EVR_IOC_OUTSET");
+		ret = checked(dev->setOutput(id, outputIndex, fromPulsegen, source));
+	}
+	
+	if(ret >= 0) {
+		journal.recordOutset(id, outputIndex, fromPulsegen, source);
+	}
+	return ret;
+}
+
+	
+bool EvrManager::ioConfig(int what)
+{
+	TraceSpan span("ioConfig");
+	bool ret = true;
+		
+	
+	
+	if(what == IOCFG_INIT) {
+
+		// the dbuf is initially off; will be set by the subscriptions
+		ioRegion.write32(EVR_REG_DATA_BUF_CTRL, 0); 
+
+		ioRegion.write32(EVR_REG_FRAC_DIV, EVR_CLOCK_119000_MHZ);
+		ioRegion.write32(EVR_REG_CTRL, 0x0);
+		ioRegion.write32(EVR_REG_IRQEN, 0x0);
+		ioRegion.write32(EVR_REG_CTRL, (1 << C_EVR_CTRL_RESET_EVENTFIFO));
+		ioRegion.write32(EVR_REG_IRQFLAG, 0xFFFFFFFF);
+		ioRegion.write32(EVR_REG_EV_CNT_PRESC, 1);
+		
+		int res;
+		{
+			TraceSpan span("MNG_DEV_EVR_IOC_INIT");
+			res = checked(dev->evrInit());
+		}
+	
+		if(res < 0) {
+			AERR("MNG_DEV_EVR_IOC_INIT failed");
+			return false;
+		}
+
+		uint32_t regCtrl = ioRegion.read32(EVR_REG_CTRL);		
+		ioRegion.write32(EVR_REG_CTRL, regCtrl | (1 << C_EVR_CTRL_MASTER_ENABLE) | (1 << C_EVR_CTRL_RXLOOPBACK));
+		
+		// wait for the card to start operating
+		TraceSpan span("waitReady");
+		ret = waitReady();
+
+	}
+	
+	return ret;
+}
+
+
+/*
+ * Polls the card until the receiver is running: the master enable
+ * must read back as set and the link violation flag must stay clear
+ * for EVR_READY_SETTLE_NS after it was last cleared. Spins at first
+ * (most cards are ready within a few reads), then backs off
+ * exponentially so a missing link doesn't burn a CPU until the timeout.
+ */
+bool EvrManager::waitReady(void)
+{
+	const uint32_t violation = 1 << C_EVR_IRQFLAG_VIOLATION;
+	
+	int64_t start = monotonicNs();
+	int64_t deadline = start + (int64_t)readyTimeoutMs * 1000000LL;
+	int64_t cleanSince = start;
+	int64_t backoff = EVR_READY_BACKOFF_MIN_NS;
+	
+	uint32_t regCtrl = 0;
+	uint32_t regIrqFlag = 0;
+	
+	readyTimeMs = -1;
+	readyPolls = 0;
+	
+	if(fileBacked) {
+		// plain memory, the flags are not cleared by writing ones
+		readyTimeMs = 0;
+		return true;
+	}
+	
+	ioRegion.write32(EVR_REG_IRQFLAG, violation);
+	
+	while(1) {
+		
+		regCtrl = ioRegion.read32(EVR_REG_CTRL);
+		regIrqFlag = ioRegion.read32(EVR_REG_IRQFLAG);
+		readyPolls ++;
+		
+		int64_t now = monotonicNs();
+		
+		if(!(regCtrl & (1 << C_EVR_CTRL_MASTER_ENABLE)) || (regIrqFlag & violation)) {
+			// not yet; clear the flag and start the settle period over
+			ioRegion.write32(EVR_REG_IRQFLAG, violation);
+			cleanSince = now;
+		} else if(now - cleanSince >= EVR_READY_SETTLE_NS) {
+			readyTimeMs = (now - start) / 1e6;
+			return true;
+		}
+		
+		if(now >= deadline) {
+			break;
+		}
+		
+		if(readyPolls > EVR_READY_SPIN_POLLS) {
+			struct timespec ts = { 0, (long)backoff };
+			nanosleep(&ts, NULL);
+			if(backoff < EVR_READY_BACKOFF_MAX_NS) {
+				backoff *= 2;
+			}
+		}
+	}
+	
+	AERR("The card is not ready after %d ms (%u polls): CTRL=0x%08X, IRQFLAG=0x%08X", 
+		 readyTimeoutMs, readyPolls, regCtrl, regIrqFlag);
+	if(!(regCtrl & (1 << C_EVR_CTRL_MASTER_ENABLE))) {
+		AERR("The master enable bit did not stick");
+	}
+	if(regIrqFlag & violation) {
+		AERR("The receiver keeps reporting link violations; is the timing fiber connected?");
+	}
+	
+	return false;
+}
+
+
+uint32_t EvrManager::readFwVersion(void)
+{
+	return ioRegion.read32(EVR_REG_FW_VERSION);
+}
+
+
+bool EvrManager::ioPrtVersion(void)
+{
+	bool ret = false;
+
+	uint32_t fw_ver[2];
+
+	fw_ver[0] = readFwVersion();
+	fw_ver[1] = ioRegion.read32(EVR_REG_FW_VERSION_SLAC);
+
+	printf("FW_VERSION: 0x%08X\n", fw_ver[0]);
+/*
+	if(fw_ver[1]) {
+		printf(", SLAC FW_VERION: 0x%08X\n", bswap32(fw_ver[1]));
+	} else {
+		printf("\n");
+	}
+*/
+
+	return ret;	
+}
+
+
+bool EvrManager::promLoad(std::string filePath, PromProgressFunc progress, void *progressArg, 
+						  int flags, const std::string &calibPath)
+{
+	bool ret = false;
+
+	ADBG("%p %s", ioRegion.ptr, filePath.c_str());
+	TraceSpan span("promLoad", filePath);
+	ret = PromLoad(ioRegion.ptr, filePath, progress, progressArg, flags, 
+				   calibPath, calibCard) == 0;
+
+	return ret;
+}
+
+bool EvrManager::promScrub(const PromScrubConfig &config, PromScrubPauseFunc pause, 
+						   void *pauseArg)
+{
+	TraceSpan span("promScrub", config.referencePath);
+	
+	return PromScrub(ioRegion.ptr, config, pause, pauseArg) == 0;
+}
+
+bool EvrManager::promPlan(std::string filePath, int flags, const std::string &calibPath)
+{
+	TraceSpan span("promPlan", filePath);
+	
+	return PromPlan(ioRegion.ptr, filePath, flags, calibPath, calibCard) == 0;
+}
+
+bool EvrManager::readTemperature(double temp[2], uint32_t raw[2])
+{
+	int i;
+
+	if(!ioRegion.read32(EVR_REG_FW_VERSION_SLAC)) {
+		return false;
+	}
+
+	raw[0] = bswap32(ioRegion.read32(AXIXADC_REG_TEMPERATURE))>>4;
+	raw[1] = bswap32(ioRegion.read32(AXIXADC_REG_MAXTEMPERATURE))>>4;
+
+	for(i=0;i<2;i++) temp[i] = double(unsigned(raw[i])) * (503.975/4096.) - 273.15;
+	
+	return true;
+}
+
+bool EvrManager::readHwInfo(HwInfo *info)
+{
+	std::string text;
+	
+	if(dev->readHwInfo(&text) < 0) {
+		return false;
+	}
+	
+	if(!info->parse(text)) {
+		errno = ENODATA;
+		return false;
+	}
+	
+	return true;
+}
+
+bool EvrManager::readConfig(std::vector<ConfigRecord> *config)
+{
+	if(!journal.read(*config)) {
+		return false;
+	}
+	
+	std::set<int> gone;
+	
+	for(size_t i = 0; i < config->size(); i ++) {
+		const ConfigRecord &rec = (*config)[i];
+		if(rec.type == ConfigRecord::VEVR && getVirtDevId(rec.name) != rec.id) {
+			gone.insert(rec.id);
+		}
+	}
+	
+	if(gone.empty()) {
+		return true;
+	}
+	
+	std::vector<ConfigRecord> live;
+	for(size_t i = 0; i < config->size(); i ++) {
+		if(gone.find((*config)[i].id) == gone.end()) {
+			live.push_back((*config)[i]);
+		}
+	}
+	
+	config->swap(live);
+	journal.rewrite(*config);
+	
+	return true;
+}
+
+bool EvrManager::ioPrtTemperature(void)
+{
+	bool ret = false;
+
+	uint32_t raw_temp[2];
+	double   temp[2];
+
+	if(!readTemperature(temp, raw_temp)) {
+		ret = true;
+		printf("The temperature register is not available for this module\n");
+		return ret;
+	}
+
+	printf("Temperature: (current) %6.2lf degC / 0x%04x, (max) %6.2lf degC / 0x%04x\n", 
+	temp[0], raw_temp[0], temp[1], raw_temp[1]);
+
+	
+	
+
+	return ret;
+}
+
+
+
+std::string CardLock::lockFilePath(const std::string &mngDevNodeName)
+{
+	std::string base = mngDevNodeName;
+	size_t slash = base.rfind('/');
+	
+	if(slash != std::string::npos) {
+		base = base.substr(slash + 1);
+	}
+	
+	const char *dir = "/var/lock";
+	if(access(dir, W_OK) != 0) {
+		dir = "/tmp";
+	}
+	
+	return std::string(dir) + "/evrManager." + base + ".lock";
+}
+
+CardLock::CardLock(const std::string &mngDevNodeName, bool take)
+	: fd(-1)
+{
+	if(!take) {
+		return;
+	}
+	
+	std::string path = lockFilePath(mngDevNodeName);
+	
+	fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+	if(fd < 0) {
+		AERR("Can't open the lock file '%s', errno=%d", path.c_str(), errno);
+		return;
+	}
+	
+	lock();
+}
+
+void CardLock::lock(void)
+{
+	if(fd < 0) {
+		return;
+	}
+	
+	// blocks until the other user of the card is done
+	while(flock(fd, LOCK_EX) < 0) {
+		if(errno != EINTR) {
+			AERR("Can't lock the card, errno=%d", errno);
+			close(fd);
+			fd = -1;
+			return;
+		}
+	}
+}
+
+void CardLock::unlock(void)
+{
+	if(fd >= 0) {
+		flock(fd, LOCK_UN);
+	}
+}
+
+CardLock::~CardLock()
+{
+	if(fd >= 0) {
+		// closing the descriptor releases the lock
+		close(fd);
+	}
+}
@@ -0,0 +1,171 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#ifndef __EVR_MANAGER_H__
+#define __EVR_MANAGER_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+#include "utils.h"
+#include "PromLoad.h"
+#include "PromScrub.h"
+#include "HwInfo.h"
+#include "ConfigJournal.h"
+
+class EvrDevice;
+
+struct IoRegion {
+	
+	uint32_t *ptr;
+	int	length;
+	
+	explicit IoRegion(void)
+		: ptr(NULL)
+		, length(0)
+	{
+	}
+	
+	void write32(int regAddr, uint32_t value)
+	{
+		((volatile uint32_t *)ptr)[regAddr / 4] = cpu_to_be32(value);
+	}
+	
+	uint32_t read32(int regAddr)
+	{
+		uint32_t value = ((volatile uint32_t *)ptr)[regAddr / 4];
+		return be32_to_cpu(value);
+	}
+};
+
+enum {
+	IOCFG_INIT,
+};
+
+// default time to wait for the card to become ready after init
+#define EVR_READY_TIMEOUT_MS_DEFAULT 1000
+
+class EvrManager {
+public:
+	
+	// 'mngDevNodeName' may also be a regular file or the emulated
+	// manager device, see openEvrDevice()
+	explicit EvrManager(const std::string &mngDevNodeName);
+	virtual ~EvrManager();
+	
+	// will return 0 on any error
+	int getVirtDevId(const std::string &virtDevName);
+	
+	// the raw ioctl (only with the kernel manager device)
+	int ioctl(unsigned long request, void *data = NULL);
+	
+	// the manager operations; as the ioctls, -1 and errno set on failure;
+	// the successful ones are recorded in the card's ConfigJournal
+	int createVirtDev(const std::string &virtDevName, int id);
+	int destroyVirtDev(int id);
+	int allocPulsegen(int id, int prescalerLength, int delayLength, int widthLength);
+	int allocOutput(int id, int absOutputNum);
+	int setOutput(int id, int outputIndex, bool fromPulsegen, int source);
+	
+	bool ioConfig(int what);
+	
+	void setReadyTimeout(int timeoutMs) { readyTimeoutMs = timeoutMs; }
+	
+	// the time it took the card to become ready in the last init, -1 if it didn't
+	double getReadyTimeMs(void) const { return readyTimeMs; }
+	unsigned getReadyPolls(void) const { return readyPolls; }
+	bool ioPrtVersion(void);
+	// 'flags' are the PROM_LOAD_xxx of PromLoad(), 'calibPath' as well
+	bool promLoad(std::string filePath, PromProgressFunc progress = NULL, 
+				  void *progressArg = NULL, int flags = 0, const std::string &calibPath = "");
+	// reads the PROM back against a reference image, see PromScrub()
+	bool promScrub(const PromScrubConfig &config, PromScrubPauseFunc pause = NULL, 
+				   void *pauseArg = NULL);
+	// prints the time promLoad() would take, see PromPlan()
+	bool promPlan(std::string filePath, int flags = 0, const std::string &calibPath = "");
+	bool ioPrtTemperature(void);
+	
+	uint32_t readFwVersion(void);
+	
+	uint32_t readReg(int regAddr) { return ioRegion.read32(regAddr); }
+	void writeReg(int regAddr, uint32_t value) { ioRegion.write32(regAddr, value); }
+	int getIoLength(void) const { return ioRegion.length; }
+	bool isFileBacked(void) const { return fileBacked; }
+	
+	// the backend, for the calls that must not be logged (benchmarks)
+	EvrDevice &getDevice(void) { return *dev; }
+	
+	// the resources of the card; false (errno set) if not available
+	bool readHwInfo(HwInfo *info);
+	
+	/*
+	 * The live configuration, from the journal; the records of the VEVRs
+	 * that are no longer on the card are dropped (and the journal
+	 * compacted). False (errno set) if the journal is of another instance.
+	 */
+	bool readConfig(std::vector<ConfigRecord> *config);
+	
+	// false if the card has no temperature registers
+	bool readTemperature(double temp[2], uint32_t raw[2]);
+
+private:
+	
+	EvrDevice *dev;
+	bool fileBacked;
+	IoRegion ioRegion;
+	ConfigJournal journal;
+	
+	int readyTimeoutMs;
+	double readyTimeMs;
+	unsigned readyPolls;
+	
+	// the card in the PROM calibration database, see promCalibCard()
+	std::string calibCard;
+	
+	bool waitReady(void);
+	int checked(int ret);
+	
+	EvrManager(const EvrManager &);
+	EvrManager &operator=(const EvrManager &);
+	
+};
+
+/*
+ * Exclusive per-card lock, so that separate evrManager invocations
+ * (and the threads of a single '--all' invocation) never drive the
+ * same card at the same time. The lock is held for the lifetime
+ * of the object and released by the kernel if the process dies.
+ */
+class CardLock {
+public:
+	
+	// with 'take' false the object does nothing (for read-only long runners)
+	explicit CardLock(const std::string &mngDevNodeName, bool take = true);
+	~CardLock();
+	
+	bool isLocked(void) const { return fd >= 0; }
+	
+	// let the others in for a while (no-ops if the lock wasn't taken)
+	void unlock(void);
+	void lock(void);
+	
+	static std::string lockFilePath(const std::string &mngDevNodeName);
+
+private:
+	
+	int fd;
+	
+	CardLock(const CardLock &);
+	CardLock &operator=(const CardLock &);
+};
+
+#endif // __EVR_MANAGER_H__
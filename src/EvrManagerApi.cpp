@@ -0,0 +1,329 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <string>
+#include <stdexcept>
+#include <new>
+
+#include "EvrManagerApi.h"
+#include "EvrManager.h"
+#include "EvrDevice.h"
+
+struct EvrManagerHandle {
+	
+	EvrManager *manager;
+	std::string mngDevNodeName;
+	pthread_mutex_t mutex;
+};
+
+namespace {
+
+/*
+ * Serializes the calls on a handle and, for the calls that change the
+ * card, also takes the card lock (held by the evrManager executable
+ * for the whole of its commands).
+ */
+class HandleLock {
+public:
+	
+	HandleLock(EvrManagerHandle *handle, bool exclusive)
+		: handle(handle)
+		, cardLock(NULL)
+	{
+		pthread_mutex_lock(&handle->mutex);
+		if(exclusive) {
+			cardLock = new CardLock(handle->mngDevNodeName);
+		}
+	}
+	
+	~HandleLock()
+	{
+		delete cardLock;
+		pthread_mutex_unlock(&handle->mutex);
+	}
+
+private:
+	
+	EvrManagerHandle *handle;
+	CardLock *cardLock;
+	
+	HandleLock(const HandleLock &);
+	HandleLock &operator=(const HandleLock &);
+};
+
+// the EvrManager operations return -1 and set errno
+int result(int ret)
+{
+	if(ret >= 0) {
+		return ret;
+	}
+	
+	return errno > 0 ? -errno : -EIO;
+}
+
+int findVirtDev(EvrManagerHandle *handle, const char *virtDevName)
+{
+	int id = handle->manager->getVirtDevId(virtDevName);
+	
+	return id > 0 ? id : -ENODEV;
+}
+
+struct ProgressForward {
+	EvrManagerProgressFunc func;
+	void *arg;
+};
+
+void forwardProgress(void *arg, const char *phase, uint32_t done, uint32_t total)
+{
+	ProgressForward *fwd = (ProgressForward *)arg;
+	
+	fwd->func(fwd->arg, phase, done, total);
+}
+
+// EVR_MANAGER_PROM_xxx to PROM_LOAD_xxx
+int promLoadFlags(int flags)
+{
+	int ret = 0;
+	
+	if(flags & EVR_MANAGER_PROM_PRELOAD) {
+		ret |= PROM_LOAD_PRELOAD;
+	}
+	if(flags & EVR_MANAGER_PROM_JITTER) {
+		ret |= PROM_LOAD_JITTER;
+	}
+	if(flags & EVR_MANAGER_PROM_INLINE_VERIFY) {
+		ret |= PROM_LOAD_INLINE_VERIFY;
+	}
+	if(flags & EVR_MANAGER_PROM_POSTED_BUFFER) {
+		ret |= PROM_LOAD_POSTED_BUFFER;
+	}
+	
+	return ret;
+}
+
+// strerror() shares one buffer between the threads
+__thread char strErrorBuf[128];
+
+} // unnamed namespace
+
+int evrManagerApiVersion(void)
+{
+	return EVR_MANAGER_API_VERSION;
+}
+
+int evrManagerOpen(const char *mngDevNodeName, EvrManagerHandle **handle)
+{
+	if(mngDevNodeName == NULL || handle == NULL) {
+		return -EINVAL;
+	}
+	
+	*handle = NULL;
+	
+	EvrManagerHandle *h = new(std::nothrow) EvrManagerHandle;
+	if(h == NULL) {
+		return -ENOMEM;
+	}
+	
+	try {
+		h->mngDevNodeName = mngDevNodeName;
+		h->manager = new EvrManager(h->mngDevNodeName);
+	} catch(std::exception &e) {
+		int err = errno > 0 ? errno : ENODEV;
+		AERR("Can't open '%s': %s", mngDevNodeName, e.what());
+		delete h;
+		return -err;
+	}
+	
+	pthread_mutex_init(&h->mutex, NULL);
+	
+	*handle = h;
+	return 0;
+}
+
+void evrManagerClose(EvrManagerHandle *handle)
+{
+	if(handle == NULL) {
+		return;
+	}
+	
+	delete handle->manager;
+	pthread_mutex_destroy(&handle->mutex);
+	delete handle;
+}
+
+int evrManagerInit(EvrManagerHandle *handle, int timeoutMs)
+{
+	HandleLock lock(handle, true);
+	
+	handle->manager->setReadyTimeout(timeoutMs > 0 ? timeoutMs : EVR_READY_TIMEOUT_MS_DEFAULT);
+	
+	if(!handle->manager->ioConfig(IOCFG_INIT)) {
+		return handle->manager->getReadyPolls() > 0 ? -ETIMEDOUT : -EIO;
+	}
+	
+	return 0;
+}
+
+int evrManagerCreate(EvrManagerHandle *handle, const char *virtDevName)
+{
+	HandleLock lock(handle, true);
+	
+	if(handle->manager->getVirtDevId(virtDevName) > 0) {
+		return -EEXIST;
+	}
+	
+	return result(handle->manager->createVirtDev(virtDevName, 0));
+}
+
+int evrManagerDestroy(EvrManagerHandle *handle, const char *virtDevName)
+{
+	HandleLock lock(handle, true);
+	
+	int id = findVirtDev(handle, virtDevName);
+	if(id < 0) {
+		return id;
+	}
+	
+	return result(handle->manager->destroyVirtDev(id));
+}
+
+int evrManagerAllocPulsegen(EvrManagerHandle *handle, const char *virtDevName,
+							int prescalerLength, int delayLength, int widthLength)
+{
+	HandleLock lock(handle, true);
+	
+	int id = findVirtDev(handle, virtDevName);
+	if(id < 0) {
+		return id;
+	}
+	
+	return result(handle->manager->allocPulsegen(id, prescalerLength, delayLength, widthLength));
+}
+
+int evrManagerAllocOutput(EvrManagerHandle *handle, const char *virtDevName,
+						  int absOutputNum)
+{
+	HandleLock lock(handle, true);
+	
+	int id = findVirtDev(handle, virtDevName);
+	if(id < 0) {
+		return id;
+	}
+	
+	return result(handle->manager->allocOutput(id, absOutputNum));
+}
+
+int evrManagerOutputSet(EvrManagerHandle *handle, const char *virtDevName,
+						int outputIndex, int fromPulsegen, int source)
+{
+	HandleLock lock(handle, true);
+	
+	int id = findVirtDev(handle, virtDevName);
+	if(id < 0) {
+		return id;
+	}
+	
+	return result(handle->manager->setOutput(id, outputIndex, fromPulsegen != 0, source));
+}
+
+int evrManagerVirtDevNode(EvrManagerHandle *handle, const char *virtDevName,
+						  char *path, size_t size)
+{
+	HandleLock lock(handle, false);
+	
+	std::string node = handle->manager->getDevice().vevrNodePath(virtDevName);
+	
+	if(node.empty()) {
+		return -ENOTSUP;
+	}
+	if(node.size() >= size) {
+		return -ERANGE;
+	}
+	
+	memcpy(path, node.c_str(), node.size() + 1);
+	
+	return 0;
+}
+
+int evrManagerVersion(EvrManagerHandle *handle, uint32_t *fwVersion)
+{
+	HandleLock lock(handle, false);
+	
+	*fwVersion = handle->manager->readFwVersion();
+	
+	return 0;
+}
+
+int evrManagerTemperature(EvrManagerHandle *handle, double *current, double *max,
+						  uint32_t *rawCurrent, uint32_t *rawMax)
+{
+	HandleLock lock(handle, false);
+	
+	double temp[2];
+	uint32_t raw[2];
+	
+	if(!handle->manager->readTemperature(temp, raw)) {
+		return -ENOTSUP;
+	}
+	
+	*current = temp[0];
+	*max = temp[1];
+	if(rawCurrent != NULL) {
+		*rawCurrent = raw[0];
+	}
+	if(rawMax != NULL) {
+		*rawMax = raw[1];
+	}
+	
+	return 0;
+}
+
+int evrManagerPromLoad(EvrManagerHandle *handle, const char *mcsFilePath,
+					   EvrManagerProgressFunc progress, void *progressArg)
+{
+	return evrManagerPromLoadEx(handle, mcsFilePath, progress, progressArg, 0, NULL);
+}
+
+int evrManagerPromLoadEx(EvrManagerHandle *handle, const char *mcsFilePath,
+						 EvrManagerProgressFunc progress, void *progressArg,
+						 int flags, const char *calibPath)
+{
+	HandleLock lock(handle, true);
+	
+	ProgressForward fwd = { progress, progressArg };
+	
+	bool ok = handle->manager->promLoad(mcsFilePath, 
+			progress != NULL ? forwardProgress : NULL, &fwd, 
+			promLoadFlags(flags), calibPath != NULL ? calibPath : "");
+	
+	return ok ? 0 : -EIO;
+}
+
+int evrManagerPromPlan(EvrManagerHandle *handle, const char *mcsFilePath,
+					   int flags, const char *calibPath)
+{
+	// only reads the registers
+	HandleLock lock(handle, false);
+	
+	bool ok = handle->manager->promPlan(mcsFilePath, promLoadFlags(flags), 
+			calibPath != NULL ? calibPath : "");
+	
+	return ok ? 0 : -EIO;
+}
+
+const char *evrManagerStrError(int err)
+{
+	// the GNU strerror_r(), which returns the message, in the buffer or not
+	return strerror_r(err < 0 ? -err : err, strErrorBuf, sizeof(strErrorBuf));
+}
@@ -0,0 +1,118 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#ifndef __EVR_MANAGER_API_H__
+#define __EVR_MANAGER_API_H__
+
+/*
+ * The C interface of libevrmanager, for the applications that manage
+ * the cards themselves instead of running the evrManager executable.
+ *
+ * A handle is opened once per card and can be used for any number of
+ * calls, from any number of threads: the calls on a handle are
+ * serialized and the ones that change the card also take the per-card
+ * lock shared with the evrManager executable, so separate handles and
+ * processes don't interfere either.
+ *
+ * All the functions returning int return 0 (or a non-negative result)
+ * on success and a negative errno value on failure.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* incremented when the interface changes incompatibly */
+#define EVR_MANAGER_API_VERSION 2
+
+typedef struct EvrManagerHandle EvrManagerHandle;
+
+/*
+ * Called during evrManagerPromLoad() with the phase ("erase", "write"
+ * or "verify") and how much of it is done, out of 'total'.
+ */
+typedef void (*EvrManagerProgressFunc)(void *arg, const char *phase,
+									   uint32_t done, uint32_t total);
+
+int evrManagerApiVersion(void);
+
+/* 'mngDevNodeName' as for the evrManager executable, e.g. "/dev/evr0mng" */
+int evrManagerOpen(const char *mngDevNodeName, EvrManagerHandle **handle);
+void evrManagerClose(EvrManagerHandle *handle);
+
+/* timeoutMs <= 0 for the default */
+int evrManagerInit(EvrManagerHandle *handle, int timeoutMs);
+
+int evrManagerCreate(EvrManagerHandle *handle, const char *virtDevName);
+int evrManagerDestroy(EvrManagerHandle *handle, const char *virtDevName);
+
+/* return the absolute index of the allocated resource */
+int evrManagerAllocPulsegen(EvrManagerHandle *handle, const char *virtDevName,
+							int prescalerLength, int delayLength, int widthLength);
+int evrManagerAllocOutput(EvrManagerHandle *handle, const char *virtDevName,
+						  int absOutputNum);
+
+int evrManagerOutputSet(EvrManagerHandle *handle, const char *virtDevName,
+						int outputIndex, int fromPulsegen, int source);
+
+/*
+ * The device node of the VEVR 'virtDevName' (created or not) into 'path',
+ * e.g. to wait for it to be closed when a call fails with -EBUSY;
+ * -ENOTSUP if the card has no such nodes, -ERANGE if 'size' is too small.
+ */
+int evrManagerVirtDevNode(EvrManagerHandle *handle, const char *virtDevName,
+						  char *path, size_t size);
+
+int evrManagerVersion(EvrManagerHandle *handle, uint32_t *fwVersion);
+
+/*
+ * In degC and as read from the registers ('rawCurrent' and 'rawMax' may
+ * be NULL); -ENOTSUP if the card has no temperature registers.
+ */
+int evrManagerTemperature(EvrManagerHandle *handle, double *current, double *max,
+						  uint32_t *rawCurrent, uint32_t *rawMax);
+
+/* 'progress' may be NULL */
+int evrManagerPromLoad(EvrManagerHandle *handle, const char *mcsFilePath,
+					   EvrManagerProgressFunc progress, void *progressArg);
+
+/* the 'flags' of evrManagerPromLoadEx() and evrManagerPromPlan() */
+#define EVR_MANAGER_PROM_PRELOAD        0x1 /* read the .mcs file into memory first */
+#define EVR_MANAGER_PROM_JITTER         0x2 /* report the gaps between the flash bus operations */
+#define EVR_MANAGER_PROM_INLINE_VERIFY  0x4 /* verify each buffer as written, no verify pass */
+#define EVR_MANAGER_PROM_POSTED_BUFFER  0x8 /* no read-back per write buffer word (not checked on hardware) */
+
+/*
+ * evrManagerPromLoad() with the EVR_MANAGER_PROM_xxx 'flags' and the
+ * calibration database the timings are added to (NULL for the default).
+ * The flash is erased while writing if the card's part has read-while-
+ * write partitions.
+ */
+int evrManagerPromLoadEx(EvrManagerHandle *handle, const char *mcsFilePath,
+						 EvrManagerProgressFunc progress, void *progressArg,
+						 int flags, const char *calibPath);
+
+/*
+ * Prints how long evrManagerPromLoadEx() with these arguments would take
+ * at most on this card, from its calibration; the flash is not touched.
+ */
+int evrManagerPromPlan(EvrManagerHandle *handle, const char *mcsFilePath,
+					   int flags, const char *calibPath);
+
+/* valid until the next call from the same thread */
+const char *evrManagerStrError(int err);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __EVR_MANAGER_API_H__
@@ -0,0 +1,176 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+
+#include "utils.h"
+#include "linux-evr-regs.h"
+#include "EvrManager.h"
+#include "EvrMonitor.h"
+#include "EvrMonitorRing.h"
+
+namespace {
+
+volatile sig_atomic_t stopRequested = 0;
+
+void onStopSignal(int)
+{
+	stopRequested = 1;
+}
+
+void sample(EvrManager &manager, EvrMonSample *s)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	
+	uint32_t raw[2];
+	double temp[2];
+	
+	s->timestampNs = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	s->fwVersion = manager.readFwVersion();
+	s->ctrl = manager.readReg(EVR_REG_CTRL);
+	s->irqFlag = manager.readReg(EVR_REG_IRQFLAG);
+	
+	if(manager.readTemperature(temp, raw)) {
+		s->temp = temp[0];
+		s->tempMax = temp[1];
+		s->flags = EVR_MON_FLAG_TEMPERATURE;
+	} else {
+		s->temp = 0;
+		s->tempMax = 0;
+		s->flags = 0;
+	}
+}
+
+} // unnamed namespace
+
+
+
+bool runMonitor(EvrManager &manager, const std::string &mngDevNodeName,
+				int periodMs, int capacity)
+{
+	if(periodMs <= 0 || capacity <= 0) {
+		AERR("Invalid monitor period %d ms or capacity %d", periodMs, capacity);
+		return false;
+	}
+	
+	std::string shmName = evrMonShmName(mngDevNodeName);
+	size_t bytes = evrMonRingBytes(capacity);
+	
+	/*
+	 * The writer holds a lock on the segment for as long as it runs. One
+	 * that is not locked was left by a monitor that died: it is replaced
+	 * by a new segment (the readers still mapping it keep the old one,
+	 * whatever the new capacity), never re-initialized in place. One of
+	 * size 0 is being created by another monitor that didn't lock it yet.
+	 */
+	int shmFd = shm_open(shmName.c_str(), O_RDWR, 0);
+	if(shmFd >= 0) {
+		struct stat st;
+		if(fstat(shmFd, &st) < 0 || st.st_size == 0 || flock(shmFd, LOCK_EX | LOCK_NB) < 0) {
+			AERR("Another monitor writes shm %s, errno=%d", shmName.c_str(), errno);
+			close(shmFd);
+			return false;
+		}
+		shm_unlink(shmName.c_str());
+		close(shmFd);
+	}
+	
+	shmFd = shm_open(shmName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+	if(shmFd < 0) {
+		AERR("shm_open(%s) failed, errno=%d", shmName.c_str(), errno);
+		return false;
+	}
+	
+	if(flock(shmFd, LOCK_EX | LOCK_NB) < 0) {
+		AERR("Another monitor writes shm %s, errno=%d", shmName.c_str(), errno);
+		close(shmFd);
+		return false;
+	}
+	
+	if(ftruncate(shmFd, bytes) < 0) {
+		AERR("ftruncate(%s) failed, errno=%d", shmName.c_str(), errno);
+		shm_unlink(shmName.c_str());
+		close(shmFd);
+		return false;
+	}
+	
+	EvrMonRing *ring = (EvrMonRing *)mmap(NULL, bytes, PROT_READ | PROT_WRITE, 
+										  MAP_SHARED, shmFd, 0);
+	
+	if(ring == MAP_FAILED) {
+		AERR("shm mmap failed, errno=%d", errno);
+		shm_unlink(shmName.c_str());
+		close(shmFd);
+		return false;
+	}
+	
+	// readers check the magic last, so a half-initialized header is never used
+	ring->magic = 0;
+	__sync_synchronize();
+	memset((void *)ring, 0, bytes);
+	ring->version = EVR_MON_RING_VERSION;
+	ring->capacity = capacity;
+	ring->sampleSize = sizeof(EvrMonSample);
+	ring->periodNs = (uint64_t)periodMs * 1000000ULL;
+	ring->head = 0;
+	strncpy(ring->mngDevName, mngDevNodeName.c_str(), sizeof(ring->mngDevName) - 1);
+	__sync_synchronize();
+	ring->magic = EVR_MON_RING_MAGIC;
+	
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = onStopSignal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	
+	AINFO("Monitoring %s every %d ms into shm %s (%d samples)", 
+		  mngDevNodeName.c_str(), periodMs, shmName.c_str(), capacity);
+	
+	struct timespec next;
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	
+	while(!stopRequested) {
+		
+		EvrMonSample s;
+		sample(manager, &s);
+		evrMonRingPublish(ring, s);
+		
+		// fixed rate, independent of how long the sampling took
+		next.tv_nsec += (long)(periodMs % 1000) * 1000000L;
+		next.tv_sec += periodMs / 1000 + next.tv_nsec / 1000000000L;
+		next.tv_nsec %= 1000000000L;
+		
+		while(!stopRequested 
+			  && clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR) {
+		}
+	}
+	
+	AINFO("Monitoring stopped after %llu samples", (unsigned long long)ring->head);
+	
+	munmap(ring, bytes);
+	shm_unlink(shmName.c_str());
+	
+	// the lock goes with it
+	close(shmFd);
+	
+	return true;
+}
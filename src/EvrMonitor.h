@@ -0,0 +1,28 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#ifndef __EVR_MONITOR_H__
+#define __EVR_MONITOR_H__
+
+#include <string>
+
+#include "EvrManager.h"
+
+#define EVR_MON_PERIOD_MS_DEFAULT  1000
+#define EVR_MON_CAPACITY_DEFAULT   3600
+
+/*
+ * Samples the card health every 'periodMs' from the already mapped
+ * registers and publishes the samples into the shared memory ring
+ * (see EvrMonitorRing.h). Runs until SIGINT/SIGTERM.
+ */
+bool runMonitor(EvrManager &manager, const std::string &mngDevNodeName,
+				int periodMs, int capacity);
+
+#endif // __EVR_MONITOR_H__
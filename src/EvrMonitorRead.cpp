@@ -0,0 +1,193 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+/*
+ * evrMonitor: prints statistics of the samples published by
+ * 'evrManager <dev> monitor' over a time window.
+ * 
+ * Usage: evrMonitor <mngDevNodeName> [window_s [repeat_s]]
+ */
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+
+#include "utils.h"
+#include "EvrMonitorRing.h"
+
+namespace {
+
+struct Stats {
+	unsigned count;
+	unsigned torn;
+	unsigned tempCount;
+	double tempMin;
+	double tempMax;
+	double tempSum;
+	double tempMaxReg;
+	uint32_t irqFlagOr;
+	uint32_t lastFwVersion;
+	uint32_t lastCtrl;
+	bool fwVersionChanged;
+	uint64_t newestNs;
+	uint64_t oldestNs;
+};
+
+void collect(const EvrMonRing *ring, double windowSec, Stats *st)
+{
+	uint64_t head = ring->head;
+	uint64_t first = head > ring->capacity ? head - ring->capacity : 0;
+	uint64_t windowNs = (uint64_t)(windowSec * 1e9);
+	
+	st->count = 0;
+	st->torn = 0;
+	st->tempCount = 0;
+	st->tempMin = 1e9;
+	st->tempMax = -1e9;
+	st->tempSum = 0;
+	st->tempMaxReg = -1e9;
+	st->irqFlagOr = 0;
+	st->fwVersionChanged = false;
+	st->newestNs = 0;
+	st->oldestNs = 0;
+	
+	// newest to oldest, stop at the window boundary
+	for(uint64_t i = head; i > first; i --) {
+		
+		EvrMonSample s;
+		
+		if(!evrMonRingRead(ring, i - 1, &s)) {
+			// overwritten by the writer while reading it
+			st->torn ++;
+			continue;
+		}
+		
+		if(st->count == 0) {
+			st->newestNs = s.timestampNs;
+			st->lastFwVersion = s.fwVersion;
+			st->lastCtrl = s.ctrl;
+		} else if(st->newestNs - s.timestampNs > windowNs) {
+			break;
+		}
+		
+		st->oldestNs = s.timestampNs;
+		st->count ++;
+		st->irqFlagOr |= s.irqFlag;
+		
+		if(s.fwVersion != st->lastFwVersion) {
+			st->fwVersionChanged = true;
+		}
+		
+		if(s.flags & EVR_MON_FLAG_TEMPERATURE) {
+			st->tempCount ++;
+			st->tempSum += s.temp;
+			if(s.temp < st->tempMin) st->tempMin = s.temp;
+			if(s.temp > st->tempMax) st->tempMax = s.temp;
+			if(s.tempMax > st->tempMaxReg) st->tempMaxReg = s.tempMax;
+		}
+	}
+}
+
+void print(const EvrMonRing *ring, const Stats &st)
+{
+	if(st.count == 0) {
+		printf("%s: no samples yet\n", ring->mngDevName);
+		return;
+	}
+	
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	double ageSec = ((uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec 
+					 - st.newestNs) / 1e9;
+	
+	printf("%s: %u samples over %.1f s, newest %.1f s old%s\n", ring->mngDevName, 
+		   st.count, (st.newestNs - st.oldestNs) / 1e9, ageSec,
+		   st.torn ? " (some overwritten while reading)" : "");
+	
+	if(st.tempCount) {
+		printf("  Temperature: min %6.2lf, max %6.2lf, avg %6.2lf degC (max register %6.2lf degC)\n",
+			   st.tempMin, st.tempMax, st.tempSum / st.tempCount, st.tempMaxReg);
+	} else {
+		printf("  Temperature: not available for this module\n");
+	}
+	
+	printf("  FW_VERSION: 0x%08X%s\n", st.lastFwVersion, 
+		   st.fwVersionChanged ? " (changed within the window)" : "");
+	printf("  CTRL: 0x%08X, IRQFLAG (or-ed over the window): 0x%08X\n", 
+		   st.lastCtrl, st.irqFlagOr);
+}
+
+} // unnamed namespace
+
+
+
+int main(int argc, const char *argv[])
+{
+	if(argc < 2) {
+		AERR("arg[1]->mngDevNodeName, [arg[2]->window_s, [arg[3]->repeat_s]]");
+		return 1;
+	}
+	
+	std::string shmName = evrMonShmName(argv[1]);
+	double windowSec = argc > 2 ? atof(argv[2]) : 60;
+	double repeatSec = argc > 3 ? atof(argv[3]) : 0;
+	
+	int shmFd = shm_open(shmName.c_str(), O_RDONLY, 0);
+	if(shmFd < 0) {
+		AERR("shm_open(%s) failed, errno=%d; is 'evrManager %s monitor' running?", 
+			 shmName.c_str(), errno, argv[1]);
+		return 1;
+	}
+	
+	struct stat sb;
+	if(fstat(shmFd, &sb) < 0 || (size_t)sb.st_size < sizeof(EvrMonRing)) {
+		AERR("%s is too small", shmName.c_str());
+		close(shmFd);
+		return 1;
+	}
+	
+	const EvrMonRing *ring = (const EvrMonRing *)mmap(NULL, sb.st_size, PROT_READ, 
+													  MAP_SHARED, shmFd, 0);
+	close(shmFd);
+	
+	if(ring == MAP_FAILED) {
+		AERR("shm mmap failed, errno=%d", errno);
+		return 1;
+	}
+	
+	if(ring->magic != EVR_MON_RING_MAGIC || ring->version != EVR_MON_RING_VERSION
+	   || ring->sampleSize != sizeof(EvrMonSample)
+	   || evrMonRingBytes(ring->capacity) > (size_t)sb.st_size) {
+		AERR("%s is not a compatible monitor ring", shmName.c_str());
+		return 1;
+	}
+	
+	// from here on no syscalls are needed to read the samples
+	do {
+		Stats st;
+		collect(ring, windowSec, &st);
+		print(ring, st);
+		
+		if(repeatSec > 0) {
+			struct timespec ts;
+			ts.tv_sec = (time_t)repeatSec;
+			ts.tv_nsec = (long)((repeatSec - ts.tv_sec) * 1e9);
+			nanosleep(&ts, NULL);
+		}
+	} while(repeatSec > 0);
+	
+	return 0;
+}
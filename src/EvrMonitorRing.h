@@ -0,0 +1,126 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#ifndef __EVR_MONITOR_RING_H__
+#define __EVR_MONITOR_RING_H__
+
+/*
+ * The layout of the shared memory ring written by 'evrManager <dev> monitor'
+ * and read by evrMonitor (or any other local consumer).
+ * 
+ * There is exactly one writer. Every sample slot carries a sequence
+ * number which is odd while the slot is being written (a seqlock), so
+ * the readers never block the writer and need no syscalls once the
+ * segment is mapped: a reader copies a slot and keeps it only if the
+ * sequence number was the expected even value before and after the copy.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+
+#define EVR_MON_RING_MAGIC    0x45564D52 // 'EVMR'
+#define EVR_MON_RING_VERSION  1
+
+#define EVR_MON_FLAG_TEMPERATURE  0x1 // the temperature fields are valid
+
+struct EvrMonSample {
+	uint64_t seq;           // 2 * sampleIndex + 2 when complete, odd while written
+	uint64_t timestampNs;   // CLOCK_REALTIME
+	double   temp;          // degC
+	double   tempMax;       // degC
+	uint32_t fwVersion;
+	uint32_t ctrl;          // EVR_REG_CTRL
+	uint32_t irqFlag;       // EVR_REG_IRQFLAG
+	uint32_t flags;         // EVR_MON_FLAG_xxx
+};
+
+struct EvrMonRing {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t capacity;      // number of sample slots
+	uint32_t sampleSize;    // sizeof(EvrMonSample) of the writer
+	uint64_t periodNs;
+	volatile uint64_t head; // number of samples published so far
+	char     mngDevName[64];
+	// followed by 'capacity' EvrMonSample slots
+};
+
+inline size_t evrMonRingBytes(uint32_t capacity)
+{
+	return sizeof(EvrMonRing) + (size_t)capacity * sizeof(EvrMonSample);
+}
+
+inline EvrMonSample *evrMonRingSlot(EvrMonRing *ring, uint64_t index)
+{
+	return (EvrMonSample *)(ring + 1) + (index % ring->capacity);
+}
+
+// The POSIX shm name for the card, e.g. /dev/evr0mng -> /evrManager.evr0mng
+inline std::string evrMonShmName(const std::string &mngDevNodeName)
+{
+	std::string base = mngDevNodeName;
+	size_t slash = base.rfind('/');
+	
+	if(slash != std::string::npos) {
+		base = base.substr(slash + 1);
+	}
+	
+	return "/evrManager." + base;
+}
+
+// Writer side: publishes 'sample' as the next one.
+inline void evrMonRingPublish(EvrMonRing *ring, const EvrMonSample &sample)
+{
+	uint64_t index = ring->head;
+	volatile EvrMonSample *slot = evrMonRingSlot(ring, index);
+	
+	slot->seq = 2 * index + 1;
+	__sync_synchronize();
+	
+	slot->timestampNs = sample.timestampNs;
+	slot->temp = sample.temp;
+	slot->tempMax = sample.tempMax;
+	slot->fwVersion = sample.fwVersion;
+	slot->ctrl = sample.ctrl;
+	slot->irqFlag = sample.irqFlag;
+	slot->flags = sample.flags;
+	
+	__sync_synchronize();
+	slot->seq = 2 * index + 2;
+	
+	__sync_synchronize();
+	ring->head = index + 1;
+}
+
+// Reader side: copies sample 'index'; false if it was overwritten meanwhile.
+inline bool evrMonRingRead(const EvrMonRing *ring, uint64_t index, EvrMonSample *out)
+{
+	const volatile EvrMonSample *slot = 
+		evrMonRingSlot(const_cast<EvrMonRing *>(ring), index);
+	
+	uint64_t seq = slot->seq;
+	__sync_synchronize();
+	
+	out->timestampNs = slot->timestampNs;
+	out->temp = slot->temp;
+	out->tempMax = slot->tempMax;
+	out->fwVersion = slot->fwVersion;
+	out->ctrl = slot->ctrl;
+	out->irqFlag = slot->irqFlag;
+	out->flags = slot->flags;
+	
+	__sync_synchronize();
+	out->seq = slot->seq;
+	
+	return seq == 2 * index + 2 && out->seq == seq;
+}
+
+#endif // __EVR_MONITOR_RING_H__
@@ -0,0 +1,199 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#include "FlashSim.h"
+
+// the smallest block of the StrataFlash parts, in words (as EvrCardG2Prom assumes)
+#define FLASH_SIM_BLOCK_WORDS  0x4000
+
+// EvrCardG2Prom maps its registers up to 0x2000C
+#define FLASH_SIM_WINDOW_BYTES 0x20010
+
+#define FLASH_SIM_STATUS_READY     0x80
+#define FLASH_SIM_STATUS_ERASE_ERR 0x20
+#define FLASH_SIM_STATUS_PROG_ERR  0x10
+
+FlashSimWindow::FlashSimWindow(void)
+	: window(FLASH_SIM_WINDOW_BYTES / 4)
+{
+}
+
+FlashSimProm::FlashSimProm(const std::string &mcsFilePath, uint32_t sizeWords)
+	: EvrCardG2Prom(&window[0], mcsFilePath)
+	, array(sizeWords, 0xFFFF)
+	, bufferCount(0)
+	, blankCheck(true)
+	, status(0)
+	, partitionWords(0)
+	, eraseOps(0)
+	, programOps(0)
+	, busOps(0)
+	, conflicts(0)
+	, busyUntil(1, 0)
+{
+}
+
+FlashSimProm::~FlashSimProm()
+{
+}
+
+void FlashSimProm::setTiming(uint32_t partitionWords, uint64_t eraseOps, uint64_t programOps)
+{
+	this->partitionWords = partitionWords;
+	this->eraseOps = eraseOps;
+	this->programOps = programOps;
+	
+	size_t partitions = 1;
+	if(partitionWords > 0) {
+		partitions = (array.size() + partitionWords - 1) / partitionWords;
+	}
+	busyUntil.assign(partitions, 0);
+}
+
+void FlashSimProm::setContents(uint32_t words, uint16_t value)
+{
+	for(uint32_t a = 0; a < words && a < array.size(); a ++) {
+		array[a] = value;
+	}
+}
+
+size_t FlashSimProm::partitionOf(uint32_t address) const
+{
+	size_t p = partitionWords > 0 ? address / partitionWords : 0;
+	
+	return p < busyUntil.size() ? p : busyUntil.size() - 1;
+}
+
+bool FlashSimProm::busy(uint32_t address) const
+{
+	return busOps < busyUntil[partitionOf(address)];
+}
+
+// a bus operation other than a status read
+void FlashSimProm::access(uint32_t address)
+{
+	busOps ++;
+	if(busy(address)) {
+		conflicts ++;
+	}
+}
+
+void FlashSimProm::startOp(uint32_t address, uint64_t ops)
+{
+	busyUntil[partitionOf(address)] = busOps + ops;
+}
+
+void FlashSimProm::eraseBlock(uint32_t address)
+{
+	uint32_t start = address - address % FLASH_SIM_BLOCK_WORDS;
+	
+	for(uint32_t a = start; a < start + FLASH_SIM_BLOCK_WORDS && a < array.size(); a ++) {
+		array[a] = 0xFFFF;
+	}
+}
+
+bool FlashSimProm::blockBlank(uint32_t address) const
+{
+	uint32_t start = address - address % FLASH_SIM_BLOCK_WORDS;
+	
+	for(uint32_t a = start; a < start + FLASH_SIM_BLOCK_WORDS && a < array.size(); a ++) {
+		if(array[a] != 0xFFFF) {
+			return false;
+		}
+	}
+	
+	return true;
+}
+
+void FlashSimProm::program(uint32_t address, uint16_t data)
+{
+	// programming can only clear bits
+	if(address < array.size()) {
+		array[address] &= data;
+	}
+}
+
+void FlashSimProm::writeToFlash(uint32_t address, uint16_t cmd, uint16_t data)
+{
+	mmioWrites_ += 2;
+	access(address);
+	
+	switch(cmd) {
+	case 0x20: // block erase (confirmed by 0xD0)
+		if(data == 0xD0) {
+			eraseBlock(address);
+			startOp(address, eraseOps);
+		}
+		break;
+	case 0xBC: // blank check (confirmed by 0xD0)
+		if(data != 0xD0) {
+			break;
+		}
+		if(!blankCheck) {
+			status |= FLASH_SIM_STATUS_ERASE_ERR | FLASH_SIM_STATUS_PROG_ERR;
+		} else if(!blockBlank(address)) {
+			status |= FLASH_SIM_STATUS_ERASE_ERR;
+		}
+		break;
+	case 0x50: // clear status
+		status = 0;
+		break;
+	case 0x40: // word program
+		program(address, data);
+		break;
+	case 0xE8: // buffered program, 'data' is the word count - 1
+		bufferCount = data + 1;
+		bufferAddr.clear();
+		bufferData.clear();
+		break;
+	default: // lock/unlock/configuration
+		break;
+	}
+}
+
+uint16_t FlashSimProm::readFlash(uint32_t address, uint16_t cmd)
+{
+	mmioWrites_ += 2;
+	mmioReads_ ++;
+	
+	if(cmd == 0x70) { // read status, of the partition
+		busOps ++;
+		return busy(address) ? 0 : FLASH_SIM_STATUS_READY | status;
+	}
+	
+	access(address);
+	
+	switch(cmd) {
+	case 0xD0: // buffered program confirm
+		for(size_t i = 0; i < bufferData.size(); i ++) {
+			program(bufferAddr[i], bufferData[i]);
+		}
+		bufferCount = 0;
+		startOp(address, programOps);
+		return 0;
+	case 0xFF: // read array
+		return address < array.size() ? array[address] : 0xFFFF;
+	default:
+		return 0;
+	}
+}
+
+void FlashSimProm::loadBufferWord(uint32_t address, uint16_t data)
+{
+	mmioWrites_ += 2;
+	if(!postedLoad_) {
+		mmioReads_ ++;
+	}
+	access(address);
+	
+	if(bufferCount > 0 && (int)bufferData.size() < bufferCount) {
+		bufferAddr.push_back(address);
+		bufferData.push_back(data);
+	}
+}
@@ -0,0 +1,99 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#ifndef __FLASH_SIM_H__
+#define __FLASH_SIM_H__
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "EvrCardG2Prom.h"
+
+// the register window EvrCardG2Prom's constructor writes to; a base
+// class so that it exists before EvrCardG2Prom is constructed
+struct FlashSimWindow {
+	
+	std::vector<uint32_t> window;
+	
+	FlashSimWindow(void);
+};
+
+/*
+ * EvrCardG2Prom driving a simulated flash instead of the card: the
+ * commands written to the flash bus are decoded by a small state
+ * machine (block erase, blank check, word and buffered program, status
+ * and array reads) working on a word array in memory. The flash is always ready,
+ * so it times the PROM engine and the MCS parsing without the card.
+ *
+ * With setTiming() the erases and the buffered programs keep their
+ * partition busy for a number of bus operations instead, which then
+ * measure the load time; touching a busy partition other than to read
+ * its status is counted as a conflict.
+ */
+class FlashSimProm : private FlashSimWindow, public EvrCardG2Prom {
+public:
+	
+	FlashSimProm(const std::string &mcsFilePath, uint32_t sizeWords);
+	virtual ~FlashSimProm();
+	
+	// the simulated array, e.g. to compare it with the image
+	const std::vector<uint16_t> &getArray(void) const { return array; }
+	
+	// the first 'words' set to 'value', as left by an earlier load
+	void setContents(uint32_t words, uint16_t value);
+	
+	// without it the blank check command is a command sequence error
+	void setBlankCheck(bool supported) { blankCheck = supported; }
+	
+	// partitionWords 0 for a single partition; the times in bus operations
+	void setTiming(uint32_t partitionWords, uint64_t eraseOps, uint64_t programOps);
+	
+	// bus operations so far, including the status polls
+	uint64_t getBusOps(void) const { return busOps; }
+	uint64_t getConflicts(void) const { return conflicts; }
+
+protected:
+	
+	virtual void writeToFlash(uint32_t address, uint16_t cmd, uint16_t data);
+	virtual uint16_t readFlash(uint32_t address, uint16_t cmd);
+	virtual void loadBufferWord(uint32_t address, uint16_t data);
+
+private:
+	
+	std::vector<uint16_t> array;
+	
+	// buffered program in progress: words expected and loaded so far
+	int bufferCount;
+	std::vector<uint32_t> bufferAddr;
+	std::vector<uint16_t> bufferData;
+	
+	bool blankCheck;
+	uint16_t status; // the error bits
+	
+	// the timing, see setTiming()
+	uint32_t partitionWords;
+	uint64_t eraseOps;
+	uint64_t programOps;
+	uint64_t busOps;
+	uint64_t conflicts;
+	std::vector<uint64_t> busyUntil; // per partition
+	
+	size_t partitionOf(uint32_t address) const;
+	bool busy(uint32_t address) const;
+	void access(uint32_t address);
+	void startOp(uint32_t address, uint64_t ops);
+	
+	void eraseBlock(uint32_t address);
+	bool blockBlank(uint32_t address) const;
+	void program(uint32_t address, uint16_t data);
+};
+
+#endif // __FLASH_SIM_H__
@@ -0,0 +1,112 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#include <stdlib.h>
+#include <ctype.h>
+
+#include "HwInfo.h"
+
+namespace {
+
+std::string upper(const std::string &s)
+{
+	std::string u = s;
+	for(size_t i = 0; i < u.size(); i ++) {
+		u[i] = toupper((unsigned char)u[i]);
+	}
+	return u;
+}
+
+std::string trim(const std::string &s)
+{
+	size_t b = s.find_first_not_of(" \t\r");
+	if(b == std::string::npos) {
+		return "";
+	}
+	return s.substr(b, s.find_last_not_of(" \t\r") - b + 1);
+}
+
+// "P16,D32,W32", "PRESC=16 DELAY=32 WIDTH=32", ...
+void parsePulsegen(const std::string &fields, HwPulsegen *pg)
+{
+	size_t pos = 0;
+	
+	while(pos < fields.size()) {
+		
+		size_t end = fields.find_first_of(", \t", pos);
+		if(end == std::string::npos) {
+			end = fields.size();
+		}
+		
+		std::string token = upper(fields.substr(pos, end - pos));
+		size_t num = token.find_first_of("0123456789");
+		
+		if(!token.empty() && num != std::string::npos) {
+			int value = atoi(token.c_str() + num);
+			switch(token[0]) {
+			case 'P': pg->prescalerLength = value; break;
+			case 'D': pg->delayLength = value; break;
+			case 'W': pg->widthLength = value; break;
+			}
+		}
+		
+		pos = end + 1;
+	}
+}
+
+} // unnamed namespace
+
+bool HwInfo::parse(const std::string &text)
+{
+	std::string section;
+	size_t pos = 0;
+	
+	pulsegens.clear();
+	outputs.clear();
+	
+	while(pos < text.size()) {
+		
+		size_t eol = text.find('\n', pos);
+		if(eol == std::string::npos) {
+			eol = text.size();
+		}
+		
+		std::string line = trim(text.substr(pos, eol - pos));
+		pos = eol + 1;
+		
+		size_t open = line.find('[');
+		size_t eq = line.find('=');
+		
+		if(open == std::string::npos || eq == std::string::npos || eq < open) {
+			if(!line.empty() && line[line.size() - 1] == ':') {
+				section = upper(line);
+			}
+			continue;
+		}
+		
+		// NAME[index]=fields
+		std::string name = upper(line.substr(0, open));
+		int index = atoi(line.c_str() + open + 1);
+		
+		if(name.compare(0, 3, "OUT") == 0 
+		   || (name.empty() && section.find("OUTPUT") != std::string::npos)) {
+			
+			outputs.push_back(index);
+			
+		} else if(name.compare(0, 5, "PULSE") == 0 || name == "PG"
+				  || (name.empty() && section.find("PULSE") != std::string::npos)) {
+			
+			HwPulsegen pg = { index, 0, 0, 0 };
+			parsePulsegen(line.substr(eq + 1), &pg);
+			pulsegens.push_back(pg);
+		}
+	}
+	
+	return !pulsegens.empty() || !outputs.empty();
+}
@@ -0,0 +1,47 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#ifndef __HW_INFO_H__
+#define __HW_INFO_H__
+
+#include <string>
+#include <vector>
+
+struct HwPulsegen {
+	int index;
+	int prescalerLength;
+	int delayLength;
+	int widthLength;
+};
+
+/*
+ * The physical resources of a card as listed by the manager's hw_info
+ * (/sys/class/modac-mng/<evrXmng>/hw_info), e.g.:
+ * 
+ *   pulsegen:
+ *   PULSEGEN[0]=P16,D32,W32
+ *   ...
+ *   output:
+ *   OUT[0]=FP_UNIV[0],MAP=xx
+ *   ...
+ * 
+ * The pulse generator properties are accepted as P16, PRESC=16 or
+ * PRESCALER:16 (and the same for the delay and width); whatever else
+ * is in the text is ignored.
+ */
+struct HwInfo {
+	
+	std::vector<HwPulsegen> pulsegens;
+	std::vector<int> outputs; // the absolute output indexes
+	
+	// false if neither pulse generators nor outputs were found
+	bool parse(const std::string &text);
+};
+
+#endif // __HW_INFO_H__
@@ -0,0 +1,147 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <poll.h>
+#include <errno.h>
+#include <time.h>
+#include <stdio.h>
+
+#include <string>
+
+#include "utils.h"
+#include "LatencyStats.h"
+#include "IdleWait.h"
+
+IdleWait::IdleWait(const std::string &nodePath, const std::string &virtDevName, 
+				   bool enabled, int timeoutMs)
+	: nodePath(nodePath)
+	, virtDevName(virtDevName)
+	, enabled(enabled)
+	, timeoutMs(timeoutMs)
+	, inotifyFd(-1)
+	, waiting(false)
+	, startNs(0)
+	, endNs(0)
+	, sliceMs(IDLE_WAIT_SLICE_MIN_MS)
+	, attempts(1)
+	, wakeups(0)
+{
+}
+
+IdleWait::~IdleWait()
+{
+	if(inotifyFd >= 0) {
+		close(inotifyFd);
+	}
+}
+
+void IdleWait::watch(void)
+{
+	if(nodePath.empty()) {
+		return;
+	}
+	
+	inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if(inotifyFd < 0) {
+		return;
+	}
+	
+	if(inotify_add_watch(inotifyFd, nodePath.c_str(), IN_CLOSE_WRITE | IN_CLOSE_NOWRITE) < 0) {
+		close(inotifyFd);
+		inotifyFd = -1;
+		return;
+	}
+	
+	// woken up by the close, the slices are only the safety net
+	sliceMs = IDLE_WAIT_SLICE_MAX_MS;
+}
+
+// true if something was closed since the last call
+bool IdleWait::drain(void)
+{
+	char buf[4096];
+	bool any = false;
+	
+	while(read(inotifyFd, buf, sizeof(buf)) > 0) {
+		any = true;
+	}
+	
+	return any;
+}
+
+bool IdleWait::again(void)
+{
+	if(!enabled || errno != EBUSY) {
+		return false;
+	}
+	
+	int64_t now = monotonicNowNs();
+	
+	if(!waiting) {
+		// a close before the watch is armed would be missed: retry once now
+		waiting = true;
+		startNs = now;
+		endNs = now;
+		watch();
+		attempts ++;
+		return true;
+	}
+	
+	int waitMs = sliceMs;
+	
+	if(timeoutMs >= 0) {
+		int64_t leftMs = timeoutMs - (now - startNs) / 1000000;
+		if(leftMs <= 0) {
+			AERR("'%s' still in use after %d ms", virtDevName.c_str(), timeoutMs);
+			errno = EBUSY;
+			return false;
+		}
+		if(leftMs < waitMs) {
+			waitMs = leftMs;
+		}
+	}
+	
+	if(inotifyFd >= 0) {
+		// a close after the last check is still pending: no wait then
+		struct pollfd pfd = { inotifyFd, POLLIN, 0 };
+		if(poll(&pfd, 1, waitMs) > 0 && drain()) {
+			wakeups ++;
+		}
+	} else {
+		struct timespec ts = { waitMs / 1000, (waitMs % 1000) * 1000000L };
+		while(nanosleep(&ts, &ts) < 0 && errno == EINTR) {
+		}
+	}
+	
+	if(sliceMs < IDLE_WAIT_SLICE_MAX_MS) {
+		sliceMs = sliceMs * 2 < IDLE_WAIT_SLICE_MAX_MS ? sliceMs * 2 : IDLE_WAIT_SLICE_MAX_MS;
+	}
+	
+	endNs = monotonicNowNs();
+	attempts ++;
+	
+	return true;
+}
+
+void IdleWait::report(void)
+{
+	if(!enabled) {
+		return;
+	}
+	
+	int err = errno;
+	
+	printf("WAIT: vevr=%s waited_ms=%.1f attempts=%u close_events=%u watch=%s\n", 
+		   virtDevName.c_str(), (endNs - startNs) / 1e6, attempts, wakeups, 
+		   !waiting ? "-" : inotifyFd >= 0 ? "inotify" : "backoff");
+	
+	errno = err;
+}
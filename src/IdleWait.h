@@ -0,0 +1,72 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#ifndef __IDLE_WAIT_H__
+#define __IDLE_WAIT_H__
+
+#include <stdint.h>
+
+#include <string>
+
+#define IDLE_WAIT_SLICE_MIN_MS  1
+#define IDLE_WAIT_SLICE_MAX_MS  200
+
+/*
+ * '--wait[=<ms>]': the operations that change a VEVR fail with EBUSY
+ * while an application has it open. Instead of failing, they are
+ * retried as soon as the VEVR node is closed (inotify), or in growing
+ * intervals if the node can't be watched (and as a safety net for a
+ * missed event). Each attempt is a call of EvrManagerApi.h, which takes
+ * the card lock for itself, so the lock isn't held while waiting.
+ * 
+ *     IdleWait wait(nodePath, virtDevName, enabled, timeoutMs);
+ *     do {
+ *         ret = evrManagerAllocOutput(...);
+ *     } while(ret < 0 && (errno = -ret, wait.again()));
+ *     wait.report();
+ */
+class IdleWait {
+public:
+	
+	// 'nodePath' of the VEVR, see evrManagerVirtDevNode(), "" if none;
+	// 'timeoutMs' < 0 waits for ever
+	IdleWait(const std::string &nodePath, const std::string &virtDevName, 
+			 bool enabled, int timeoutMs);
+	~IdleWait();
+	
+	// after a failed operation: true if it is to be retried now, false 
+	// (errno kept) if it didn't fail with EBUSY or the wait timed out
+	bool again(void);
+	
+	// the 'WAIT:' line (if enabled)
+	void report(void);
+
+private:
+	
+	std::string nodePath;
+	std::string virtDevName;
+	bool enabled;
+	int timeoutMs;
+	
+	int inotifyFd;
+	bool waiting;
+	int64_t startNs;
+	int64_t endNs;
+	int sliceMs;
+	unsigned attempts;
+	unsigned wakeups;
+	
+	void watch(void);
+	bool drain(void);
+	
+	IdleWait(const IdleWait &);
+	IdleWait &operator=(const IdleWait &);
+};
+
+#endif // __IDLE_WAIT_H__
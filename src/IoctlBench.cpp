@@ -0,0 +1,292 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#include <sys/utsname.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "utils.h"
+#include "EvrManager.h"
+#include "EvrDevice.h"
+#include "LatencyStats.h"
+#include "IoctlBench.h"
+
+// a VEVR name that can't exist
+#define IOCTL_BENCH_MISS_NAME  "ioctlbench-miss"
+
+#define IOCTL_BENCH_WARMUP     100
+
+namespace {
+
+enum BenchOp {
+	OP_CONFIG,
+	OP_FIND_HIT,
+	OP_FIND_MISS,
+};
+
+const char *opName(BenchOp op)
+{
+	switch(op) {
+	case OP_CONFIG:    return "config";
+	case OP_FIND_HIT:  return "find_hit";
+	case OP_FIND_MISS: return "find_miss";
+	}
+	return "?";
+}
+
+/*
+ * Where the threads line up after their warm-up, to start measuring
+ * together, or to return at once if not all of them could be started
+ * (a barrier would keep those waiting for the missing ones).
+ */
+enum GateState { GATE_CLOSED, GATE_OPEN, GATE_ABORT };
+
+struct StartGate {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int waiting;
+	GateState state;
+};
+
+// false if the run is aborted
+bool waitAtGate(StartGate *gate)
+{
+	pthread_mutex_lock(&gate->lock);
+	gate->waiting ++;
+	pthread_cond_broadcast(&gate->cond);
+	while(gate->state == GATE_CLOSED) {
+		pthread_cond_wait(&gate->cond, &gate->lock);
+	}
+	bool go = gate->state == GATE_OPEN;
+	pthread_mutex_unlock(&gate->lock);
+	
+	return go;
+}
+
+// once 'threads' wait, or at once for GATE_ABORT
+void releaseGate(StartGate *gate, int threads, GateState state)
+{
+	pthread_mutex_lock(&gate->lock);
+	while(state == GATE_OPEN && gate->waiting < threads) {
+		pthread_cond_wait(&gate->cond, &gate->lock);
+	}
+	gate->state = state;
+	pthread_cond_broadcast(&gate->cond);
+	pthread_mutex_unlock(&gate->lock);
+}
+
+struct BenchThread {
+	
+	EvrDevice *dev;
+	BenchOp op;
+	std::string name;
+	int iterations;
+	StartGate *gate;
+	
+	pthread_t thread;
+	LatencyStats stats;
+	int failures;
+	int64_t startNs;
+	int64_t endNs;
+};
+
+// the expected result of a call, no logging in the loop
+bool runOp(BenchThread &t)
+{
+	int id = 0;
+	int length = 0;
+	
+	switch(t.op) {
+	case OP_CONFIG:
+		return t.dev->getIoMemoryLength(&length) == 0;
+	case OP_FIND_HIT:
+		return t.dev->findVirtDev(t.name, &id) == 0;
+	case OP_FIND_MISS:
+		return t.dev->findVirtDev(t.name, &id) < 0;
+	}
+	return false;
+}
+
+void *benchThread(void *arg)
+{
+	BenchThread &t = *(BenchThread *)arg;
+	
+	for(int i = 0; i < IOCTL_BENCH_WARMUP; i ++) {
+		runOp(t);
+	}
+	
+	if(!waitAtGate(t.gate)) {
+		return NULL;
+	}
+	
+	t.startNs = monotonicNowNs();
+	
+	for(int i = 0; i < t.iterations; i ++) {
+		int64_t t0 = monotonicNowNs();
+		bool ok = runOp(t);
+		int64_t t1 = monotonicNowNs();
+		
+		t.stats.add(t1 - t0);
+		if(!ok) {
+			t.failures ++;
+		}
+	}
+	
+	t.endNs = monotonicNowNs();
+	
+	return NULL;
+}
+
+std::string moduleVersion(void)
+{
+	char buf[64] = "unknown";
+	
+	FILE *f = fopen("/sys/module/evrma/version", "r");
+	if(f != NULL) {
+		if(fgets(buf, sizeof(buf), f) != NULL) {
+			buf[strcspn(buf, "\n")] = '\0';
+		}
+		fclose(f);
+	}
+	
+	return buf;
+}
+
+// aggregate ops/s, -1 on error
+double runThreads(EvrDevice *dev, BenchOp op, const std::string &name, 
+				  int iterations, int threads, LatencyStats &all, int *failures)
+{
+	std::vector<BenchThread> bt(threads);
+	StartGate gate;
+	
+	*failures = 0;
+	pthread_mutex_init(&gate.lock, NULL);
+	pthread_cond_init(&gate.cond, NULL);
+	gate.waiting = 0;
+	gate.state = GATE_CLOSED;
+	
+	for(int i = 0; i < threads; i ++) {
+		bt[i].dev = dev;
+		bt[i].op = op;
+		bt[i].name = name;
+		bt[i].iterations = iterations;
+		bt[i].gate = &gate;
+		bt[i].failures = 0;
+		bt[i].stats.reserve(iterations);
+	}
+	
+	int started = 0;
+	for(; started < threads; started ++) {
+		if(pthread_create(&bt[started].thread, NULL, benchThread, &bt[started])) {
+			break;
+		}
+	}
+	
+	if(started < threads) {
+		// the others return from the gate without measuring
+		AERR("pthread_create failed");
+		releaseGate(&gate, started, GATE_ABORT);
+		for(int i = 0; i < started; i ++) {
+			pthread_join(bt[i].thread, NULL);
+		}
+		pthread_cond_destroy(&gate.cond);
+		pthread_mutex_destroy(&gate.lock);
+		return -1;
+	}
+	
+	releaseGate(&gate, threads, GATE_OPEN);
+	
+	int64_t start = 0;
+	int64_t end = 0;
+	
+	for(int i = 0; i < threads; i ++) {
+		pthread_join(bt[i].thread, NULL);
+		all.merge(bt[i].stats);
+		*failures += bt[i].failures;
+		if(i == 0 || bt[i].startNs < start) start = bt[i].startNs;
+		if(i == 0 || bt[i].endNs > end) end = bt[i].endNs;
+	}
+	
+	pthread_cond_destroy(&gate.cond);
+	pthread_mutex_destroy(&gate.lock);
+	
+	return end > start ? (double)iterations * threads * 1e9 / (end - start) : 0;
+}
+
+} // unnamed namespace
+
+
+
+bool ioctlBench(EvrManager &manager, int iterations, int maxThreads, 
+				const std::string &virtDevName)
+{
+	if(iterations <= 0 || maxThreads <= 0) {
+		AERR("Invalid iterations %d or threads %d", iterations, maxThreads);
+		return false;
+	}
+	
+	struct utsname uts;
+	std::string kernel = uname(&uts) == 0 ? uts.release : "unknown";
+	std::string module = moduleVersion();
+	
+	std::vector<BenchOp> ops;
+	ops.push_back(OP_CONFIG);
+	if(!virtDevName.empty()) {
+		ops.push_back(OP_FIND_HIT);
+	}
+	ops.push_back(OP_FIND_MISS);
+	
+	// powers of two up to the requested count, which is always run as well
+	std::vector<int> threadCounts;
+	for(int threads = 1; threads < maxThreads; threads *= 2) {
+		threadCounts.push_back(threads);
+	}
+	threadCounts.push_back(maxThreads);
+	
+	bool ret = true;
+	
+	for(size_t o = 0; o < ops.size(); o ++) {
+		
+		std::string name = ops[o] == OP_FIND_HIT ? virtDevName : IOCTL_BENCH_MISS_NAME;
+		double single = 0;
+		
+		for(size_t t = 0; t < threadCounts.size(); t ++) {
+			
+			int threads = threadCounts[t];
+			LatencyStats st;
+			int failures = 0;
+			
+			double opsPerSec = runThreads(&manager.getDevice(), ops[o], name, 
+										  iterations, threads, st, &failures);
+			if(opsPerSec < 0) {
+				return false;
+			}
+			if(threads == 1) {
+				single = opsPerSec;
+			}
+			
+			printf("IOCTLBENCH kernel=%s,evrma=%s,op=%s,threads=%d,ops_per_s=%.0f,"
+				   "scaling=%.2f,failures=%d,%s\n",
+				   kernel.c_str(), module.c_str(), opName(ops[o]), threads, opsPerSec,
+				   single > 0 ? opsPerSec / single : 0, failures, 
+				   st.keyValues("lat").c_str());
+			
+			if(failures) {
+				AERR("%s: %d unexpected result(s)", opName(ops[o]), failures);
+				ret = false;
+			}
+		}
+	}
+	
+	return ret;
+}
@@ -0,0 +1,34 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#ifndef __IOCTL_BENCH_H__
+#define __IOCTL_BENCH_H__
+
+#include <string>
+
+#include "EvrManager.h"
+
+#define IOCTL_BENCH_ITERATIONS_DEFAULT  10000
+#define IOCTL_BENCH_THREADS_DEFAULT     1
+
+/*
+ * Runs the read-only manager operations (MNG_DEV_IOC_CONFIG and
+ * MNG_DEV_IOC_VIRT_DEV_FIND, a hit on 'virtDevName' if given and a
+ * miss) in tight loops with 1, 2, 4, ... up to 'maxThreads' threads
+ * and prints one line per operation and thread count:
+ * 
+ *   IOCTLBENCH kernel=<release>,evrma=<version>,op=<op>,threads=<n>,
+ *       ops_per_s=<..>,scaling=<..>,lat_n=<..>,lat_mean_ns=<..>,lat_p50_ns=<..>,...
+ * 
+ * (on a single line) so the results can be tracked across module releases.
+ */
+bool ioctlBench(EvrManager &manager, int iterations, int maxThreads, 
+				const std::string &virtDevName);
+
+#endif // __IOCTL_BENCH_H__
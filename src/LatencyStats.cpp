@@ -0,0 +1,113 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#include <stdio.h>
+#include <math.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "LatencyStats.h"
+
+void LatencyStats::merge(const LatencyStats &other)
+{
+	samples.insert(samples.end(), other.samples.begin(), other.samples.end());
+	sorted = false;
+}
+
+void LatencyStats::sort(void)
+{
+	if(!sorted) {
+		std::sort(samples.begin(), samples.end());
+		sorted = true;
+	}
+}
+
+double LatencyStats::mean(void) const
+{
+	double sum = 0;
+	
+	if(samples.empty()) return 0;
+	
+	for(size_t i = 0; i < samples.size(); i++) sum += samples[i];
+	return sum / samples.size();
+}
+
+double LatencyStats::min(void)
+{
+	if(samples.empty()) return 0;
+	sort();
+	return samples.front();
+}
+
+double LatencyStats::max(void)
+{
+	if(samples.empty()) return 0;
+	sort();
+	return samples.back();
+}
+
+double LatencyStats::percentile(double p)
+{
+	if(samples.empty()) return 0;
+	sort();
+	
+	size_t rank = (size_t)ceil(p / 100.0 * samples.size());
+	if(rank < 1) rank = 1;
+	if(rank > samples.size()) rank = samples.size();
+	
+	return samples[rank - 1];
+}
+
+void LatencyStats::printSummary(const std::string &name)
+{
+	printf("%-24s n=%-8u mean=%9.1f p50=%9.1f p90=%9.1f p99=%9.1f p99.9=%9.1f max=%9.1f ns\n",
+			 name.c_str(), (unsigned)count(), mean(), percentile(50), percentile(90),
+			 percentile(99), percentile(99.9), max());
+}
+
+void LatencyStats::printHistogram(void)
+{
+	const int barWidth = 50;
+	std::vector<size_t> buckets;
+	size_t peak = 0;
+	
+	if(samples.empty()) return;
+	
+	for(size_t i = 0; i < samples.size(); i++) {
+		size_t b = 0;
+		double v = samples[i];
+		while(v >= 2.0) { v /= 2.0; b++; }
+		if(b >= buckets.size()) buckets.resize(b + 1, 0);
+		buckets[b]++;
+	}
+	
+	for(size_t b = 0; b < buckets.size(); b++) {
+		if(buckets[b] > peak) peak = buckets[b];
+	}
+	
+	for(size_t b = 0; b < buckets.size(); b++) {
+		if(buckets[b] == 0) continue;
+		int bar = (int)((double)buckets[b] / peak * barWidth + 0.5);
+		printf("  [%9.0f, %9.0f) ns %8u |%.*s\n", b ? pow(2.0, (double)b) : 0.0, pow(2.0, (double)b + 1),
+				 (unsigned)buckets[b], bar, "##################################################");
+	}
+}
+
+std::string LatencyStats::keyValues(const std::string &prefix)
+{
+	char buf[256];
+	snprintf(buf, sizeof(buf), "%s_n=%u,%s_mean_ns=%.1f,%s_p50_ns=%.1f,%s_p90_ns=%.1f,"
+				"%s_p99_ns=%.1f,%s_max_ns=%.1f",
+				prefix.c_str(), (unsigned)count(), prefix.c_str(), mean(), 
+				prefix.c_str(), percentile(50), prefix.c_str(), percentile(90), 
+				prefix.c_str(), percentile(99), prefix.c_str(), max());
+	return buf;
+}
@@ -0,0 +1,63 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#ifndef __LATENCY_STATS_H__
+#define __LATENCY_STATS_H__
+
+#include <stdint.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+inline int64_t monotonicNowNs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Latency samples (in ns) with percentiles and a log2 histogram.
+class LatencyStats {
+public:
+	
+	LatencyStats(void) : sorted(true) {}
+	
+	void reserve(size_t n) { samples.reserve(n); }
+	// negative values (after subtracting a timer overhead) are clamped to 0
+	void add(double ns) { samples.push_back(ns > 0 ? ns : 0); sorted = false; }
+	void merge(const LatencyStats &other);
+	void clear(void) { samples.clear(); sorted = true; }
+	
+	size_t count(void) const { return samples.size(); }
+	double mean(void) const;
+	double min(void);
+	double max(void);
+	
+	// p in [0, 100], nearest rank
+	double percentile(double p);
+	
+	// one line: count, mean, p50, p90, p99, p99.9, max
+	void printSummary(const std::string &name);
+	
+	// power of two buckets with a bar per bucket
+	void printHistogram(void);
+	
+	// comma separated name=value pairs, for logs tracked across releases
+	std::string keyValues(const std::string &prefix);
+
+private:
+	
+	std::vector<double> samples;
+	bool sorted;
+	
+	void sort(void);
+};
+
+#endif // __LATENCY_STATS_H__
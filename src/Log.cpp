@@ -0,0 +1,421 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#include <sys/types.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <poll.h>
+#include <errno.h>
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <string>
+
+#include "Log.h"
+
+#define LOG_WRITER_POLL_MS  100
+
+namespace {
+
+struct LogMessage {
+	int level;
+	pid_t tid;
+	struct timespec time;
+	char text[LOG_MESSAGE_MAX];
+};
+
+/*
+ * Bounded multi-producer queue: a slot is free for the producer that
+ * claims position 'pos' when its sequence is 'pos' and ready for the
+ * (single) writer when it is 'pos + 1'.
+ */
+struct LogSlot {
+	volatile uint32_t seq;
+	LogMessage msg;
+};
+
+LogSlot slots[LOG_QUEUE_SLOTS];
+volatile uint32_t enqueuePos;
+volatile uint32_t dequeuePos;   // moved by the writer only
+volatile uint32_t writtenPos;   // what the writer has written and flushed
+volatile uint32_t dropped;
+uint32_t reportedDrops;         // by the writer, over its restarts
+
+bool async;
+bool json;
+int maxLevel = LOG_LEVEL_DBG;
+FILE *sink;
+
+pthread_once_t initOnce = PTHREAD_ONCE_INIT;
+pthread_t writer;
+bool writerRunning;
+int wakeFd = -1;
+volatile int writerSleeping;
+volatile int stopWriter;
+
+const char *levelPrefix[] = { "ERROR: ", "INFO: ", "DBG: " };
+const char *levelName[] = { "error", "info", "debug" };
+
+bool enqueue(const LogMessage &msg)
+{
+	uint32_t pos = enqueuePos;
+	
+	for(;;) {
+		LogSlot &slot = slots[pos & (LOG_QUEUE_SLOTS - 1)];
+		int32_t diff = (int32_t)(slot.seq - pos);
+		
+		if(diff == 0) {
+			if(__sync_bool_compare_and_swap(&enqueuePos, pos, pos + 1)) {
+				slot.msg = msg;
+				__sync_synchronize();
+				slot.seq = pos + 1;
+				return true;
+			}
+			pos = enqueuePos;
+		} else if(diff < 0) {
+			return false; // full
+		} else {
+			pos = enqueuePos;
+		}
+	}
+}
+
+bool dequeue(LogMessage *msg)
+{
+	LogSlot &slot = slots[dequeuePos & (LOG_QUEUE_SLOTS - 1)];
+	
+	if(slot.seq != dequeuePos + 1) {
+		return false;
+	}
+	__sync_synchronize();
+	
+	*msg = slot.msg;
+	
+	__sync_synchronize();
+	slot.seq = dequeuePos + LOG_QUEUE_SLOTS;
+	dequeuePos ++;
+	
+	return true;
+}
+
+void appendJsonString(std::string &out, const char *s)
+{
+	out += '"';
+	for(; *s; s ++) {
+		unsigned char c = *s;
+		if(c == '"' || c == '\\') {
+			out += '\\';
+			out += c;
+		} else if(c < 0x20) {
+			char buf[8];
+			snprintf(buf, sizeof(buf), "\\u%04x", c);
+			out += buf;
+		} else {
+			out += c;
+		}
+	}
+	out += '"';
+}
+
+void writeMessage(const LogMessage &msg)
+{
+	if(!json) {
+		fprintf(sink, "%s%s\n", levelPrefix[msg.level], msg.text);
+		return;
+	}
+	
+	struct tm tm;
+	char time[64];
+	gmtime_r(&msg.time.tv_sec, &tm);
+	size_t n = strftime(time, sizeof(time), "%Y-%m-%dT%H:%M:%S", &tm);
+	snprintf(time + n, sizeof(time) - n, ".%06ldZ", msg.time.tv_nsec / 1000);
+	
+	std::string line = "{\"time\":\"";
+	line += time;
+	line += "\",\"level\":\"";
+	line += levelName[msg.level];
+	line += "\",\"tid\":";
+	char tid[16];
+	snprintf(tid, sizeof(tid), "%d", (int)msg.tid);
+	line += tid;
+	line += ",\"msg\":";
+	appendJsonString(line, msg.text);
+	line += "}\n";
+	
+	fputs(line.c_str(), sink);
+}
+
+void *writerThread(void *)
+{
+	LogMessage msg;
+	
+	for(;;) {
+		
+		while(dequeue(&msg)) {
+			writeMessage(msg);
+		}
+		
+		uint32_t drops = __sync_fetch_and_add(&dropped, 0);
+		if(drops != reportedDrops) {
+			LogMessage note = LogMessage();
+			note.level = LOG_LEVEL_ERR;
+			note.tid = syscall(SYS_gettid);
+			clock_gettime(CLOCK_REALTIME, &note.time);
+			snprintf(note.text, sizeof(note.text), "%u log message(s) dropped", 
+					 drops - reportedDrops);
+			writeMessage(note);
+			reportedDrops = drops;
+		}
+		
+		fflush(sink);
+		__sync_lock_test_and_set(&writtenPos, dequeuePos);
+		
+		if(__sync_fetch_and_add(&stopWriter, 0)) {
+			break;
+		}
+		
+		// the producers check the flag after publishing, so either they
+		// see it or the message is seen here
+		__sync_fetch_and_or(&writerSleeping, 1);
+		if(slots[dequeuePos & (LOG_QUEUE_SLOTS - 1)].seq == dequeuePos + 1) {
+			__sync_fetch_and_and(&writerSleeping, 0);
+			continue;
+		}
+		
+		struct pollfd pfd = { wakeFd, POLLIN, 0 };
+		if(poll(&pfd, 1, LOG_WRITER_POLL_MS) > 0) {
+			uint64_t count;
+			if(read(wakeFd, &count, sizeof(count)) < 0) {
+				// nothing to do, the next poll tells
+			}
+		}
+		__sync_fetch_and_and(&writerSleeping, 0);
+	}
+	
+	return NULL;
+}
+
+void wakeWriter(void)
+{
+	if(__sync_fetch_and_add(&writerSleeping, 0)) {
+		uint64_t one = 1;
+		if(write(wakeFd, &one, sizeof(one)) < 0) {
+			// the writer wakes up on its own
+		}
+	}
+}
+
+/*
+ * Joins the writer, which writes what was queued before it stops; what
+ * was queued after it looked last is written here. The callers write
+ * themselves from then on.
+ */
+void stopWriterThread(void)
+{
+	if(!writerRunning) {
+		return;
+	}
+	
+	__sync_fetch_and_add(&stopWriter, 1);
+	uint64_t one = 1;
+	if(write(wakeFd, &one, sizeof(one)) < 0) {
+	}
+	pthread_join(writer, NULL);
+	writerRunning = false;
+	__sync_fetch_and_and(&stopWriter, 0);
+	
+	LogMessage msg;
+	while(dequeue(&msg)) {
+		writeMessage(msg);
+	}
+	
+	close(wakeFd);
+	wakeFd = -1;
+}
+
+void stopAtExit(void)
+{
+	stopWriterThread();
+}
+
+void startWriter(void)
+{
+	static bool stopRegistered = false;
+	
+	if(writerRunning) {
+		return;
+	}
+	
+	for(uint32_t i = 0; i < LOG_QUEUE_SLOTS; i ++) {
+		slots[i].seq = i;
+	}
+	enqueuePos = dequeuePos = writtenPos = 0;
+	
+	wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if(wakeFd < 0 || pthread_create(&writer, NULL, writerThread, NULL) != 0) {
+		// the callers write themselves then
+		if(wakeFd >= 0) {
+			close(wakeFd);
+			wakeFd = -1;
+		}
+		async = false;
+		return;
+	}
+	
+	writerRunning = true;
+	if(!stopRegistered) {
+		atexit(stopAtExit);
+		stopRegistered = true;
+	}
+}
+
+bool configure(const char *spec);
+
+void initFromEnv(void)
+{
+	sink = stdout;
+	
+	const char *spec = getenv("EVR_LOG");
+	if(spec != NULL && !configure(spec)) {
+		fprintf(stderr, "Invalid EVR_LOG: %s\n", spec);
+	}
+}
+
+bool configure(const char *spec)
+{
+	bool wantAsync = false;
+	bool wantJson = false;
+	int wantLevel = LOG_LEVEL_DBG;
+	FILE *file = NULL;
+	
+	std::string s = spec;
+	size_t pos = 0;
+	
+	while(pos <= s.size()) {
+		size_t comma = s.find(',', pos);
+		if(comma == std::string::npos) {
+			comma = s.size();
+		}
+		std::string item = s.substr(pos, comma - pos);
+		
+		if(item == "async") {
+			wantAsync = true;
+		} else if(item == "sync" || item.empty()) {
+			wantAsync = false;
+		} else if(item == "json") {
+			wantJson = true;
+		} else if(item.size() == 7 && item.compare(0, 6, "level=") == 0 
+				  && item[6] >= '0' && item[6] <= '2') {
+			wantLevel = item[6] - '0';
+		} else if(item.compare(0, 5, "file=") == 0 && file == NULL) {
+			file = fopen(item.c_str() + 5, "a");
+			if(file == NULL) {
+				return false;
+			}
+		} else {
+			if(file != NULL) {
+				fclose(file);
+			}
+			return false;
+		}
+		
+		pos = comma + 1;
+	}
+	
+	// the writer is done with the old sink before it is closed; it is
+	// started again below if still wanted
+	stopWriterThread();
+	
+	if(sink != NULL) {
+		fflush(sink);
+	}
+	if(sink != NULL && sink != stdout) {
+		fclose(sink);
+	}
+	sink = file != NULL ? file : stdout;
+	json = wantJson;
+	async = wantAsync;
+	maxLevel = wantLevel;
+	
+	if(async) {
+		startWriter();
+	}
+	
+	return true;
+}
+
+} // unnamed namespace
+
+
+
+bool evrLogConfigure(const char *spec)
+{
+	// the environment first, so this overrides it
+	pthread_once(&initOnce, initFromEnv);
+	
+	return configure(spec);
+}
+
+void evrLog(int level, const char *format, ...)
+{
+	pthread_once(&initOnce, initFromEnv);
+	
+	if(level > maxLevel) {
+		return;
+	}
+	
+	LogMessage msg;
+	msg.level = level;
+	msg.tid = json ? syscall(SYS_gettid) : 0;
+	if(json) {
+		clock_gettime(CLOCK_REALTIME, &msg.time);
+	}
+	
+	va_list ap;
+	va_start(ap, format);
+	vsnprintf(msg.text, sizeof(msg.text), format, ap);
+	va_end(ap);
+	
+	if(async && writerRunning) {
+		if(enqueue(msg)) {
+			wakeWriter();
+			return;
+		}
+		if(level != LOG_LEVEL_ERR) {
+			__sync_fetch_and_add(&dropped, 1);
+			return;
+		}
+	}
+	
+	writeMessage(msg);
+}
+
+void evrLogFlush(void)
+{
+	if(writerRunning) {
+		// until the writer caught up with what was queued so far
+		uint32_t end = __sync_fetch_and_add(&enqueuePos, 0);
+		while((int32_t)(end - __sync_fetch_and_add(&writtenPos, 0)) > 0) {
+			uint64_t one = 1;
+			if(write(wakeFd, &one, sizeof(one)) < 0) {
+			}
+			usleep(1000);
+		}
+	}
+	
+	if(sink != NULL) {
+		fflush(sink);
+	}
+}
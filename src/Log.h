@@ -0,0 +1,53 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#ifndef __EVR_LOG_H__
+#define __EVR_LOG_H__
+
+/*
+ * The diagnostics of evrManager and the libraries, see ADBG, AINFO and
+ * AERR in utils.h.
+ * 
+ * The levels above EVR_LOG_LEVEL (set at build time, 'make 
+ * EVR_LOG_LEVEL=1') are compiled out: their calls, arguments included,
+ * generate no code.
+ * 
+ * The output is configured with the EVR_LOG environment variable (read
+ * at the first message) or evrLogConfigure(), a comma separated list:
+ *   sync         written by the caller (the default),
+ *   async        queued (lock-free) and written by a background thread,
+ *                so the caller never waits for the terminal or the file;
+ *                if the queue is full the message is dropped (counted),
+ *                except the errors which are then written by the caller,
+ *   json         one JSON object per line instead of the text,
+ *   file=<path>  appended to <path> instead of stdout,
+ *   level=<n>    only the messages up to level <n> (of those compiled in).
+ * The queued messages are written at the latest on exit.
+ */
+
+#define LOG_LEVEL_ERR   0
+#define LOG_LEVEL_INFO  1
+#define LOG_LEVEL_DBG   2
+
+#ifndef EVR_LOG_LEVEL
+#define EVR_LOG_LEVEL   LOG_LEVEL_DBG
+#endif
+
+#define LOG_QUEUE_SLOTS   1024  // a power of 2
+#define LOG_MESSAGE_MAX   256
+
+void evrLog(int level, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+// false if 'spec' is invalid; to be called before the threads log
+bool evrLogConfigure(const char *spec);
+
+// returns when the queued messages are written
+void evrLogFlush(void);
+
+#endif // __EVR_LOG_H__
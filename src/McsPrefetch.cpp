@@ -0,0 +1,279 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#include "utils.h"
+#include "LatencyStats.h"
+#include "Trace.h"
+#include "McsPrefetch.h"
+
+// each of the two buffers
+#define MCS_PREFETCH_CHUNK_BYTES (1024 * 1024)
+
+McsPrefetch::McsPrefetch(void)
+	: fd(-1)
+	, threaded(false)
+	, current(-1)
+	, done(false)
+	, stop(false)
+	, offset(0)
+	, bytes(0)
+	, readNs(0)
+	, stallNs(0)
+	, stalls(0)
+{
+	pthread_mutex_init(&mutex, NULL);
+	pthread_cond_init(&cond, NULL);
+	
+	for(int i = 0; i < 2; i ++) {
+		chunks[i].data.resize(MCS_PREFETCH_CHUNK_BYTES);
+		chunks[i].length = 0;
+		chunks[i].full = false;
+	}
+}
+
+McsPrefetch::~McsPrefetch()
+{
+	close();
+	pthread_cond_destroy(&cond);
+	pthread_mutex_destroy(&mutex);
+}
+
+bool McsPrefetch::open(const std::string &path)
+{
+	close();
+	
+	fd = ::open(path.c_str(), O_RDONLY);
+	if(fd < 0) {
+		return false;
+	}
+	
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	
+	bytes = 0;
+	readNs = 0;
+	stallNs = 0;
+	stalls = 0;
+	
+	start();
+	return true;
+}
+
+void McsPrefetch::close(void)
+{
+	if(fd < 0) {
+		return;
+	}
+	
+	finish();
+	::close(fd);
+	fd = -1;
+}
+
+// the reader from the start of the file
+void McsPrefetch::start(void)
+{
+	current = -1;
+	done = false;
+	stop = false;
+	offset = 0;
+	chunks[0].full = false;
+	chunks[1].full = false;
+	setg(NULL, NULL, NULL);
+	
+	threaded = pthread_create(&thread, NULL, readerThread, this) == 0;
+	if(!threaded) {
+		AINFO("No reader thread for the .mcs file, reading it in line");
+	}
+}
+
+void McsPrefetch::finish(void)
+{
+	if(!threaded) {
+		return;
+	}
+	
+	pthread_mutex_lock(&mutex);
+	stop = true;
+	pthread_cond_broadcast(&cond);
+	pthread_mutex_unlock(&mutex);
+	
+	pthread_join(thread, NULL);
+	threaded = false;
+}
+
+// a whole chunk unless at the end of the file; 0 at the end or on an error
+size_t McsPrefetch::fill(Chunk &chunk, uint64_t at)
+{
+	// the kernel reads the chunk after this one meanwhile
+	posix_fadvise(fd, at + MCS_PREFETCH_CHUNK_BYTES, MCS_PREFETCH_CHUNK_BYTES, 
+				  POSIX_FADV_WILLNEED);
+	
+	int64_t t0 = monotonicNowNs();
+	size_t length = 0;
+	
+	while(length < chunk.data.size()) {
+		ssize_t n = ::read(fd, &chunk.data[length], chunk.data.size() - length);
+		if(n < 0 && errno == EINTR) {
+			continue;
+		}
+		if(n < 0) {
+			AERR("Can't read the .mcs file: %s", strerror(errno));
+			break;
+		}
+		if(n == 0) {
+			break;
+		}
+		length += n;
+	}
+	
+	int64_t t1 = monotonicNowNs();
+	readNs += t1 - t0;
+	if(traceOn) traceAdd("mcs read", "", t0, t1);
+	bytes += length;
+	
+	return length;
+}
+
+void *McsPrefetch::readerThread(void *arg)
+{
+	McsPrefetch &p = *(McsPrefetch *)arg;
+	uint64_t offset = 0;
+	
+	traceThreadName("mcs reader");
+	
+	for(int i = 0; ; i ^= 1) {
+		
+		Chunk &chunk = p.chunks[i];
+		
+		pthread_mutex_lock(&p.mutex);
+		while(chunk.full && !p.stop) {
+			pthread_cond_wait(&p.cond, &p.mutex);
+		}
+		bool stop = p.stop;
+		pthread_mutex_unlock(&p.mutex);
+		
+		if(stop) {
+			break;
+		}
+		
+		size_t length = p.fill(chunk, offset);
+		offset += length;
+		
+		pthread_mutex_lock(&p.mutex);
+		chunk.length = length;
+		chunk.full = true;
+		if(length < chunk.data.size()) {
+			p.done = true;
+		}
+		pthread_cond_broadcast(&p.cond);
+		pthread_mutex_unlock(&p.mutex);
+		
+		if(length < chunk.data.size()) {
+			break;
+		}
+	}
+	
+	return NULL;
+}
+
+McsPrefetch::int_type McsPrefetch::underflow(void)
+{
+	if(fd < 0) {
+		return traits_type::eof();
+	}
+	
+	if(!threaded) {
+		if(done) {
+			return traits_type::eof();
+		}
+		// all the time in read() is waiting
+		Chunk &chunk = chunks[0];
+		int64_t t0 = monotonicNowNs();
+		chunk.length = fill(chunk, offset);
+		stallNs += monotonicNowNs() - t0;
+		stalls ++;
+		offset += chunk.length;
+		if(chunk.length < chunk.data.size()) {
+			done = true;
+		}
+		if(chunk.length == 0) {
+			return traits_type::eof();
+		}
+		setg(&chunk.data[0], &chunk.data[0], &chunk.data[0] + chunk.length);
+		return traits_type::to_int_type(*gptr());
+	}
+	
+	pthread_mutex_lock(&mutex);
+	
+	// give the one parsed back to the reader
+	int next = 0;
+	if(current >= 0) {
+		chunks[current].full = false;
+		next = current ^ 1;
+		pthread_cond_broadcast(&cond);
+	}
+	
+	// the last chunk was the one just given back
+	if(!chunks[next].full && done) {
+		pthread_mutex_unlock(&mutex);
+		setg(NULL, NULL, NULL);
+		return traits_type::eof();
+	}
+	
+	if(!chunks[next].full) {
+		int64_t t0 = monotonicNowNs();
+		while(!chunks[next].full) {
+			pthread_cond_wait(&cond, &mutex);
+		}
+		int64_t t1 = monotonicNowNs();
+		stallNs += t1 - t0;
+		if(traceOn) traceAdd("mcs stall", "", t0, t1);
+		stalls ++;
+	}
+	
+	current = next;
+	Chunk &chunk = chunks[current];
+	
+	pthread_mutex_unlock(&mutex);
+	
+	if(chunk.length == 0) {
+		setg(NULL, NULL, NULL);
+		return traits_type::eof();
+	}
+	
+	setg(&chunk.data[0], &chunk.data[0], &chunk.data[0] + chunk.length);
+	return traits_type::to_int_type(*gptr());
+}
+
+McsPrefetch::pos_type McsPrefetch::seekoff(off_type off, std::ios_base::seekdir dir,
+										   std::ios_base::openmode)
+{
+	if(fd < 0 || off != 0 || dir != std::ios_base::beg) {
+		return pos_type(off_type(-1));
+	}
+	
+	finish();
+	
+	if(lseek(fd, 0, SEEK_SET) < 0) {
+		return pos_type(off_type(-1));
+	}
+	
+	start();
+	return pos_type(0);
+}
+
+McsPrefetch::pos_type McsPrefetch::seekpos(pos_type pos, std::ios_base::openmode which)
+{
+	return seekoff(off_type(pos), std::ios_base::beg, which);
+}
@@ -0,0 +1,83 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#ifndef __MCS_PREFETCH_H__
+#define __MCS_PREFETCH_H__
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <streambuf>
+#include <string>
+#include <vector>
+
+/*
+ * The input of McsRead for the .mcs files: a reader thread fills two
+ * large buffers in turn with read() while the parser works on the other
+ * one, and asks the kernel for the chunk after with posix_fadvise(), so
+ * on a network file system (AFS) there is always I/O in flight instead
+ * of one blocking miss per getline(). Without the thread the reads are
+ * done in underflow(). Only seeking back to the start is supported.
+ */
+class McsPrefetch : public std::streambuf {
+public:
+	
+	McsPrefetch(void);
+	virtual ~McsPrefetch();
+	
+	bool open(const std::string &path);
+	bool isOpen(void) const { return fd >= 0; }
+	void close(void);
+	
+	// since open(), over all the passes: bytes read, the time spent in
+	// read() and how long the parser waited for the data
+	uint64_t getBytes(void) const { return bytes; }
+	int64_t getReadNs(void) const { return readNs; }
+	int64_t getStallNs(void) const { return stallNs; }
+	unsigned getStalls(void) const { return stalls; }
+	
+protected:
+	
+	virtual int_type underflow(void);
+	virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+							 std::ios_base::openmode which);
+	virtual pos_type seekpos(pos_type pos, std::ios_base::openmode which);
+	
+private:
+	
+	struct Chunk {
+		std::vector<char> data;
+		size_t length;
+		bool full; // filled, not yet given back by the parser
+	};
+	
+	int fd;
+	pthread_t thread;
+	bool threaded;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	
+	Chunk chunks[2];
+	int current;     // the chunk the parser is on, -1 for none
+	bool done;       // the reader reached the end of the file
+	bool stop;
+	uint64_t offset; // of the inline reads
+	
+	uint64_t bytes;
+	int64_t readNs;
+	int64_t stallNs;
+	unsigned stalls;
+	
+	static void *readerThread(void *arg);
+	size_t fill(Chunk &chunk, uint64_t at);
+	void start(void);
+	void finish(void);
+};
+
+#endif // __MCS_PREFETCH_H__
@@ -21,6 +21,8 @@
 //-----------------------------------------------------------------------------
 
 #include <McsRead.h>
+#include "utils.h"
+#include "Trace.h"
 #include <iostream>
 #include <fstream>
 #include <stdint.h>
@@ -29,7 +31,8 @@
 using namespace std;
 
 // Constructor
-McsRead::McsRead ( ) {
+McsRead::McsRead ( ) : file(&prefetch) {
+   in = &file;
 }
 
 // Deconstructor
@@ -38,19 +41,21 @@ McsRead::~McsRead ( ) {
 
 // Open file
 bool McsRead::open ( string filePath ) {
+   TraceSpan span("mcs open", filePath);
 
    promPntr = 16;
    promBaseAddr = 0;
    endOfFile = false;
 
-   //attempt to open the file 
-   file.open(filePath.c_str() );
+   //attempt to open the file, read ahead by a thread
+   in = &file;
+   file.clear();
+   prefetch.open(filePath);
    
    //check if not opened
-   if ( !file.is_open() ) {
+   if ( !prefetch.isOpen() ) {
       //show error message
-      cout << "McsRead::open error = ";
-      cout << "unable to open" << filePath << endl;
+      AERR("McsRead::open error = unable to open %s", filePath.c_str());
       
       //close the file
       close();
@@ -63,20 +68,44 @@ bool McsRead::open ( string filePath ) {
    }
 }
 
+// Open a file already read into memory
+bool McsRead::openImage ( const string &contents ) {
+
+   promPntr = 16;
+   promBaseAddr = 0;
+   endOfFile = false;
+
+   image.clear();
+   image.str(contents);
+   in = &image;
+   
+   return true;
+}
+
 //! Moves the ifstream to beginning of file
 void McsRead::beg ( ) {
    promPntr = 16;
    promBaseAddr = 0;
    endOfFile = false;    
     
-   file.clear();
-   file.seekg(0, ios::beg);
+   in->clear();
+   in->seekg(0, ios::beg);
 }
 
 //! Open file
 void McsRead::close ( ) {
    //close the file
-   file.close();
+   if(in == &file && prefetch.isOpen()) {
+      prefetch.close();
+      
+      //report the I/O and how long the parsing waited for it
+      if(prefetch.getReadNs() > 0) {
+         AINFO("McsRead: %.1f MB read at %.1f MB/s, parser stalled %.1f ms in %u waits",
+               prefetch.getBytes() / 1e6, 
+               prefetch.getBytes() / 1e6 / (prefetch.getReadNs() / 1e9),
+               prefetch.getStallNs() / 1e6, prefetch.getStalls());
+      }
+   }
 }
 
 //! Get Address space size file
@@ -164,24 +193,21 @@ int32_t McsRead::next ( ) {
    uint32_t data[16];   
   
    //check the ifstream status flag
-   if ( !file.good() ) {
+   if ( !in->good() ) {
       //show error message
-      cout << "McsRead::next error = ";
-      cout << "file.good = false" << endl;
+      AERR("McsRead::next error = file.good = false");
    
       //return error
       return -1;
    }      
    else{   
       //readout a line
-      getline(file,line);
+      getline(*in,line);
       
       //check for "start code"
       if (line.at(0) != ':') {
          //show error message
-         cout << "McsRead::next error = ";
-         cout << "missing start code" << endl;      
-         cout << "\t line = "     << line << endl;
+         AERR("McsRead::next error = missing start code, line = %s", line.c_str());
          //return error
          return -1;
       }
@@ -225,10 +251,7 @@ int32_t McsRead::next ( ) {
          //check for an invalid byte count
          if (byteCnt>16) {
             //show error message
-            cout << "McsRead::next error = ";
-            cout << "Invalid byte count: ";  
-            cout << byteCnt << endl;
-            cout << "\t line = "     << line << endl;
+            AERR("McsRead::next error = Invalid byte count: %u, line = %s", byteCnt, line.c_str());
             return -1;            
          }
          
@@ -243,10 +266,7 @@ int32_t McsRead::next ( ) {
                //check for an invalid byte count
                if (byteCnt==0) {
                   //show error message
-                  cout << "McsRead::next error = ";
-                  cout << "Invalid byte count: ";  
-                  cout << byteCnt << endl; 
-                  cout << "\t line = "     << line << endl;
+                  AERR("McsRead::next error = Invalid byte count: %u, line = %s", byteCnt, line.c_str());
                   return -1;            
                }
                //collect the data
@@ -264,12 +284,8 @@ int32_t McsRead::next ( ) {
                //compare the check sums
                if( summing != checkSum ) {
                   //show error message
-                  cout << "McsRead::next error = ";
-                  cout << "CheckSum Error:  ";           
-                  cout << recordType << endl;    
-                  cout << "\t line = "     << line << endl;
-                  cout << "\t summing = "  << (int32_t)summing << endl;
-                  cout << "\t checkSum = " << (int32_t)checkSum << endl;
+                  AERR("McsRead::next error = CheckSum Error:  %u, line = %s, summing = %d, checkSum = %d", 
+                       recordType, line.c_str(), (int32_t)summing, (int32_t)checkSum);
                   return -1;               
                }
                
@@ -294,12 +310,8 @@ int32_t McsRead::next ( ) {
                //compare the check sums
                if( summing != checkSum ) {
                   //show error message
-                  cout << "McsRead::next error = ";
-                  cout << "CheckSum Error:  ";           
-                  cout << recordType << endl;    
-                  cout << "\t line = "     << line << endl;
-                  cout << "\t summing = "  << (int32_t)summing << endl;
-                  cout << "\t checkSum = " << (int32_t)checkSum << endl;
+                  AERR("McsRead::next error = CheckSum Error:  %u, line = %s, summing = %d, checkSum = %d", 
+                       recordType, line.c_str(), (int32_t)summing, (int32_t)checkSum);
                   return -1;               
                }          
                
@@ -314,20 +326,14 @@ int32_t McsRead::next ( ) {
                //check for an invalid byte count
                if (byteCnt!=2) {
                   //show error message
-                  cout << "McsRead::next error = ";
-                  cout << "Invalid byte count: ";
-                  cout << byteCnt << endl;              
-                  cout << "\t line = " << line << endl;                  
+                  AERR("McsRead::next error = Invalid byte count: %u, line = %s", byteCnt, line.c_str());
                   return -1;            
                }
                
                //check for an invalid address header
                if (addr!=0) {
                   //show error message
-                  cout << "McsRead::next error = ";
-                  cout << "Invalid address header: ";
-                  cout << addr << endl;              
-                  cout << "\t line = " << line << endl;                  
+                  AERR("McsRead::next error = Invalid address header: %u, line = %s", addr, line.c_str());
                   return -1;            
                }               
                //collect the data
@@ -342,12 +348,8 @@ int32_t McsRead::next ( ) {
                //compare the check sums
                if( summing != checkSum ) {
                   //show error message
-                  cout << "McsRead::next error = ";
-                  cout << "CheckSum Error:  ";           
-                  cout << recordType << endl;    
-                  cout << "\t line = "     << line << endl;
-                  cout << "\t summing = "  << (int32_t)summing << endl;
-                  cout << "\t checkSum = " << (int32_t)checkSum << endl;
+                  AERR("McsRead::next error = CheckSum Error:  %u, line = %s, summing = %d, checkSum = %d", 
+                       recordType, line.c_str(), (int32_t)summing, (int32_t)checkSum);
                   return -1;                
                }
                
@@ -364,10 +366,7 @@ int32_t McsRead::next ( ) {
           
             default:
                //show error message
-               cout << "McsRead::next error = ";
-               cout << "Invalid Record Type: ";  
-               cout << recordType << endl;  
-               cout << "\t line = " << line << endl;
+               AERR("McsRead::next error = Invalid Record Type: %u, line = %s", recordType, line.c_str());
                return -1;         
          }   
       }   
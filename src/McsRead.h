@@ -26,8 +26,11 @@
 #include <string>
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <stdint.h>
 
+#include "McsPrefetch.h"
+
 using namespace std;
 
 #ifdef __CINT__
@@ -53,6 +56,9 @@ class McsRead {
       //! Open File
       bool open ( string filePath);
 
+      //! Open a file already read into memory
+      bool openImage ( const string &contents);
+
       //! Close File
       void close ( );
       
@@ -71,7 +77,10 @@ class McsRead {
       //! Get next data record
       int32_t next ( );   
    
-      ifstream file;
+      McsPrefetch prefetch;
+      istream file;
+      istringstream image;
+      istream *in;
       
       uint32_t promPntr;
       uint32_t promBaseAddr;
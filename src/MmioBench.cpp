@@ -0,0 +1,230 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#include <stdio.h>
+
+#include "utils.h"
+#include "linux-evr-regs.h"
+#include "EvrManager.h"
+#include "LatencyStats.h"
+#include "MmioBench.h"
+
+// the register rewritten with its own value by the write tests
+#define MMIO_BENCH_SCRATCH_REG  EVR_REG_EV_CNT_PRESC
+
+// a read-only register for the read test
+#define MMIO_BENCH_READ_REG     EVR_REG_FW_VERSION
+
+// posted writes per timed batch (closed by one read to flush them)
+#define MMIO_BENCH_WRITE_BATCH  64
+
+/*
+ * The flash access pattern of EvrCardG2Prom: every command is a
+ * writeToFlash() (2 posted writes) or a readFlash() (2 posted writes
+ * and a read), an erase is issued every PROM_BLOCK_SIZE words, a
+ * buffered program loads 256 words. The flash internal times are
+ * typical datasheet values of the StrataFlash parts on the cards.
+ */
+#define PROM_BLOCK_WORDS            0x4000
+#define PROM_BUFFER_WORDS           256
+#define FLASH_BLOCK_ERASE_TYP_US    800000.0
+#define FLASH_BUFFER_PROGRAM_TYP_US 900.0
+
+namespace {
+
+double timerOverheadNs(int iterations)
+{
+	LatencyStats st;
+	st.reserve(iterations);
+	
+	for(int i = 0; i < iterations; i ++) {
+		int64_t t0 = monotonicNowNs();
+		int64_t t1 = monotonicNowNs();
+		st.add(t1 - t0);
+	}
+	
+	return st.percentile(50);
+}
+
+void report(LatencyStats &st, const char *name)
+{
+	st.printSummary(name);
+	st.printHistogram();
+}
+
+// the read and turnaround latencies where the thread runs now
+void measureLatencies(EvrManager &manager, int iterations, double overhead, 
+					  LatencyStats &readSt, LatencyStats &turnSt)
+{
+	uint32_t scratch = manager.readReg(MMIO_BENCH_SCRATCH_REG);
+	
+	readSt.reserve(iterations);
+	turnSt.reserve(iterations);
+	
+	for(int i = 0; i < iterations; i ++) {
+		int64_t t0 = monotonicNowNs();
+		manager.readReg(MMIO_BENCH_READ_REG);
+		int64_t t1 = monotonicNowNs();
+		readSt.add(t1 - t0 - overhead);
+	}
+	
+	for(int i = 0; i < iterations; i ++) {
+		int64_t t0 = monotonicNowNs();
+		manager.writeReg(MMIO_BENCH_SCRATCH_REG, scratch);
+		manager.readReg(MMIO_BENCH_SCRATCH_REG);
+		int64_t t1 = monotonicNowNs();
+		turnSt.add(t1 - t0 - overhead);
+	}
+}
+
+} // unnamed namespace
+
+
+
+bool mmioBench(EvrManager &manager, int iterations, uint32_t imageBytes, 
+			   MmioCost *cost)
+{
+	if(iterations < MMIO_BENCH_WRITE_BATCH) {
+		AERR("At least %d iterations needed", MMIO_BENCH_WRITE_BATCH);
+		return false;
+	}
+	
+	if(MMIO_BENCH_SCRATCH_REG + 4 > manager.getIoLength() 
+	   || MMIO_BENCH_READ_REG + 4 > manager.getIoLength()) {
+		AERR("The IO region (%d bytes) is too small", manager.getIoLength());
+		return false;
+	}
+	
+	double overhead = timerOverheadNs(iterations);
+	printf("Timer overhead: %.1f ns (subtracted)%s\n", overhead, 
+		   manager.isFileBacked() ? ", file backed region" : "");
+	
+	LatencyStats readSt, writeSt, turnSt;
+	writeSt.reserve(iterations / MMIO_BENCH_WRITE_BATCH);
+	
+	measureLatencies(manager, iterations, overhead, readSt, turnSt);
+	
+	double readNs = readSt.percentile(50);
+	uint32_t scratch = manager.readReg(MMIO_BENCH_SCRATCH_REG);
+	
+	for(int i = 0; i < iterations / MMIO_BENCH_WRITE_BATCH; i ++) {
+		int64_t t0 = monotonicNowNs();
+		for(int j = 0; j < MMIO_BENCH_WRITE_BATCH; j ++) {
+			manager.writeReg(MMIO_BENCH_SCRATCH_REG, scratch);
+		}
+		// the read can't complete before the posted writes did
+		manager.readReg(MMIO_BENCH_READ_REG);
+		int64_t t1 = monotonicNowNs();
+		writeSt.add((t1 - t0 - overhead - readNs) / MMIO_BENCH_WRITE_BATCH);
+	}
+	
+	report(readSt, "read");
+	report(writeSt, "posted write (per write)");
+	report(turnSt, "write->read turnaround");
+	
+	MmioCost c;
+	c.readNs = readNs;
+	c.postedWriteNs = writeSt.percentile(50);
+	c.turnaroundNs = turnSt.percentile(50);
+	
+	printf("Posted write throughput: %.2f Mwrites/s (%.1f MB/s)\n", 
+		   c.postedWriteNs > 0 ? 1e3 / c.postedWriteNs : 0,
+		   c.postedWriteNs > 0 ? 4e3 / c.postedWriteNs : 0);
+	
+	mmioPredictPromLoad(c, imageBytes);
+	
+	if(cost != NULL) {
+		*cost = c;
+	}
+	
+	return true;
+}
+
+bool mmioPlacementBench(EvrManager &manager, const CardLocality &loc, int iterations)
+{
+	if(iterations <= 0) {
+		AERR("Invalid iterations %d", iterations);
+		return false;
+	}
+	
+	if(MMIO_BENCH_SCRATCH_REG + 4 > manager.getIoLength() 
+	   || MMIO_BENCH_READ_REG + 4 > manager.getIoLength()) {
+		AERR("The IO region (%d bytes) is too small", manager.getIoLength());
+		return false;
+	}
+	
+	printf("Card %s: %s, remote CPUs %s\n", 
+		   loc.pciDevice.empty() ? "(no PCI device)" : loc.pciDevice.c_str(), 
+		   loc.describe().c_str(), formatCpuList(loc.remoteCpus).c_str());
+	
+	const Placement placements[] = { PLACEMENT_LOCAL, PLACEMENT_REMOTE };
+	const char *names[] = { "local", "remote" };
+	double readP50[2] = { 0, 0 };
+	double turnP50[2] = { 0, 0 };
+	
+	printf("%-8s %10s %10s %10s %10s\n", "PLACE", "READ_P50", "READ_P99", "TURN_P50", "TURN_P99");
+	
+	for(int p = 0; p < 2; p ++) {
+		
+		if(placements[p] == PLACEMENT_REMOTE && CPU_COUNT(&loc.remoteCpus) == 0) {
+			printf("%-8s (no CPUs away from the card)\n", names[p]);
+			continue;
+		}
+		
+		PlacementScope place(loc, placements[p]);
+		if(!place.isPlaced()) {
+			return false;
+		}
+		
+		LatencyStats readSt, turnSt;
+		measureLatencies(manager, iterations, timerOverheadNs(iterations), readSt, turnSt);
+		
+		readP50[p] = readSt.percentile(50);
+		turnP50[p] = turnSt.percentile(50);
+		
+		printf("%-8s %10.1f %10.1f %10.1f %10.1f\n", names[p], readP50[p], 
+			   readSt.percentile(99), turnP50[p], turnSt.percentile(99));
+	}
+	
+	if(readP50[0] > 0 && readP50[1] > 0) {
+		printf("Remote/local: read %.2fx, turnaround %.2fx\n", 
+			   readP50[1] / readP50[0], turnP50[0] > 0 ? turnP50[1] / turnP50[0] : 0);
+	}
+	
+	return true;
+}
+
+void mmioPredictPromLoad(const MmioCost &c, uint32_t imageBytes)
+{
+	double words = imageBytes / 2.0;
+	double blocks = imageBytes / PROM_BLOCK_WORDS + 1; // see eraseBootProm()
+	double buffers = (uint32_t)(words + PROM_BUFFER_WORDS - 1) / PROM_BUFFER_WORDS;
+	
+	double writeCmdNs = 2 * c.postedWriteNs;
+	double readCmdNs = c.postedWriteNs + c.turnaroundNs;
+	
+	// unlock, clear status, erase, lock + one status read
+	double eraseMmioNs = blocks * (4 * writeCmdNs + readCmdNs);
+	double eraseFlashNs = blocks * FLASH_BLOCK_ERASE_TYP_US * 1e3;
+	
+	// unlock, clear status, program + the words + confirm, status, lock
+	double progMmioNs = buffers * (4 * writeCmdNs + (PROM_BUFFER_WORDS + 2) * readCmdNs);
+	double progFlashNs = buffers * FLASH_BUFFER_PROGRAM_TYP_US * 1e3;
+	
+	double verifyNs = words * readCmdNs;
+	
+	printf("Predicted promload of a 0x%08X byte image:\n", imageBytes);
+	printf("  erase   %5.0f blocks:  %8.2f s (MMIO %6.3f s)\n", blocks, 
+		   (eraseMmioNs + eraseFlashNs) / 1e9, eraseMmioNs / 1e9);
+	printf("  program %5.0f buffers: %8.2f s (MMIO %6.3f s)\n", buffers, 
+		   (progMmioNs + progFlashNs) / 1e9, progMmioNs / 1e9);
+	printf("  verify  %8.0f words: %8.2f s (MMIO)\n", words, verifyNs / 1e9);
+	printf("  total:                 %8.2f s\n", 
+		   (eraseMmioNs + eraseFlashNs + progMmioNs + progFlashNs + verifyNs) / 1e9);
+}
@@ -0,0 +1,47 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#ifndef __MMIO_BENCH_H__
+#define __MMIO_BENCH_H__
+
+#include <stdint.h>
+
+#include "EvrManager.h"
+#include "CardPlacement.h"
+
+#define MMIO_BENCH_ITERATIONS_DEFAULT  100000
+
+// PROM_SIZE of EvrCardG2Prom.cpp, the usual image size in bytes
+#define MMIO_BENCH_IMAGE_BYTES_DEFAULT 0x002DF2FB
+
+struct MmioCost {
+	double readNs;        // uncached read latency (p50)
+	double postedWriteNs; // cost of one posted write in a stream (p50)
+	double turnaroundNs;  // write immediately followed by a read (p50)
+};
+
+/*
+ * Measures the MMIO costs on the mapped region using only read-only
+ * and scratch registers (the write tests write back the value read
+ * from EVR_REG_EV_CNT_PRESC). Prints percentile summaries, histograms
+ * and the promload duration predicted for an image of 'imageBytes'.
+ */
+bool mmioBench(EvrManager &manager, int iterations, uint32_t imageBytes, 
+			   MmioCost *cost = NULL);
+
+/*
+ * The MMIO read and write->read turnaround latencies with the thread on
+ * the CPUs local to the card and then on the others, side by side.
+ */
+bool mmioPlacementBench(EvrManager &manager, const CardLocality &loc, int iterations);
+
+// Prints the promload duration predicted from 'cost' and the typical flash timings.
+void mmioPredictPromLoad(const MmioCost &cost, uint32_t imageBytes);
+
+#endif // __MMIO_BENCH_H__
@@ -0,0 +1,237 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#include <glob.h>
+#include <pthread.h>
+#include <time.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "utils.h"
+#include "EvrManager.h"
+#include "MultiCard.h"
+#include "ConfigSnapshot.h"
+#include "Trace.h"
+#include "CardPlacement.h"
+
+namespace {
+
+struct CardJob {
+	
+	std::string mngDevNodeName;
+	std::string command;
+	std::string arg;
+	const Options *options;
+	
+	pthread_t thread;
+	bool started;
+	
+	bool ok;
+	std::string result;
+	double elapsedMs;
+	int numaNode;
+	
+	explicit CardJob(const std::string &devNode, const std::string &cmd, 
+					const std::string &cmdArg, const Options &opts)
+		: mngDevNodeName(devNode)
+		, command(cmd)
+		, arg(cmdArg)
+		, options(&opts)
+		, started(false)
+		, ok(false)
+		, elapsedMs(0)
+		, numaNode(-1)
+	{
+	}
+};
+
+double msSince(const struct timespec &start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	
+	return (now.tv_sec - start.tv_sec) * 1e3 
+			+ (now.tv_nsec - start.tv_nsec) / 1e6;
+}
+
+void runCardJob(CardJob &job)
+{
+	char buf[128];
+	
+	EvrManager manager(job.mngDevNodeName);
+	
+	CardLock lock(job.mngDevNodeName);
+	
+	if(job.command == "init") {
+		
+		manager.setReadyTimeout(job.options->readyTimeoutMs);
+		
+		job.ok = manager.ioConfig(IOCFG_INIT);
+		
+		if(job.ok && job.options->timing) {
+			snprintf(buf, sizeof(buf), "ready after %.3f ms (%u polls)", 
+					manager.getReadyTimeMs(), manager.getReadyPolls());
+			job.result = buf;
+		} else if(!job.ok) {
+			job.result = "not ready";
+		}
+		
+	} else if(job.command == "version") {
+		
+		snprintf(buf, sizeof(buf), "FW_VERSION: 0x%08X", manager.readFwVersion());
+		job.result = buf;
+		job.ok = true;
+		
+	} else if(job.command == "temperature") {
+		
+		double temp[2];
+		uint32_t raw[2];
+		
+		if(manager.readTemperature(temp, raw)) {
+			snprintf(buf, sizeof(buf), "(current) %6.2lf degC, (max) %6.2lf degC",
+					temp[0], temp[1]);
+			job.result = buf;
+		} else {
+			job.result = "not available";
+		}
+		job.ok = true;
+		
+	} else if(job.command == "snapshot" || job.command == "restore") {
+		
+		// one file per card in the directory
+		std::string base = job.mngDevNodeName.substr(job.mngDevNodeName.rfind('/') + 1);
+		std::string filePath = job.arg + "/" + base + ".snap";
+		
+		if(job.command == "snapshot") {
+			job.ok = snapshotConfig(manager, job.mngDevNodeName, filePath, &job.result);
+		} else {
+			job.ok = restoreConfig(manager, filePath, &job.result);
+		}
+		if(!job.ok && job.result.empty()) {
+			job.result = "failed";
+		}
+	}
+}
+
+void *cardJobThread(void *arg)
+{
+	CardJob &job = *(CardJob *)arg;
+	
+	traceThreadName(job.mngDevNodeName.c_str());
+	TraceSpan span("card", job.command);
+	
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	
+	// the card's MMIO round trips and the job's memory stay on its node
+	CardLocality locality;
+	bool located = locality.find(job.mngDevNodeName);
+	if(located) {
+		job.numaNode = locality.numaNode;
+	}
+	PlacementScope place(locality, located ? job.options->placement : PLACEMENT_NONE);
+	
+	try {
+		runCardJob(job);
+	} catch(std::runtime_error &e) {
+		job.ok = false;
+		job.result = e.what();
+	}
+	
+	job.elapsedMs = msSince(start);
+	
+	return NULL;
+}
+
+} // unnamed namespace
+
+
+
+std::vector<std::string> findMngDevNodes(void)
+{
+	std::vector<std::string> nodes;
+	glob_t g;
+	
+	if(glob("/dev/evr*mng", 0, NULL, &g) == 0) {
+		for(size_t i = 0; i < g.gl_pathc; i ++) {
+			nodes.push_back(g.gl_pathv[i]);
+		}
+	}
+	globfree(&g);
+	
+	return nodes;
+}
+
+bool isMultiCardCommand(const std::string &command)
+{
+	return command == "init" || command == "version" || command == "temperature"
+			|| command == "snapshot" || command == "restore";
+}
+
+bool runOnAllCards(const std::string &command, const std::string &arg, 
+				   const Options &options)
+{
+	std::vector<std::string> nodes = findMngDevNodes();
+	
+	if(nodes.empty()) {
+		AERR("No /dev/evr*mng devices found");
+		return false;
+	}
+	
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	
+	std::vector<CardJob> jobs;
+	for(size_t i = 0; i < nodes.size(); i ++) {
+		jobs.push_back(CardJob(nodes[i], command, arg, options));
+	}
+	
+	// the vector is not resized from here on so the job addresses are stable
+	for(size_t i = 0; i < jobs.size(); i ++) {
+		int err = pthread_create(&jobs[i].thread, NULL, cardJobThread, &jobs[i]);
+		if(err) {
+			AERR("pthread_create failed for %s, err=%d", 
+					jobs[i].mngDevNodeName.c_str(), err);
+			jobs[i].result = "thread start failed";
+		} else {
+			jobs[i].started = true;
+		}
+	}
+	
+	for(size_t i = 0; i < jobs.size(); i ++) {
+		if(jobs[i].started) {
+			pthread_join(jobs[i].thread, NULL);
+		}
+	}
+	
+	bool ret = true;
+	
+	printf("%-20s %-12s %-6s %4s %10s  %s\n", "DEVICE", "COMMAND", "STATUS", "NODE", 
+			"TIME[ms]", "RESULT");
+	for(size_t i = 0; i < jobs.size(); i ++) {
+		const CardJob &job = jobs[i];
+		char node[16] = "-";
+		if(job.numaNode >= 0) {
+			snprintf(node, sizeof(node), "%d", job.numaNode);
+		}
+		printf("%-20s %-12s %-6s %4s %10.1f  %s\n", job.mngDevNodeName.c_str(), 
+				job.command.c_str(), job.ok ? "OK" : "FAILED", node, job.elapsedMs, 
+				job.result.c_str());
+		if(!job.ok) {
+			ret = false;
+		}
+	}
+	printf("%d card(s), total %.1f ms\n", (int)jobs.size(), msSince(start));
+	
+	return ret;
+}
@@ -0,0 +1,30 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#ifndef __MULTI_CARD_H__
+#define __MULTI_CARD_H__
+
+#include <string>
+#include <vector>
+
+#include "Options.h"
+
+// Returns the sorted list of all /dev/evr*mng manager device nodes.
+std::vector<std::string> findMngDevNodes(void);
+
+// Is 'command' one of the commands supported by the '--all' form?
+bool isMultiCardCommand(const std::string &command);
+
+// Runs 'command' on every card in parallel (one thread per card) and
+// prints a merged result table. True if it succeeded on all the cards.
+// 'arg' is the directory of the per-card files of snapshot and restore.
+bool runOnAllCards(const std::string &command, const std::string &arg, 
+				   const Options &options);
+
+#endif // __MULTI_CARD_H__
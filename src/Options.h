@@ -0,0 +1,59 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#ifndef __EVR_MANAGER_OPTIONS_H__
+#define __EVR_MANAGER_OPTIONS_H__
+
+#include "EvrManager.h"
+#include "RealTime.h"
+#include "CardPlacement.h"
+
+// The '--xxx' options given in front of the manager device node.
+struct Options {
+	
+	bool all;              // --all
+	bool timing;           // --timing
+	int readyTimeoutMs;    // --init-timeout=<ms>
+	bool rt;               // --rt[=<cpu>[,<priority>]]
+	int rtCpu;
+	int rtPriority;
+	bool dryRun;           // --dry-run
+	bool wait;             // --wait[=<ms>]
+	int waitTimeoutMs;     // < 0 for ever
+	bool inlineVerify;     // --inline-verify
+	bool postedBuffer;     // --posted-buffer
+	bool plan;             // --plan
+	std::string calibPath; // --calib=<file>, empty for the default
+	Placement placement;   // --placement=none|local|remote, local with --all
+	bool placementSet;
+	uint32_t scrubRate;    // --scrub-rate=<words/s>
+	int scrubTimeS;        // --scrub-time=<s>, 0 for a whole pass
+	
+	explicit Options(void)
+		: all(false)
+		, timing(false)
+		, readyTimeoutMs(EVR_READY_TIMEOUT_MS_DEFAULT)
+		, rt(false)
+		, rtCpu(-1)
+		, rtPriority(RT_PRIORITY_DEFAULT)
+		, dryRun(false)
+		, wait(false)
+		, waitTimeoutMs(-1)
+		, inlineVerify(false)
+		, postedBuffer(false)
+		, plan(false)
+		, placement(PLACEMENT_NONE)
+		, placementSet(false)
+		, scrubRate(PROM_SCRUB_RATE_DEFAULT)
+		, scrubTimeS(0)
+	{
+	}
+};
+
+#endif // __EVR_MANAGER_OPTIONS_H__
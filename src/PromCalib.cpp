@@ -0,0 +1,314 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#include <unistd.h>
+#include <limits.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+#include "utils.h"
+#include "PromCalib.h"
+
+// the latest loads the estimates and the trend are taken from
+#define PROM_CALIB_RUNS      5
+
+// the loads needed at each end of the history to tell a trend
+#define PROM_CALIB_TREND_RUNS 3
+
+// how much slower than the first loads is reported (%)
+#define PROM_CALIB_SLOWER_PCT 20
+
+namespace {
+
+// the median of the first 'runs' non-zero 'field' from 'first' on, 0 if none
+double median(const std::vector<PromCalibration> &history, 
+			  double PromCalibration::*field, size_t first, size_t runs)
+{
+	std::vector<double> values;
+	
+	for(size_t i = first; i < history.size() && values.size() < runs; i ++) {
+		if(history[i].*field > 0) {
+			values.push_back(history[i].*field);
+		}
+	}
+	
+	if(values.empty()) {
+		return 0;
+	}
+	
+	std::sort(values.begin(), values.end());
+	return values[values.size() / 2];
+}
+
+// the latest loads, 'runs' of them measuring 'field', start at the result
+size_t latest(const std::vector<PromCalibration> &history, 
+			  double PromCalibration::*field, size_t runs)
+{
+	size_t i = history.size();
+	size_t found = 0;
+	
+	while(i > 0 && found < runs) {
+		i --;
+		if(history[i].*field > 0) {
+			found ++;
+		}
+	}
+	
+	return i;
+}
+
+// "erase 812.3 -> 1002.7 ms (+23%)" if 'field' grew too much
+bool slower(const std::vector<PromCalibration> &history, 
+			double PromCalibration::*field, const char *name, std::string *what)
+{
+	size_t measured = 0;
+	for(size_t i = 0; i < history.size(); i ++) {
+		if(history[i].*field > 0) {
+			measured ++;
+		}
+	}
+	
+	// the first and the latest loads may not overlap
+	if(measured < 2 * PROM_CALIB_TREND_RUNS) {
+		return false;
+	}
+	
+	double first = median(history, field, 0, PROM_CALIB_TREND_RUNS);
+	double last = median(history, field, latest(history, field, PROM_CALIB_TREND_RUNS), 
+						 PROM_CALIB_TREND_RUNS);
+	
+	if(last * 100 <= first * (100 + PROM_CALIB_SLOWER_PCT)) {
+		return false;
+	}
+	
+	char buf[96];
+	snprintf(buf, sizeof(buf), "%s%s %.3f -> %.3f ms (+%.0f%%)", 
+			 what->empty() ? "" : ", ", name, first / 1e6, last / 1e6, 
+			 (last / first - 1) * 100);
+	*what += buf;
+	
+	return true;
+}
+
+// no blanks, "unknown" if nothing is left
+std::string keyPart(const std::string &text)
+{
+	std::string part;
+	
+	for(size_t i = 0; i < text.size() && text[i] != '\0'; i ++) {
+		char c = text[i];
+		part += c > ' ' && c < 0x7f ? c : '_';
+	}
+	
+	// the padding of the register
+	while(!part.empty() && part[part.size() - 1] == '_') {
+		part.erase(part.size() - 1);
+	}
+	
+	return part.empty() ? "unknown" : part;
+}
+
+} // unnamed namespace
+
+
+
+PromCalibration::PromCalibration(void)
+	: time(0)
+	, fwVersion(0)
+	, eraseNs(0)
+	, blankNs(0)
+	, programNs(0)
+	, verifyNs(0)
+	, mmioNs(0)
+{
+}
+
+std::string PromCalibration::format(void) const
+{
+	char buf[256];
+	
+	snprintf(buf, sizeof(buf), " time=%lld fw=0x%x erase_ns=%.0f blank_ns=%.0f "
+			 "program_ns=%.0f verify_ns=%.1f mmio_ns=%.1f", 
+			 (long long)time, fwVersion, eraseNs, blankNs, programNs, verifyNs, mmioNs);
+	
+	return key + buf;
+}
+
+bool PromCalibration::parse(const std::string &line)
+{
+	std::istringstream in(line);
+	std::string field;
+	
+	*this = PromCalibration();
+	
+	if(!(in >> key) || key[0] == '#') {
+		return false;
+	}
+	
+	// unknown fields are left for the later versions
+	while(in >> field) {
+		
+		size_t eq = field.find('=');
+		if(eq == std::string::npos) {
+			return false;
+		}
+		
+		std::string name = field.substr(0, eq);
+		const char *value = field.c_str() + eq + 1;
+		
+		if(name == "time") {
+			time = ::strtoll(value, NULL, 10);
+		} else if(name == "fw") {
+			fwVersion = ::strtoul(value, NULL, 0);
+		} else if(name == "erase_ns") {
+			eraseNs = ::atof(value);
+		} else if(name == "blank_ns") {
+			blankNs = ::atof(value);
+		} else if(name == "program_ns") {
+			programNs = ::atof(value);
+		} else if(name == "verify_ns") {
+			verifyNs = ::atof(value);
+		} else if(name == "mmio_ns") {
+			mmioNs = ::atof(value);
+		}
+	}
+	
+	return time != 0;
+}
+
+std::string promCalibPath(const std::string &path)
+{
+	if(!path.empty()) {
+		return path;
+	}
+	
+	const char *dir = "/var/lib";
+	if(access(dir, W_OK) != 0) {
+		dir = "/tmp";
+	}
+	
+	return std::string(dir) + "/evrManager.promcalib";
+}
+
+std::string promCalibCard(const std::string &mngDevNodeName)
+{
+	std::string base = mngDevNodeName.substr(mngDevNodeName.rfind('/') + 1);
+	std::string link = "/sys/class/modac-mng/" + base + "/device";
+	char path[PATH_MAX];
+	
+	if(realpath(link.c_str(), path) == NULL) {
+		return base;
+	}
+	
+	std::string dev = path;
+	return dev.substr(dev.rfind('/') + 1);
+}
+
+std::string promCalibKey(const std::string &card, const std::string &buildStamp)
+{
+	return keyPart(card) + "/" + keyPart(buildStamp);
+}
+
+bool promCalibRecord(const std::string &path, const PromCalibration &calib)
+{
+	std::string file = promCalibPath(path);
+	
+	FILE *f = fopen(file.c_str(), "a");
+	if(f == NULL) {
+		AERR("Can't open the calibration database '%s', errno=%d", file.c_str(), errno);
+		return false;
+	}
+	
+	bool ok = fprintf(f, "%s\n", calib.format().c_str()) > 0;
+	ok = fclose(f) == 0 && ok;
+	
+	if(!ok) {
+		AERR("Can't write the calibration database '%s'", file.c_str());
+		return false;
+	}
+	
+	AINFO("Calibration: %.3f ms per erase, %.3f ms per buffer, %.1f ns per MMIO read", 
+		  calib.eraseNs / 1e6, calib.programNs / 1e6, calib.mmioNs);
+	
+	std::vector<PromCalibration> history;
+	std::string what;
+	
+	if(promCalibLoad(path, calib.key, history) && promCalibSlower(history, &what)) {
+		AERR("The flash of this card is getting slower: %s over %u loads", 
+			 what.c_str(), (unsigned)history.size());
+	}
+	
+	return true;
+}
+
+bool promCalibLoad(const std::string &path, const std::string &key, 
+				   std::vector<PromCalibration> &history)
+{
+	std::string file = promCalibPath(path);
+	std::ifstream in(file.c_str());
+	std::string line;
+	
+	history.clear();
+	
+	if(!in) {
+		return false;
+	}
+	
+	while(std::getline(in, line)) {
+		PromCalibration calib;
+		if(calib.parse(line) && calib.key == key) {
+			history.push_back(calib);
+		}
+	}
+	
+	return true;
+}
+
+PromCalibration promCalibEstimate(const std::vector<PromCalibration> &history)
+{
+	PromCalibration est;
+	
+	if(history.empty()) {
+		return est;
+	}
+	
+	est.key = history.back().key;
+	est.time = history.back().time;
+	est.fwVersion = history.back().fwVersion;
+	
+	double PromCalibration::*fields[] = {
+		&PromCalibration::eraseNs, &PromCalibration::blankNs, 
+		&PromCalibration::programNs, &PromCalibration::verifyNs, 
+		&PromCalibration::mmioNs,
+	};
+	
+	for(size_t f = 0; f < sizeof(fields) / sizeof(fields[0]); f ++) {
+		est.*fields[f] = median(history, fields[f], 
+								latest(history, fields[f], PROM_CALIB_RUNS), PROM_CALIB_RUNS);
+	}
+	
+	return est;
+}
+
+bool promCalibSlower(const std::vector<PromCalibration> &history, std::string *what)
+{
+	what->clear();
+	
+	bool erase = slower(history, &PromCalibration::eraseNs, "erase", what);
+	bool program = slower(history, &PromCalibration::programNs, "program", what);
+	
+	return erase || program;
+}
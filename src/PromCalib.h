@@ -0,0 +1,71 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#ifndef __PROM_CALIB_H__
+#define __PROM_CALIB_H__
+
+#include <stdint.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+// The flash timings measured by one PROM load of a card (0 if not measured).
+struct PromCalibration {
+	
+	std::string key;       // the card, see promCalibKey()
+	time_t time;           // of the load
+	uint32_t fwVersion;
+	double eraseNs;        // per block erased
+	double blankNs;        // per block checked
+	double programNs;      // per buffer programmed
+	double verifyNs;       // per word verified
+	double mmioNs;         // per register read
+	
+	PromCalibration(void);
+	
+	// one line of the database
+	std::string format(void) const;
+	bool parse(const std::string &line);
+};
+
+/*
+ * The calibration database: every successful promload appends what it
+ * measured to /var/lib/evrManager.promcalib (/tmp if not writable), one
+ * line per load, and 'evrManager --plan' predicts a load from it. The
+ * cards have no serial number to read, so a card is known by its slot
+ * (the PCI device) and its build stamp: the loads of the same firmware
+ * in the same slot are the history of the card.
+ */
+
+// the default database, if 'path' is empty
+std::string promCalibPath(const std::string &path);
+
+// the card of the manager node: its PCI device (e.g. "0000:05:00.0"), 
+// the node name if it has none (e.g. the emulator)
+std::string promCalibCard(const std::string &mngDevNodeName);
+
+// "<card>/<build stamp>" as a database key (no blanks)
+std::string promCalibKey(const std::string &card, const std::string &buildStamp);
+
+// appends 'calib', reporting if the card's flash is getting slower
+bool promCalibRecord(const std::string &path, const PromCalibration &calib);
+
+// the loads of 'key', the oldest first; false if the database can't be read
+bool promCalibLoad(const std::string &path, const std::string &key, 
+				   std::vector<PromCalibration> &history);
+
+// each timing as the median of the latest loads that measured it
+PromCalibration promCalibEstimate(const std::vector<PromCalibration> &history);
+
+// true if the erase or program time grew from the first loads to the
+// latest ones; 'what' tells by how much
+bool promCalibSlower(const std::vector<PromCalibration> &history, std::string *what);
+
+#endif // __PROM_CALIB_H__
@@ -0,0 +1,102 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#ifndef __PROM_GENERATION_H__
+#define __PROM_GENERATION_H__
+
+#include <stdint.h>
+
+/*
+ * The PROM interface of a card generation: the register layout, the
+ * flash geometry and the bus cycle of a flash command. Each generation
+ * is a compile time policy (a struct of constants and inline functions)
+ * that EvrCardProm<Gen> builds a driver from; PromLayout is the same at
+ * run time, for the code that isn't specialized. A new card revision
+ * gets its own policy and a line in PromRegistry.cpp.
+ */
+
+struct PromLayout {
+	
+	uint32_t id;           // the firmware version >> 12
+	const char *name;
+	
+	// register offsets in BAR0
+	uint32_t versionReg;
+	uint32_t buildReg;
+	uint32_t dataReg;      // command and data of a bus cycle
+	uint32_t addressReg;   // address, writing it starts the cycle
+	uint32_t readReg;      // the data read by the cycle
+	uint32_t readReq;      // address bit of a read cycle
+	
+	// the flash configuration register setup at the start
+	uint32_t configAddr;
+	uint16_t configCmd;
+	uint16_t configData;
+	
+	uint32_t blockWords;   // the smallest erase block
+	uint32_t bufferWords;  // of the buffered program command
+	uint32_t partitionWords; // of the read-while-write partitions, 0 for none
+};
+
+// EvrCardG2 (SLAC firmware 0xCED2xxxx), StrataFlash on the flash bus
+struct PromGen2 {
+	
+	static const uint32_t ID           = 0xCED20;
+	
+	static const uint32_t VERSION_REG  = 0x10000;
+	static const uint32_t BUILD_REG    = 0x10800;
+	static const uint32_t DATA_REG     = 0x20000;
+	static const uint32_t ADDRESS_REG  = 0x20004;
+	static const uint32_t READ_REG     = 0x20008;
+	static const uint32_t READ_REQ     = 0x80000000;
+	
+	static const uint32_t CONFIG_ADDR  = 0xFD4F; // force the default configuration
+	static const uint16_t CONFIG_CMD   = 0x60;
+	static const uint16_t CONFIG_DATA  = 0x03;
+	
+	static const uint32_t BLOCK_WORDS  = 0x4000; // assume 16-kword blocks
+	static const uint32_t BUFFER_WORDS = 256;
+	
+	// erasing while writing is not checked with the part of these cards:
+	// no partitions, the whole PROM is erased first
+	static const uint32_t PARTITION_WORDS = 0;
+	
+	static const char *name(void) { return "EvrCardG2"; }
+	
+	// the data bus word of a cycle
+	static uint32_t request(uint16_t cmd, uint16_t data)
+	{
+		return ((uint32_t)cmd << 16) | data;
+	}
+};
+
+template <class Gen>
+PromLayout promLayout(void)
+{
+	PromLayout layout;
+	
+	layout.id          = Gen::ID;
+	layout.name        = Gen::name();
+	layout.versionReg  = Gen::VERSION_REG;
+	layout.buildReg    = Gen::BUILD_REG;
+	layout.dataReg     = Gen::DATA_REG;
+	layout.addressReg  = Gen::ADDRESS_REG;
+	layout.readReg     = Gen::READ_REG;
+	layout.readReq     = Gen::READ_REQ;
+	layout.configAddr  = Gen::CONFIG_ADDR;
+	layout.configCmd   = Gen::CONFIG_CMD;
+	layout.configData  = Gen::CONFIG_DATA;
+	layout.blockWords  = Gen::BLOCK_WORDS;
+	layout.bufferWords = Gen::BUFFER_WORDS;
+	layout.partitionWords = Gen::PARTITION_WORDS;
+	
+	return layout;
+}
+
+#endif // __PROM_GENERATION_H__
@@ -15,33 +15,52 @@
 #include <fcntl.h>
 #include <sstream>
 #include <string>
+#include <vector>
+#include <algorithm>
 #include <iomanip>
 #include <iostream>
+#include <fstream>
 #include <string.h>
 #include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
 
 #include "EvrCardG2Prom.h"
+#include "PromRegistry.h"
+#include "PromCalib.h"
 #include "PromLoad.h"
+#include "Trace.h"
+#include "utils.h"
 
 using namespace std;
 
 #define PAGE_SIZE sysconf(_SC_PAGE_SIZE)
 
-int PromLoad (void *mapStart, string filePath) {
+int PromLoad (void *mapStart, string filePath, 
+              PromProgressFunc progress, void *progressArg, int flags,
+              const string &calibPath, const string &card) {
 
    EvrCardG2Prom *prom;
+   PromCalibration calib;
+   string image;
 
    if(mapStart == MAP_FAILED){
-      cout << "Error: mmap() = " << dec << mapStart << endl;
+      AERR("mmap() = %p", mapStart);
       return(1);   
    }
    
-   // Create the EvrCardG2Prom object
-   prom = new EvrCardG2Prom(mapStart,filePath);
+   // Create the driver of the card generation
+   prom = createPromDriver(mapStart,filePath);
+   if(prom == NULL) {
+      return(1);   
+   }
+   prom->setProgress(progress,progressArg);
+   prom->setInlineVerify((flags & PROM_LOAD_INLINE_VERIFY) != 0);
+   prom->setPostedBufferLoad((flags & PROM_LOAD_POSTED_BUFFER) != 0);
    
    // Check if the .mcs file exists
    if(!prom->fileExist()){
-      cout << "Error opening: " << filePath << endl;
+      AERR("Error opening: %s", filePath.c_str());
       delete prom;
       return(1);   
    }   
@@ -49,41 +68,168 @@ int PromLoad (void *mapStart, string filePath) {
    // Get & Set the FPGA's PROM code size
    prom->setPromSize(prom->getPromSize(filePath));       
    
+   // Keep the whole file in memory, no file system access while programming
+   if(flags & PROM_LOAD_PRELOAD) {
+      TraceSpan span("preload");
+      ifstream file(filePath.c_str());
+      stringstream contents;
+      contents << file.rdbuf();
+      image = contents.str();
+      prom->setImage(&image);
+   }
+   
    // Check if the PCIe device is a generation 2 card
    if(!prom->checkFirmwareVersion()){
       delete prom;
       return(1);   
    }    
       
-   // Erase the PROM
-   prom->eraseBootProm();
-  
-   // Write the .mcs file to the PROM
-   if(!prom->bufferedWriteBootProm()) {
-      cout << "Error in prom->bufferedWriteBootProm() function" << endl;
+   // Before the flash keeps the bus busy
+   calib.mmioNs = prom->measureMmioNs();
+   
+   prom->trackJitter((flags & PROM_LOAD_JITTER) != 0);
+   
+   // Erase the PROM and write the .mcs file to it
+   if(!prom->eraseWriteBootProm()) {
+      AERR("Error in prom->eraseWriteBootProm() function");
       delete prom;
       return(1);     
    }   
+   prom->printJitter("write");
 
-   // Compare the .mcs file with the PROM
-   if(!prom->verifyBootProm()) {
-      cout << "Error in prom->verifyBootProm() function" << endl;
-      delete prom;
-      return(1);     
+   // Compare the .mcs file with the PROM, or after an inline verified write
+   // (and the erases past the image) the crc of the whole image read back
+   if(!(flags & PROM_LOAD_INLINE_VERIFY)) {
+      if(!prom->verifyBootProm()) {
+         AERR("Error in prom->verifyBootProm() function");
+         delete prom;
+         return(1);     
+      }
+   } else {
+      if(!prom->verifyImageCrc()) {
+         AERR("Error in prom->verifyImageCrc() function");
+         delete prom;
+         return(1);     
+      }
    }
+   prom->printJitter("verify");
+      
+   // Keep the timings of the card for PromPlan()
+   double mmioNs = calib.mmioNs;
+   prom->getCalibration(&calib,card);
+   calib.mmioNs = mmioNs;
+   promCalibRecord(calibPath, calib);
       
-   // Display Reminder
-   cout << "\n\n\n\n\n";
-   cout << "***************************************" << endl;
-   cout << "***************************************" << endl;
-   cout << "New data has been written into the PROM." << endl;
-   cout << "To load the new PROM data into the FPGA, " << endl<< endl;
-   cout << "a power cycle of the PCIe card is required " << endl;
-   cout << "***************************************" << endl;
-   cout << "***************************************" << endl;
-   cout << "\n\n\n\n\n";
+   // Display Reminder, whatever the log level, after the log lines so far
+   evrLogFlush();
+   printf("New data has been written into the PROM.\n");
+   printf("To load the new PROM data into the FPGA, a power cycle of the PCIe card is required\n");
+   fflush(stdout);
    
 	// Close all the devices
    delete prom;
    return(0);
 }
+
+int PromPlan (void *mapStart, string filePath, int flags,
+              const string &calibPath, const string &card) {
+
+   EvrCardG2Prom *prom;
+   vector<PromCalibration> history;
+   uint32_t blocks, buffers, words;
+   string slower;
+
+   if(mapStart == MAP_FAILED){
+      AERR("mmap() = %p", mapStart);
+      return(1);   
+   }
+   
+   // Only the firmware registers are read, the flash is left alone
+   prom = createPromDriver(mapStart,filePath,false);
+   if(prom == NULL) {
+      return(1);   
+   }
+   
+   if(!prom->fileExist()){
+      AERR("Error opening: %s", filePath.c_str());
+      delete prom;
+      return(1);   
+   }   
+   
+   // The card's history, by its slot and build stamp
+   string key = promCalibKey(card,prom->getBuildStamp());
+   promCalibLoad(calibPath, key, history);
+   PromCalibration est = promCalibEstimate(history);
+   if(est.eraseNs == 0 || est.programNs == 0) {
+      AERR("No calibration of this card in %s, promload it once first", 
+           promCalibPath(calibPath).c_str());
+      delete prom;
+      return(1);   
+   }
+   
+   // What the load would do with this image
+   prom->setPromSize(prom->getPromSize(filePath));       
+   if(!prom->planBootProm(&blocks,&buffers,&words)) {
+      delete prom;
+      return(1);   
+   }
+   
+   // The reads are as slow as the round trip now, e.g. in another slot
+   double mmioNs = prom->measureMmioNs();
+   double mmioScale = est.mmioNs > 0 ? mmioNs / est.mmioNs : 1;
+   uint32_t blockWords = prom->getLayout().blockWords;
+   uint32_t partitionWords = prom->getLayout().partitionWords;
+   delete prom;
+   
+   double eraseS   = blocks * est.eraseNs / 1e9;
+   double blankS   = blocks * est.blankNs / 1e9;
+   double programS = buffers * est.programNs / 1e9;
+   double verifyS;
+   const char *verifyHow;
+   
+   if(flags & PROM_LOAD_INLINE_VERIFY) {
+      // Each word read back right after its buffer, then once more for the crc
+      verifyS   = words * 2 * mmioNs / 1e9;
+      verifyHow = "inline and crc, MMIO time";
+   } else if(est.verifyNs > 0) {
+      verifyS   = words * est.verifyNs * mmioScale / 1e9;
+      verifyHow = "calibrated";
+   } else {
+      // A write and a read per word
+      verifyS   = words * 2 * mmioNs / 1e9;
+      verifyHow = "MMIO time";
+   }
+   
+   // With partitions the erases after the first partition go on while writing
+   double eraseWriteS = blankS + eraseS + programS;
+   if(partitionWords != 0) {
+      uint32_t partBlocks = (partitionWords + blockWords - 1) / blockWords;
+      double firstS = (partBlocks < blocks ? partBlocks : blocks) * est.eraseNs / 1e9;
+      double overlapS = blankS + firstS + max(programS, eraseS - firstS);
+      if(overlapS < eraseWriteS) {
+         eraseWriteS = overlapS;
+      }
+   }
+   
+   printf("Plan of %s for %s\n", filePath.c_str(), key.c_str());
+   printf("  calibration: %u loads, the latest on %s", (unsigned)history.size(), 
+          ctime(&est.time));
+   printf("  blank check: %7u blocks  x %9.3f ms = %8.1f s\n", blocks, est.blankNs / 1e6, blankS);
+   printf("  erase:       %7u blocks  x %9.3f ms = %8.1f s (at most, blank blocks are skipped)\n", 
+          blocks, est.eraseNs / 1e6, eraseS);
+   printf("  program:     %7u buffers x %9.3f ms = %8.1f s\n", buffers, est.programNs / 1e6, programS);
+   printf("  verify:      %7u words   x %9.3f us = %8.1f s (%s)\n", words, 
+          verifyS * 1e6 / (words ? words : 1), verifyS, verifyHow);
+   if(partitionWords != 0) {
+      printf("  erase while writing, partitions of %u words: at most %.1f s for erase and program\n", 
+             partitionWords, eraseWriteS);
+   }
+   printf("  total:       at most %.1f s (MMIO read %.1f ns, calibrated %.1f ns)\n", 
+          eraseWriteS + verifyS, mmioNs, est.mmioNs);
+   
+   if(promCalibSlower(history, &slower)) {
+      printf("  the flash of this card is getting slower: %s\n", slower.c_str());
+   }
+   
+   return(0);
+}
@@ -10,6 +10,28 @@
 #ifndef __PROM_LOAD_H__
 #define __PROM_LOAD_H__
 
+#include <string>
+
+#include "EvrCardG2Prom.h"
+
 using namespace std;
-int PromLoad (void *mapStart, string filePath);
+
+// PromLoad() flags
+#define PROM_LOAD_PRELOAD  0x1 // read the .mcs file into memory before starting
+#define PROM_LOAD_JITTER   0x2 // report the gaps between the flash bus operations
+#define PROM_LOAD_INLINE_VERIFY 0x4 // verify each buffer as it is written, no verify pass
+#define PROM_LOAD_POSTED_BUFFER 0x8 // load the write buffer without reading back each cycle
+
+// The read-while-write partitions of the flash are those of the card's PromLayout
+// calibPath: the calibration database the timings are added to ("" for the default)
+// card: the card in the database, see promCalibCard()
+int PromLoad (void *mapStart, string filePath, 
+              PromProgressFunc progress = NULL, void *progressArg = NULL, int flags = 0,
+              const string &calibPath = "", const string &card = "");
+
+// Print how long PromLoad() with these arguments would take on this card
+// at most (every block erased), from its calibration; the PROM is not 
+// touched, nor is the flash configured
+int PromPlan (void *mapStart, string filePath, int flags = 0,
+              const string &calibPath = "", const string &card = "");
 #endif 
@@ -0,0 +1,58 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#include "utils.h"
+#include "EvrCardProm.h"
+#include "PromRegistry.h"
+
+namespace {
+
+template <class Gen>
+EvrCardG2Prom *createDriver(void volatile *mapStart, const std::string &pathToFile, 
+						   bool configure)
+{
+	return new EvrCardProm<Gen>(mapStart, pathToFile, configure);
+}
+
+// one line per card generation
+const PromDriver drivers[] = {
+	{ promLayout<PromGen2>, createDriver<PromGen2> },
+};
+
+} // unnamed namespace
+
+
+
+const PromDriver *findPromDriver(uint32_t fwVersion)
+{
+	for(size_t i = 0; i < sizeof(drivers) / sizeof(drivers[0]); i ++) {
+		if(drivers[i].layout().id == fwVersion >> 12) {
+			return &drivers[i];
+		}
+	}
+	
+	return NULL;
+}
+
+EvrCardG2Prom *createPromDriver(void volatile *mapStart, const std::string &pathToFile, 
+								bool configure)
+{
+	uint32_t fwVersion = *(volatile uint32_t *)((volatile uint8_t *)mapStart + 
+												PROM_FW_VERSION_REG);
+	
+	const PromDriver *driver = findPromDriver(fwVersion);
+	if(driver == NULL) {
+		AERR("No PROM driver for the firmware version 0x%x", fwVersion);
+		return NULL;
+	}
+	
+	ADBG("PROM driver %s for the firmware version 0x%x", driver->layout().name, fwVersion);
+	
+	return driver->create(mapStart, pathToFile, configure);
+}
@@ -0,0 +1,41 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#ifndef __PROM_REGISTRY_H__
+#define __PROM_REGISTRY_H__
+
+#include <stdint.h>
+
+#include <string>
+
+#include "PromGeneration.h"
+
+class EvrCardG2Prom;
+
+// where every generation has its firmware version
+#define PROM_FW_VERSION_REG 0x10000
+
+typedef EvrCardG2Prom *(*PromDriverFactory)(void volatile *mapStart, 
+											 const std::string &pathToFile, 
+											 bool configure);
+
+struct PromDriver {
+	PromLayout (*layout)(void);
+	PromDriverFactory create;
+};
+
+// the driver of the card generation of 'fwVersion', NULL if none
+const PromDriver *findPromDriver(uint32_t fwVersion);
+
+// the driver for the card at 'mapStart' (BAR0), NULL if none; with 
+// configure=false nothing is written to the flash (for a plan)
+EvrCardG2Prom *createPromDriver(void volatile *mapStart, const std::string &pathToFile, 
+								bool configure = true);
+
+#endif // __PROM_REGISTRY_H__
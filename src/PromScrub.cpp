@@ -0,0 +1,388 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+#include <fstream>
+
+#include "utils.h"
+#include "LatencyStats.h"
+#include "Crc32.h"
+#include "McsRead.h"
+#include "EvrCardG2Prom.h"
+#include "PromRegistry.h"
+#include "PromScrub.h"
+
+#define PROM_SCRUB_STATE_HEADER "# evrManager promscrub state"
+
+namespace {
+
+struct ScrubState {
+	
+	// the reference image, as it was when its CRCs were taken
+	std::string reference;
+	long long size;
+	long long mtime;
+	uint32_t words;
+	uint32_t blockWords;
+	uint32_t crc;                     // of all its words
+	std::vector<uint32_t> blockCrcs;
+	
+	// the pass in progress
+	uint32_t pass;
+	uint32_t cursor;                  // the next block
+	uint32_t passCrc;                 // of the PROM words before the cursor
+	std::vector<uint32_t> bad;        // the blocks that differed
+	
+	ScrubState(void)
+		: size(0), mtime(0), words(0), blockWords(0), crc(0)
+		, pass(0), cursor(0), passCrc(0)
+	{
+	}
+	
+	bool load(const std::string &path);
+	bool save(const std::string &path) const;
+};
+
+bool ScrubState::load(const std::string &path)
+{
+	std::ifstream in(path.c_str());
+	std::string line;
+	
+	if(!std::getline(in, line) || line != PROM_SCRUB_STATE_HEADER) {
+		return false;
+	}
+	
+	while(std::getline(in, line)) {
+		
+		unsigned index, value;
+		int pathAt = -1;
+		
+		if(sscanf(line.c_str(), "reference size=%lld mtime=%lld words=%u block_words=%u "
+				  "crc=0x%x path=%n", &size, &mtime, &words, &blockWords, &crc, &pathAt) == 5
+		   && pathAt > 0) {
+			reference = line.substr(pathAt);
+		} else if(sscanf(line.c_str(), "pass=%u cursor=%u crc=0x%x", 
+						 &pass, &cursor, &passCrc) == 3) {
+		} else if(sscanf(line.c_str(), "block %u 0x%x", &index, &value) == 2 
+				  && index == blockCrcs.size()) {
+			blockCrcs.push_back(value);
+		} else if(sscanf(line.c_str(), "bad %u", &index) == 1) {
+			bad.push_back(index);
+		} else {
+			AERR("Invalid promscrub state line: %s", line.c_str());
+			return false;
+		}
+	}
+	
+	// a block CRC for every block of the reference and the cursor on one
+	return blockWords != 0 && words != 0 
+		&& blockCrcs.size() == (words + blockWords - 1) / blockWords 
+		&& cursor < blockCrcs.size();
+}
+
+// Written aside and renamed, a crash leaves the old state or the new one.
+// The file aside is a fresh one from mkstemp(), not a name someone else 
+// could have put a symlink on.
+bool ScrubState::save(const std::string &path) const
+{
+	std::string tmpl = path + ".XXXXXX";
+	std::vector<char> tmp(tmpl.begin(), tmpl.end());
+	tmp.push_back('\0');
+	
+	int fd = mkstemp(&tmp[0]);
+	if(fd < 0) {
+		AERR("Can't write the promscrub state '%s', errno=%d", path.c_str(), errno);
+		return false;
+	}
+	fchmod(fd, 0644);
+	
+	FILE *f = fdopen(fd, "w");
+	if(f == NULL) {
+		AERR("Can't write the promscrub state '%s', errno=%d", &tmp[0], errno);
+		close(fd);
+		unlink(&tmp[0]);
+		return false;
+	}
+	
+	fprintf(f, "%s\n", PROM_SCRUB_STATE_HEADER);
+	fprintf(f, "reference size=%lld mtime=%lld words=%u block_words=%u crc=0x%08x path=%s\n", 
+			size, mtime, words, blockWords, crc, reference.c_str());
+	fprintf(f, "pass=%u cursor=%u crc=0x%08x\n", pass, cursor, passCrc);
+	for(size_t i = 0; i < blockCrcs.size(); i ++) {
+		fprintf(f, "block %u 0x%08x\n", (unsigned)i, blockCrcs[i]);
+	}
+	for(size_t i = 0; i < bad.size(); i ++) {
+		fprintf(f, "bad %u\n", bad[i]);
+	}
+	
+	bool ok = !ferror(f);
+	ok = fclose(f) == 0 && ok;
+	
+	if(!ok || rename(&tmp[0], path.c_str()) < 0) {
+		AERR("Can't write the promscrub state '%s', errno=%d", path.c_str(), errno);
+		unlink(&tmp[0]);
+		return false;
+	}
+	
+	return true;
+}
+
+// the words verifyBootProm() compares, from address 0 on
+bool readReference(const std::string &path, std::vector<uint16_t> &words)
+{
+	McsRead reader;
+	McsReadData mem;
+	uint16_t word = 0;
+	bool toggle = false;
+	
+	if(!reader.open(path)) {
+		reader.close();
+		AERR("Error opening: %s", path.c_str());
+		return false;
+	}
+	
+	mem.endOfFile = false;
+	while(!mem.endOfFile) {
+		
+		if(reader.read(&mem) < 0) {
+			AERR("Invalid .mcs file: %s", path.c_str());
+			reader.close();
+			return false;
+		}
+		
+		if(!toggle) {
+			word = (uint16_t)mem.data;
+		} else {
+			word |= (uint16_t)mem.data << 8;
+			words.push_back(word);
+		}
+		toggle = !toggle;
+	}
+	
+	reader.close();
+	
+	return !words.empty();
+}
+
+// the reference CRCs, reused from 'state' if the image didn't change
+bool referenceCrcs(const PromScrubConfig &config, uint32_t blockWords, ScrubState &state)
+{
+	struct stat st;
+	
+	if(stat(config.referencePath.c_str(), &st) < 0) {
+		AERR("Can't access the reference image '%s', errno=%d", 
+			 config.referencePath.c_str(), errno);
+		return false;
+	}
+	
+	if(state.reference == config.referencePath && state.size == (long long)st.st_size 
+	   && state.mtime == (long long)st.st_mtime && state.blockWords == blockWords) {
+		return true;
+	}
+	
+	std::vector<uint16_t> words;
+	if(!readReference(config.referencePath, words)) {
+		return false;
+	}
+	
+	// a new reference starts a new pass
+	state = ScrubState();
+	state.reference = config.referencePath;
+	state.size = st.st_size;
+	state.mtime = st.st_mtime;
+	state.words = words.size();
+	state.blockWords = blockWords;
+	state.crc = crc32Update(0, &words[0], words.size() * sizeof(words[0]));
+	
+	for(uint32_t base = 0; base < state.words; base += blockWords) {
+		uint32_t n = state.words - base < blockWords ? state.words - base : blockWords;
+		state.blockCrcs.push_back(crc32Update(0, &words[base], n * sizeof(words[0])));
+	}
+	
+	AINFO("Reference %s: %u words in %u blocks, crc 0x%08x", state.reference.c_str(), 
+		  state.words, (unsigned)state.blockCrcs.size(), state.crc);
+	
+	return true;
+}
+
+void sleepNs(void *, int64_t ns)
+{
+	struct timespec ts = { (time_t)(ns / 1000000000LL), (long)(ns % 1000000000LL) };
+	while(nanosleep(&ts, &ts) < 0 && errno == EINTR) {
+	}
+}
+
+} // unnamed namespace
+
+
+
+std::string promScrubStatePath(const std::string &mngDevNodeName)
+{
+	std::string base = mngDevNodeName.substr(mngDevNodeName.rfind('/') + 1);
+	
+	return "/var/lib/evrManager." + base + ".scrub";
+}
+
+int PromScrub (void *mapStart, const PromScrubConfig &config, 
+			   PromScrubPauseFunc pause, void *pauseArg)
+{
+	if(mapStart == MAP_FAILED) {
+		AERR("mmap() = %p", mapStart);
+		return 1;
+	}
+	
+	if(config.rateWords == 0) {
+		AERR("Invalid scrub rate 0");
+		return 1;
+	}
+	
+	if(pause == NULL) {
+		pause = sleepNs;
+	}
+	
+	// found out now rather than after a pass
+	std::string::size_type slash = config.statePath.rfind('/');
+	std::string stateDir = slash == std::string::npos ? "." 
+						 : config.statePath.substr(0, slash + 1);
+	if(access(stateDir.c_str(), W_OK) != 0) {
+		AERR("Can't write the promscrub state in '%s', errno=%d, give a <state_file> "
+			 "in a directory writable only by you", stateDir.c_str(), errno);
+		return 1;
+	}
+	
+	// Only reads: each word is read with the read array command, so the 
+	// configuration register is left as the last promload (or the 
+	// power-up) set it, not written on a card that is in use
+	EvrCardG2Prom *prom = createPromDriver(mapStart, config.referencePath, false);
+	if(prom == NULL) {
+		return 1;
+	}
+	
+	const PromLayout &layout = prom->getLayout();
+	ScrubState state;
+	
+	if(!state.load(config.statePath)) {
+		state = ScrubState();
+	}
+	if(!referenceCrcs(config, layout.blockWords, state)) {
+		delete prom;
+		return 1;
+	}
+	
+	std::vector<uint16_t> buf(layout.bufferWords);
+	int64_t slotNs = (int64_t)layout.bufferWords * 1000000000LL / config.rateWords;
+	int64_t startNs = monotonicNowNs();
+	int64_t nextNs = startNs;
+	int64_t busyNs = 0;
+	uint32_t wordsRead = 0;
+	bool ok = true;
+	
+	for(;;) {
+		
+		uint32_t base = state.cursor * state.blockWords;
+		uint32_t end = base + state.blockWords < state.words ? base + state.blockWords : state.words;
+		uint32_t blockCrc = 0;
+		
+		for(uint32_t addr = base; addr < end; addr += layout.bufferWords) {
+			
+			uint32_t n = end - addr < layout.bufferWords ? end - addr : layout.bufferWords;
+			
+			// The card is left to the others only between the blocks, a 
+			// promload in the middle of one would make it half old, half 
+			// new and report it as differing. Within a block the reads are 
+			// paced holding the card.
+			// No catching up after the card was busy (e.g. a promload).
+			int64_t now = monotonicNowNs();
+			int64_t waitNs = nextNs > now ? nextNs - now : 0;
+			if(addr == base) {
+				pause(pauseArg, waitNs);
+				now = monotonicNowNs();
+			} else if(waitNs > 0) {
+				sleepNs(NULL, waitNs);
+			}
+			if(now - nextNs > slotNs) {
+				nextNs = now;
+			}
+			nextNs += slotNs;
+			
+			int64_t t0 = monotonicNowNs();
+			prom->readPromWords(addr, &buf[0], n);
+			busyNs += monotonicNowNs() - t0;
+			
+			blockCrc = crc32Update(blockCrc, &buf[0], n * sizeof(buf[0]));
+			state.passCrc = crc32Update(state.passCrc, &buf[0], n * sizeof(buf[0]));
+			wordsRead += n;
+		}
+		
+		if(blockCrc != state.blockCrcs[state.cursor]) {
+			AERR("PROM block %u (0x%x-0x%x) differs from %s: crc 0x%08x, expected 0x%08x", 
+				 state.cursor, base, end - 1, state.reference.c_str(), 
+				 blockCrc, state.blockCrcs[state.cursor]);
+			state.bad.push_back(state.cursor);
+			ok = false;
+		}
+		
+		state.cursor ++;
+		
+		if(state.cursor == state.blockCrcs.size()) {
+			
+			bool match = state.passCrc == state.crc && state.bad.empty();
+			
+			printf("PROM scrub pass %u: %s, PROM crc 0x%08x, reference crc 0x%08x (%s)", 
+				   state.pass, match ? "OK" : "DIFFERS", state.passCrc, state.crc, 
+				   state.reference.c_str());
+			if(!state.bad.empty()) {
+				printf(", %u block(s) differ", (unsigned)state.bad.size());
+			}
+			printf("\n");
+			
+			ok = ok && match;
+			
+			state.pass ++;
+			state.cursor = 0;
+			state.passCrc = 0;
+			state.bad.clear();
+		}
+		
+		if(!state.save(config.statePath)) {
+			ok = false;
+			break;
+		}
+		
+		// a whole pass, or whatever fits in the time
+		if(config.timeLimitS > 0 
+		   ? monotonicNowNs() - startNs >= config.timeLimitS * 1000000000LL 
+		   : state.cursor == 0) {
+			break;
+		}
+	}
+	
+	double elapsedS = (monotonicNowNs() - startNs) / 1e9;
+	
+	AINFO("Scrubbed %u words in %.1f s, flash bus busy %.1f%% of the time, "
+		  "pass %u next at block %u of %u", wordsRead, elapsedS, 
+		  elapsedS > 0 ? busyNs / 1e7 / elapsedS : 0, 
+		  state.pass, state.cursor, (unsigned)state.blockCrcs.size());
+	
+	delete prom;
+	
+	// also what the earlier invocations found in this pass
+	return ok && state.bad.empty() ? 0 : 1;
+}
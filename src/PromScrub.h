@@ -0,0 +1,60 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#ifndef __PROM_SCRUB_H__
+#define __PROM_SCRUB_H__
+
+#include <stdint.h>
+
+#include <string>
+
+// words read back per second by default: a pass over a 3 MB image takes
+// about 90 s and keeps the flash bus busy a few % of the time
+#define PROM_SCRUB_RATE_DEFAULT 16384
+
+// sleeps 'ns' with the card left to the others (see CardLock::unlock())
+typedef void (*PromScrubPauseFunc)(void *arg, int64_t ns);
+
+struct PromScrubConfig {
+	
+	std::string referencePath; // the .mcs image the PROM should hold
+	std::string statePath;     // see promScrubStatePath()
+	uint32_t rateWords;        // words read per second
+	int timeLimitS;            // stop after, 0 at the end of the pass
+	
+	PromScrubConfig(void)
+		: rateWords(PROM_SCRUB_RATE_DEFAULT)
+		, timeLimitS(0)
+	{
+	}
+};
+
+// /var/lib/evrManager.<evrXmng>.scrub
+std::string promScrubStatePath(const std::string &mngDevNodeName);
+
+/*
+ * Reads the PROM back a little at a time, at most 'rateWords' words
+ * per second, and compares each block with the reference image by its
+ * CRC-32, so that a flipped bit or a foreign image is found before a
+ * power cycle loads it. Before each block 'pause' (if not NULL) lets
+ * the other commands use the card, within a block the card is kept so
+ * it can't change under the block CRC.
+ * 
+ * The state file keeps the position in the current pass, the CRC of
+ * the words read so far and the CRCs of the reference blocks, so the
+ * next invocation goes on where the last one stopped. At the end of a
+ * pass the CRC of the whole PROM image is compared with the reference
+ * one and the next pass starts from the beginning.
+ * 
+ * Returns 0 if nothing differed so far, 1 on an error or a difference.
+ */
+int PromScrub (void *mapStart, const PromScrubConfig &config, 
+			   PromScrubPauseFunc pause = NULL, void *pauseArg = NULL);
+
+#endif // __PROM_SCRUB_H__
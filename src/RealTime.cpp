@@ -0,0 +1,94 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+#include "utils.h"
+#include "RealTime.h"
+
+// touched once so that the stack pages are there before the timed loops
+#define RT_STACK_PREFAULT_BYTES (256 * 1024)
+
+namespace {
+
+void prefaultStack(void)
+{
+	volatile char stack[RT_STACK_PREFAULT_BYTES];
+	
+	for(size_t i = 0; i < sizeof(stack); i += 4096) {
+		stack[i] = 0;
+	}
+}
+
+} // unnamed namespace
+
+RealTimeScope::RealTimeScope(int cpu, int priority)
+	: cpu(cpu)
+	, savedPolicy(SCHED_OTHER)
+	, affinitySet(false)
+	, schedulerSet(false)
+	, memoryLocked(false)
+{
+	if(this->cpu < 0) {
+		this->cpu = sched_getcpu();
+	}
+	
+	if(sched_getaffinity(0, sizeof(savedAffinity), &savedAffinity) == 0) {
+		
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(this->cpu, &set);
+		
+		affinitySet = sched_setaffinity(0, sizeof(set), &set) == 0;
+	}
+	if(!affinitySet) {
+		AERR("Can't pin to CPU %d, errno=%d", this->cpu, errno);
+	}
+	
+	savedPolicy = sched_getscheduler(0);
+	sched_getparam(0, &savedParam);
+	
+	struct sched_param param;
+	memset(&param, 0, sizeof(param));
+	param.sched_priority = priority;
+	
+	schedulerSet = savedPolicy >= 0 && sched_setscheduler(0, SCHED_FIFO, &param) == 0;
+	if(!schedulerSet) {
+		AERR("Can't set SCHED_FIFO priority %d, errno=%d", priority, errno);
+	}
+	
+	memoryLocked = mlockall(MCL_CURRENT | MCL_FUTURE) == 0;
+	if(!memoryLocked) {
+		AERR("Can't lock the memory, errno=%d", errno);
+	}
+	
+	prefaultStack();
+	
+	AINFO("Real time: CPU %d%s, SCHED_FIFO %d%s, memory %slocked", this->cpu, 
+		  affinitySet ? "" : " (failed)", priority, schedulerSet ? "" : " (failed)", 
+		  memoryLocked ? "" : "not ");
+}
+
+RealTimeScope::~RealTimeScope()
+{
+	if(memoryLocked) {
+		munlockall();
+	}
+	
+	if(schedulerSet) {
+		sched_setscheduler(0, savedPolicy, &savedParam);
+	}
+	
+	if(affinitySet) {
+		sched_setaffinity(0, sizeof(savedAffinity), &savedAffinity);
+	}
+}
@@ -0,0 +1,52 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#ifndef __REAL_TIME_H__
+#define __REAL_TIME_H__
+
+#include <sched.h>
+
+// SCHED_FIFO priority of '--rt' if not given
+#define RT_PRIORITY_DEFAULT 50
+
+/*
+ * Runs the calling thread deterministically for the lifetime of the
+ * object: pinned to one CPU, at a SCHED_FIFO priority and with all the
+ * memory locked (and the stack pre-faulted), so the MMIO loops are not
+ * preempted by the other processes nor stalled by page faults. The
+ * previous affinity, scheduling and locking are restored at the end.
+ * Whatever can't be set (usually for the lack of privileges) is
+ * reported and skipped.
+ */
+class RealTimeScope {
+public:
+	
+	// 'cpu' < 0 for the CPU the thread runs on now
+	RealTimeScope(int cpu, int priority);
+	~RealTimeScope();
+	
+	int getCpu(void) const { return cpu; }
+
+private:
+	
+	int cpu;
+	
+	cpu_set_t savedAffinity;
+	int savedPolicy;
+	struct sched_param savedParam;
+	
+	bool affinitySet;
+	bool schedulerSet;
+	bool memoryLocked;
+	
+	RealTimeScope(const RealTimeScope &);
+	RealTimeScope &operator=(const RealTimeScope &);
+};
+
+#endif // __REAL_TIME_H__
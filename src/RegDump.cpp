@@ -0,0 +1,387 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#include <time.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include <string>
+#include <vector>
+
+#include "utils.h"
+#include "linux-evr-regs.h"
+#include "EvrManager.h"
+#include "RegDump.h"
+
+#define REG_SNAP_MAGIC    0x45565253 // 'EVRS'
+#define REG_SNAP_VERSION  1
+
+#define REG_NAME_LEN      40
+
+namespace {
+
+struct RegDesc {
+	const char *name;
+	int offset;
+	bool counter;   // free running, show the deltas
+};
+
+#define REG_DESC(REG, COUNTER) { #REG, REG, COUNTER }
+
+/*
+ * The registers that are safe to read (no read side effects, so
+ * e.g. the event FIFO registers are not here), in the order they
+ * are read. Those not defined by the evrma headers in use are skipped.
+ */
+const RegDesc regDescs[] = {
+#ifdef EVR_REG_STATUS
+	REG_DESC(EVR_REG_STATUS, false),
+#endif
+	REG_DESC(EVR_REG_CTRL, false),
+	REG_DESC(EVR_REG_IRQFLAG, false),
+	REG_DESC(EVR_REG_IRQEN, false),
+#ifdef EVR_REG_PULSE_IRQ_MAP
+	REG_DESC(EVR_REG_PULSE_IRQ_MAP, false),
+#endif
+	REG_DESC(EVR_REG_DATA_BUF_CTRL, false),
+#ifdef EVR_REG_TX_BUF_CTRL
+	REG_DESC(EVR_REG_TX_BUF_CTRL, false),
+#endif
+	REG_DESC(EVR_REG_FW_VERSION, false),
+	REG_DESC(EVR_REG_EV_CNT_PRESC, false),
+#ifdef EVR_REG_USEC_DIVIDER
+	REG_DESC(EVR_REG_USEC_DIVIDER, false),
+#endif
+#ifdef EVR_REG_CLOCK_CTRL
+	REG_DESC(EVR_REG_CLOCK_CTRL, false),
+#endif
+#ifdef EVR_REG_SECONDS_SHIFT
+	REG_DESC(EVR_REG_SECONDS_SHIFT, false),
+#endif
+#ifdef EVR_REG_SECONDS_COUNTER
+	REG_DESC(EVR_REG_SECONDS_COUNTER, true),
+#endif
+#ifdef EVR_REG_TS_EVENT_COUNTER
+	REG_DESC(EVR_REG_TS_EVENT_COUNTER, true),
+#endif
+#ifdef EVR_REG_SECONDS_LATCH
+	REG_DESC(EVR_REG_SECONDS_LATCH, false),
+#endif
+#ifdef EVR_REG_TS_LATCH
+	REG_DESC(EVR_REG_TS_LATCH, false),
+#endif
+	REG_DESC(EVR_REG_FRAC_DIV, false),
+#ifdef EVR_REG_RX_INIT_PS
+	REG_DESC(EVR_REG_RX_INIT_PS, false),
+#endif
+	REG_DESC(EVR_REG_FW_VERSION_SLAC, false),
+	REG_DESC(AXIXADC_REG_TEMPERATURE, false),
+	REG_DESC(AXIXADC_REG_MAXTEMPERATURE, false),
+};
+
+const int regDescCount = sizeof(regDescs) / sizeof(regDescs[0]);
+
+struct RegSnapHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t count;
+	uint32_t reserved;
+	uint64_t timestampNs;   // CLOCK_REALTIME
+};
+
+struct RegSnapEntry {
+	char name[REG_NAME_LEN];
+	uint32_t offset;
+	uint32_t value;
+};
+
+uint64_t realtimeNs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+const RegDesc *findRegDesc(const std::string &name)
+{
+	for(int i = 0; i < regDescCount; i ++) {
+		if(name == regDescs[i].name) {
+			return &regDescs[i];
+		}
+	}
+	return NULL;
+}
+
+// The selected registers in the table order; false on an unknown name.
+bool selectRegs(EvrManager &manager, const std::string &regList, 
+				std::vector<const RegDesc *> &regs)
+{
+	regs.clear();
+	
+	std::vector<bool> wanted(regDescCount, regList.empty());
+	size_t pos = 0;
+	
+	while(pos < regList.size()) {
+		size_t comma = regList.find(',', pos);
+		if(comma == std::string::npos) {
+			comma = regList.size();
+		}
+		
+		std::string name = regList.substr(pos, comma - pos);
+		const RegDesc *desc = findRegDesc(name);
+		
+		if(desc == NULL) {
+			AERR("Unknown register: '%s'", name.c_str());
+			return false;
+		}
+		wanted[desc - regDescs] = true;
+		
+		pos = comma + 1;
+	}
+	
+	for(int i = 0; i < regDescCount; i ++) {
+		if(!wanted[i]) {
+			continue;
+		}
+		if(regDescs[i].offset + 4 > manager.getIoLength()) {
+			AINFO("%s (0x%05X) is outside the IO region, skipped", 
+				  regDescs[i].name, regDescs[i].offset);
+			continue;
+		}
+		regs.push_back(&regDescs[i]);
+	}
+	
+	return true;
+}
+
+// One ordered pass, exactly one read per register, nothing else in between.
+void readRegs(EvrManager &manager, const std::vector<const RegDesc *> &regs, 
+			  std::vector<uint32_t> &values)
+{
+	values.resize(regs.size());
+	
+	for(size_t i = 0; i < regs.size(); i ++) {
+		values[i] = manager.readReg(regs[i]->offset);
+	}
+}
+
+bool loadSnapshot(const std::string &filePath, RegSnapHeader *header, 
+				  std::vector<RegSnapEntry> &entries)
+{
+	FILE *f = fopen(filePath.c_str(), "rb");
+	if(f == NULL) {
+		AERR("Can't open '%s', errno=%d", filePath.c_str(), errno);
+		return false;
+	}
+	
+	bool ok = fread(header, sizeof(*header), 1, f) == 1
+			&& header->magic == REG_SNAP_MAGIC
+			&& header->version == REG_SNAP_VERSION;
+	
+	if(ok) {
+		entries.resize(header->count);
+		ok = header->count == 0 
+			|| fread(&entries[0], sizeof(RegSnapEntry), header->count, f) == header->count;
+	}
+	
+	fclose(f);
+	
+	if(!ok) {
+		AERR("'%s' is not a valid register snapshot", filePath.c_str());
+	}
+	
+	return ok;
+}
+
+} // unnamed namespace
+
+
+
+bool regDump(EvrManager &manager, const std::string &filePath, 
+			 const std::string &regList)
+{
+	std::vector<const RegDesc *> regs;
+	std::vector<uint32_t> values;
+	
+	if(!selectRegs(manager, regList, regs)) {
+		return false;
+	}
+	
+	uint64_t timestampNs = realtimeNs();
+	readRegs(manager, regs, values);
+	
+	for(size_t i = 0; i < regs.size(); i ++) {
+		printf("%-28s 0x%05X: 0x%08X\n", regs[i]->name, regs[i]->offset, values[i]);
+	}
+	
+	if(filePath == "-") {
+		return true;
+	}
+	
+	RegSnapHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = REG_SNAP_MAGIC;
+	header.version = REG_SNAP_VERSION;
+	header.count = regs.size();
+	header.timestampNs = timestampNs;
+	
+	std::vector<RegSnapEntry> entries(regs.size());
+	for(size_t i = 0; i < regs.size(); i ++) {
+		memset(&entries[i], 0, sizeof(entries[i]));
+		strncpy(entries[i].name, regs[i]->name, REG_NAME_LEN - 1);
+		entries[i].offset = regs[i]->offset;
+		entries[i].value = values[i];
+	}
+	
+	FILE *f = fopen(filePath.c_str(), "wb");
+	if(f == NULL) {
+		AERR("Can't create '%s', errno=%d", filePath.c_str(), errno);
+		return false;
+	}
+	
+	bool ok = fwrite(&header, sizeof(header), 1, f) == 1
+			&& (entries.empty() 
+				|| fwrite(&entries[0], sizeof(RegSnapEntry), entries.size(), f) == entries.size());
+	
+	if(fclose(f) != 0 || !ok) {
+		AERR("Writing '%s' failed", filePath.c_str());
+		return false;
+	}
+	
+	return true;
+}
+
+int regDiff(EvrManager *manager, const std::string &oldPath, 
+			const std::string &newPath)
+{
+	RegSnapHeader oldHeader, newHeader;
+	std::vector<RegSnapEntry> oldEntries, newEntries;
+	
+	// from the card: those outside its IO region (e.g. a smaller BAR)
+	std::vector<bool> unreadable;
+	
+	if(!loadSnapshot(oldPath, &oldHeader, oldEntries)) {
+		return REG_DIFF_ERROR;
+	}
+	
+	if(!newPath.empty()) {
+		if(!loadSnapshot(newPath, &newHeader, newEntries)) {
+			return REG_DIFF_ERROR;
+		}
+		unreadable.resize(newEntries.size(), false);
+	} else if(manager == NULL) {
+		AERR("No card to compare '%s' with", oldPath.c_str());
+		return REG_DIFF_ERROR;
+	} else {
+		// the same registers from the card, still in one pass
+		newEntries = oldEntries;
+		newHeader = oldHeader;
+		newHeader.timestampNs = realtimeNs();
+		unreadable.resize(newEntries.size(), false);
+		
+		for(size_t i = 0; i < newEntries.size(); i ++) {
+			if((int)newEntries[i].offset + 4 <= manager->getIoLength()) {
+				newEntries[i].value = manager->readReg(newEntries[i].offset);
+			} else {
+				unreadable[i] = true;
+			}
+		}
+	}
+	
+	printf("%.3f s between the snapshots\n", 
+		   ((int64_t)(newHeader.timestampNs - oldHeader.timestampNs)) / 1e9);
+	
+	int differ = 0;
+	int notReadable = 0;
+	
+	for(size_t i = 0; i < oldEntries.size(); i ++) {
+		
+		const RegSnapEntry &o = oldEntries[i];
+		const RegSnapEntry *n = NULL;
+		size_t j = 0;
+		
+		for(; j < newEntries.size(); j ++) {
+			if(newEntries[j].offset == o.offset) {
+				n = &newEntries[j];
+				break;
+			}
+		}
+		
+		if(n == NULL) {
+			printf("%-28s 0x%05X: 0x%08X -> (missing)\n", o.name, o.offset, o.value);
+			differ ++;
+		} else if(unreadable[j]) {
+			printf("%-28s 0x%05X: 0x%08X -> (not readable)\n", o.name, o.offset, o.value);
+			notReadable ++;
+		} else if(n->value != o.value) {
+			printf("%-28s 0x%05X: 0x%08X -> 0x%08X (changed bits 0x%08X)\n", 
+				   o.name, o.offset, o.value, n->value, o.value ^ n->value);
+			differ ++;
+		}
+	}
+	
+	printf("%d of %d register(s) differ", differ, (int)oldEntries.size());
+	if(notReadable != 0) {
+		printf(", %d not readable", notReadable);
+	}
+	printf("\n");
+	
+	return differ != 0 || notReadable != 0 ? REG_DIFF_DIFFER : REG_DIFF_SAME;
+}
+
+bool regWatch(EvrManager &manager, int intervalMs, int count, 
+			  const std::string &regList)
+{
+	std::vector<const RegDesc *> regs;
+	std::vector<uint32_t> prev, values;
+	
+	if(intervalMs <= 0 || count <= 0) {
+		AERR("Invalid interval %d ms or count %d", intervalMs, count);
+		return false;
+	}
+	
+	if(!selectRegs(manager, regList, regs)) {
+		return false;
+	}
+	
+	readRegs(manager, regs, prev);
+	
+	struct timespec next;
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	
+	for(int n = 1; n <= count; n ++) {
+		
+		next.tv_nsec += (long)(intervalMs % 1000) * 1000000L;
+		next.tv_sec += intervalMs / 1000 + next.tv_nsec / 1000000000L;
+		next.tv_nsec %= 1000000000L;
+		
+		while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR) {
+		}
+		
+		readRegs(manager, regs, values);
+		
+		printf("--- interval %d (%d ms)\n", n, intervalMs);
+		
+		for(size_t i = 0; i < regs.size(); i ++) {
+			if(regs[i]->counter) {
+				// unsigned arithmetic handles the wrap around
+				uint32_t delta = values[i] - prev[i];
+				printf("%-28s +%u (%.1f/s)\n", regs[i]->name, delta, 
+					   delta * 1000.0 / intervalMs);
+			} else if(values[i] != prev[i]) {
+				printf("%-28s 0x%08X -> 0x%08X\n", regs[i]->name, prev[i], values[i]);
+			}
+		}
+		
+		prev.swap(values);
+	}
+	
+	return true;
+}
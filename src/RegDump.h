@@ -0,0 +1,42 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#ifndef __REG_DUMP_H__
+#define __REG_DUMP_H__
+
+#include <string>
+
+#include "EvrManager.h"
+
+/*
+ * Register snapshots of the mapped BAR.
+ * 
+ * 'regList' is a comma separated list of register names as in
+ * linux-evr-regs.h (e.g. "EVR_REG_CTRL,EVR_REG_IRQFLAG"); empty
+ * means all the known registers. 'filePath' "-" only prints.
+ */
+bool regDump(EvrManager &manager, const std::string &filePath, 
+			 const std::string &regList);
+
+// regDiff() results, the exit codes of diff(1)
+#define REG_DIFF_SAME    0
+#define REG_DIFF_DIFFER  1 // or some registers not readable from the card
+#define REG_DIFF_ERROR   2
+
+// Compares two snapshots ('manager' may be NULL) or, with an empty
+// 'newPath', a snapshot with the card.
+int regDiff(EvrManager *manager, const std::string &oldPath, 
+			const std::string &newPath);
+
+// Reads the registers 'count' times, 'intervalMs' apart, printing the
+// per-interval deltas of the counters and any change of the others.
+bool regWatch(EvrManager &manager, int intervalMs, int count, 
+			  const std::string &regList);
+
+#endif // __REG_DUMP_H__
@@ -0,0 +1,244 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#include <sys/syscall.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <vector>
+
+#include "utils.h"
+#include "Trace.h"
+
+// events each thread buffer reserves at first, it grows as needed
+#define TRACE_BUFFER_EVENTS 4096
+
+volatile bool traceOn = false;
+
+namespace {
+
+struct TraceEvent {
+	const char *name;
+	std::string arg;
+	int64_t startNs;
+	int64_t endNs;
+};
+
+struct TraceBuffer {
+	long tid;
+	std::string threadName;
+	std::vector<TraceEvent> events;
+};
+
+__thread TraceBuffer *threadBuffer = NULL;
+
+// all the buffers, kept after their threads exit
+pthread_mutex_t buffersLock = PTHREAD_MUTEX_INITIALIZER;
+std::vector<TraceBuffer *> buffers;
+
+std::string tracePath;
+int64_t traceStartNs;
+
+TraceBuffer *getBuffer(void)
+{
+	if(threadBuffer == NULL) {
+		TraceBuffer *b = new TraceBuffer;
+		b->tid = syscall(SYS_gettid);
+		b->events.reserve(TRACE_BUFFER_EVENTS);
+		
+		pthread_mutex_lock(&buffersLock);
+		buffers.push_back(b);
+		pthread_mutex_unlock(&buffersLock);
+		
+		threadBuffer = b;
+	}
+	
+	return threadBuffer;
+}
+
+// the process start on the monotonic clock, from the boot time clock
+// and /proc/self/stat; 0 if unknown
+int64_t processStartNs(void)
+{
+	FILE *f = fopen("/proc/self/stat", "r");
+	if(f == NULL) {
+		return 0;
+	}
+	
+	char line[1024];
+	bool ok = fgets(line, sizeof(line), f) != NULL;
+	fclose(f);
+	
+	// the fields after the command name, which may contain spaces
+	char *p = ok ? strrchr(line, ')') : NULL;
+	if(p == NULL) {
+		return 0;
+	}
+	
+	// starttime is the field 22, the 20th after ')'
+	unsigned long long ticks = 0;
+	for(int field = 3; field <= 22 && p != NULL; field ++) {
+		p = strchr(p + 1, ' ');
+		if(field == 22 && p != NULL) {
+			ticks = strtoull(p + 1, NULL, 10);
+		}
+	}
+	
+	struct timespec boot;
+	clock_gettime(CLOCK_BOOTTIME, &boot);
+	int64_t bootNs = (int64_t)boot.tv_sec * 1000000000LL + boot.tv_nsec;
+	int64_t startNs = (int64_t)(ticks * (1000000000.0 / sysconf(_SC_CLK_TCK)));
+	
+	return traceNowNs() - (bootNs - startNs);
+}
+
+void writeString(FILE *f, const std::string &s)
+{
+	fputc('"', f);
+	for(size_t i = 0; i < s.size(); i ++) {
+		unsigned char c = s[i];
+		if(c == '"' || c == '\\') {
+			fprintf(f, "\\%c", c);
+		} else if(c < 0x20) {
+			fprintf(f, "\\u%04x", c);
+		} else {
+			fputc(c, f);
+		}
+	}
+	fputc('"', f);
+}
+
+void writeEvent(FILE *f, bool *first, long tid, const TraceEvent &e)
+{
+	fprintf(f, "%s\n{\"name\":", *first ? "" : ",");
+	writeString(f, e.name);
+	fprintf(f, ",\"cat\":\"evr\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%ld",
+			e.startNs / 1e3, (e.endNs - e.startNs) / 1e3, (int)getpid(), tid);
+	if(!e.arg.empty()) {
+		fprintf(f, ",\"args\":{\"arg\":");
+		writeString(f, e.arg);
+		fprintf(f, "}");
+	}
+	fprintf(f, "}");
+	*first = false;
+}
+
+} // unnamed namespace
+
+
+
+int64_t traceNowNs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void traceAdd(const char *name, const std::string &arg, int64_t startNs, int64_t endNs)
+{
+	TraceBuffer *b = getBuffer();
+	
+	b->events.push_back(TraceEvent());
+	TraceEvent &e = b->events.back();
+	e.name = name;
+	e.arg = arg;
+	e.startNs = startNs;
+	e.endNs = endNs;
+}
+
+void traceThreadName(const char *name)
+{
+	if(traceOn) {
+		getBuffer()->threadName = name;
+	}
+}
+
+bool traceStart(const std::string &path)
+{
+	// fail early rather than after the run
+	FILE *f = fopen(path.c_str(), "w");
+	if(f == NULL) {
+		AERR("Can't create the trace file '%s'", path.c_str());
+		return false;
+	}
+	fclose(f);
+	
+	tracePath = path;
+	traceStartNs = traceNowNs();
+	traceOn = true;
+	traceThreadName("main");
+	
+	return true;
+}
+
+bool traceStop(void)
+{
+	if(!traceOn) {
+		return true;
+	}
+	
+	int64_t endNs = traceNowNs();
+	traceOn = false;
+	
+	TraceEvent run;
+	run.name = "run";
+	run.startNs = traceStartNs;
+	run.endNs = endNs;
+	getBuffer()->events.push_back(run);
+	
+	TraceEvent startup;
+	startup.name = "startup";
+	startup.startNs = processStartNs();
+	startup.endNs = traceStartNs;
+	if(startup.startNs > 0 && startup.startNs < traceStartNs) {
+		getBuffer()->events.push_back(startup);
+	}
+	
+	FILE *f = fopen(tracePath.c_str(), "w");
+	if(f == NULL) {
+		AERR("Can't create the trace file '%s'", tracePath.c_str());
+		return false;
+	}
+	
+	size_t events = 0;
+	bool first = true;
+	fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+	
+	pthread_mutex_lock(&buffersLock);
+	for(size_t i = 0; i < buffers.size(); i ++) {
+		TraceBuffer *b = buffers[i];
+		if(!b->threadName.empty()) {
+			fprintf(f, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%ld,"
+					"\"args\":{\"name\":", first ? "" : ",", (int)getpid(), b->tid);
+			writeString(f, b->threadName);
+			fprintf(f, "}}");
+			first = false;
+		}
+		for(size_t j = 0; j < b->events.size(); j ++) {
+			writeEvent(f, &first, b->tid, b->events[j]);
+		}
+		events += b->events.size();
+	}
+	pthread_mutex_unlock(&buffersLock);
+	
+	fprintf(f, "\n]}\n");
+	
+	if(fclose(f) != 0) {
+		AERR("Can't write the trace file '%s'", tracePath.c_str());
+		return false;
+	}
+	
+	AINFO("Trace of %zu events written to %s", events, tracePath.c_str());
+	
+	return true;
+}
@@ -0,0 +1,73 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'evrManager'.
+// It is subject to the license terms in the LICENSE.txt file found in the 
+// top-level directory of this distribution and at: 
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html. 
+// No part of 'evrManager', including this file, 
+// may be copied, modified, propagated, or distributed except according to 
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+#ifndef __EVR_TRACE_H__
+#define __EVR_TRACE_H__
+
+#include <stdint.h>
+
+#include <string>
+
+/*
+ * The timeline of an evrManager run ('--trace=<file>') in the Chrome
+ * trace event format, to be opened in chrome://tracing or Perfetto.
+ * 
+ * A TraceSpan records the time from its construction to its destruction
+ * as a complete ("X") event. Each thread appends to its own buffer, with
+ * no lock, and only when tracing is on; otherwise a span costs one load
+ * of a flag. The buffers are written by traceStop(), which is to be
+ * called once the threads that traced are done.
+ */
+
+extern volatile bool traceOn;
+
+// records from now on, until traceStop() writes 'path'; false if it can't
+bool traceStart(const std::string &path);
+
+// writes the file with a "startup" span from the process start and a
+// "run" span from traceStart(); false if it can't
+bool traceStop(void);
+
+// the name of the calling thread in the timeline
+void traceThreadName(const char *name);
+
+void traceAdd(const char *name, const std::string &arg, int64_t startNs, int64_t endNs);
+
+int64_t traceNowNs(void);
+
+class TraceSpan {
+public:
+	
+	// 'name' must stay valid (a literal), 'arg' is copied if tracing
+	explicit TraceSpan(const char *name)
+		: name(name)
+		, startNs(traceOn ? traceNowNs() : 0)
+	{
+	}
+	
+	TraceSpan(const char *name, const std::string &arg)
+		: name(name)
+		, startNs(traceOn ? traceNowNs() : 0)
+	{
+		if(startNs) this->arg = arg;
+	}
+	
+	~TraceSpan()
+	{
+		if(startNs) traceAdd(name, arg, startNs, traceNowNs());
+	}
+	
+private:
+	
+	const char *name;
+	std::string arg;
+	int64_t startNs;
+};
+
+#endif // __EVR_TRACE_H__
@@ -8,6 +8,7 @@
 // the terms contained in the LICENSE.txt file.
 //////////////////////////////////////////////////////////////////////////////
 #include <stdlib.h>
+#include <limits.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -17,256 +18,363 @@
 #include <sys/mman.h>
 
 #include <string>
+#include <vector>
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
+#include <time.h>
 #include <stdexcept>
 
 #include "utils.h"
-#include "linux-evrma.h"
 #include "linux-evr-regs.h"
-#include "PromLoad.h"
+#include "EvrManager.h"
+#include "EvrManagerApi.h"
+#include "MultiCard.h"
+#include "Options.h"
+#include "EvrMonitor.h"
+#include "RegDump.h"
+#include "MmioBench.h"
+#include "IoctlBench.h"
+#include "EventBench.h"
+#include "RealTime.h"
+#include "AllocPlanner.h"
+#include "ConfigSnapshot.h"
+#include "IdleWait.h"
+#include "Trace.h"
 
 namespace {
 
-struct IoRegion {
-	
-	uint32_t *ptr;
-	int	length;
+// promscrub: the other commands get the card between the blocks
+void scrubPause(void *arg, int64_t ns)
+{
+	CardLock &lock = *(CardLock *)arg;
+	struct timespec ts = { (time_t)(ns / 1000000000LL), (long)(ns % 1000000000LL) };
 	
-	explicit IoRegion(void)
-		: ptr(NULL)
-		, length(0)
-	{
+	lock.unlock();
+	while(nanosleep(&ts, &ts) < 0 && errno == EINTR) {
 	}
+	lock.lock();
+}
+
+// closes the handle of runApi()
+class ApiHandle {
+public:
 	
-	void write32(int regAddr, uint32_t value)
-	{
-		ptr[regAddr / 4] = cpu_to_be32(value);
-	}
+	ApiHandle(void) : handle(NULL) {}
+	~ApiHandle() { evrManagerClose(handle); }
 	
-	uint32_t read32(int regAddr)
-	{
-		return be32_to_cpu(ptr[regAddr / 4]);
-	}
+	EvrManagerHandle *handle;
+	
+private:
+	
+	ApiHandle(const ApiHandle &);
+	ApiHandle &operator=(const ApiHandle &);
 };
 
-enum {
-	IOCFG_INIT,
-};
+bool isApiCommand(const std::string &command)
+{
+	return command == "version" || command == "temperature" 
+		|| command == "create" || command == "destroy" 
+		|| command == "alloc" || command == "output" || command == "promload";
+}
 
-class EvrManager {
-public:
+// "" if the VEVR has no node to watch
+std::string virtDevNode(EvrManagerHandle *handle, const std::string &virtDevName)
+{
+	char path[PATH_MAX];
 	
-	explicit EvrManager(const std::string &mngDevNodeName)
-	{
-		fd = open(mngDevNodeName.c_str(), O_RDWR);
-		if(fd < 0) {
-			throw std::runtime_error("failed mng open");
-		}
+	if(evrManagerVirtDevNode(handle, virtDevName.c_str(), path, sizeof(path)) < 0) {
+		return "";
+	}
+	return path;
+}
+
+// after an API call: true to call it again, see IdleWait
+bool retry(IdleWait &wait, int r)
+{
+	if(r >= 0) {
+		return false;
+	}
+	
+	errno = -r;
+	return wait.again();
+}
+
+/*
+ * The commands of EvrManagerApi.h, run through it like an application
+ * would: on a handle, each call taking the card lock for itself.
+ */
+bool runApi(const Options &options, const std::string &mngDevNodeName, 
+			const std::string &command, int argc, const char *argv[], int argc_used)
+{
+	ApiHandle api;
+	
+	int r = evrManagerOpen(mngDevNodeName.c_str(), &api.handle);
+	if(r < 0) {
+		AERR("Can't open '%s': %s", mngDevNodeName.c_str(), evrManagerStrError(r));
+		return false;
+	}
+	
+	if(command == "version") {
 		
-		struct mngdev_config mngdev_config;
+		uint32_t fwVersion;
 		
-		int ret = ioctl(MNG_DEV_IOC_CONFIG, &mngdev_config);
-		if(ret) {
-			AERR("MNG_DEV_IOC_CONFIG failed with errno=%d", errno);
-			close(fd);
-			throw std::runtime_error("MNG_DEV_IOC_CONFIG failed");
+		r = evrManagerVersion(api.handle, &fwVersion);
+		if(r == 0) {
+			printf("FW_VERSION: 0x%08X\n", fwVersion);
 		}
+		return r == 0;
 		
-		if(mngdev_config.io_memory_length > 0) {
-			int prot;
-			prot = PROT_READ | PROT_WRITE;
-			
-			ioRegion.length = mngdev_config.io_memory_length;
-			
-// 			ADBG("mmaping: %d", ioRegion.length);
-			
-			ioRegion.ptr = (uint32_t *)mmap(NULL, ioRegion.length, 
-								prot, MAP_SHARED, fd, 0);
-			
-			if(ioRegion.ptr != MAP_FAILED) {
-// 				ADBG("IO mmap-ed pointer: 0x%x", (int)(size_t)ioRegion.ptr);
-			} else {
-				AERR("IO mmap failed with errno=%d", errno);
-				close(fd);
-				throw std::runtime_error("IO mmap failed");
-			}
+	} else if(command == "temperature") {
+		
+		double current, max;
+		uint32_t rawCurrent, rawMax;
+		
+		r = evrManagerTemperature(api.handle, &current, &max, &rawCurrent, &rawMax);
+		if(r == -ENOTSUP) {
+			printf("The temperature register is not available for this module\n");
+			return true;
 		}
-	}
-	
-	virtual ~EvrManager()
-	{
-		if(ioRegion.ptr != NULL) {
-			if(munmap(NULL, ioRegion.length)) {
-				AERR("IO munmap failed, errno=%d", errno);
-			}
+		if(r == 0) {
+			printf("Temperature: (current) %6.2lf degC / 0x%04x, (max) %6.2lf degC / 0x%04x\n", 
+				   current, rawCurrent, max, rawMax);
 		}
+		return r == 0;
+	}
 	
-		close(fd);
+	if(argc < argc_used + 1) {
+		AERR("arg[%d]->virtDevName", argc_used);
+		return false;
 	}
 	
-	// will return 0 on any error
-	int getVirtDevId(const std::string &virtDevName)
-	{
-		struct mngdev_ioctl_vdev_ids vDevData = {
-			0,
-			"",
-		};
+	// the .mcs file for promload
+	std::string virtDevName = argv[argc_used ++];
+	
+	if(command == "promload") {
 		
-		strncpy(vDevData.name, virtDevName.c_str(), sizeof(vDevData.name));
+		int flags = 0;
 		
-		int ret = ioctl(MNG_DEV_IOC_VIRT_DEV_FIND, &vDevData) == 0;
-
-		if(!ret) {
-			return 0;
+		if(options.rt) {
+			// no file reads (and page faults) between the flash commands
+			flags |= EVR_MANAGER_PROM_PRELOAD | EVR_MANAGER_PROM_JITTER;
+		}
+		if(options.timing) {
+			flags |= EVR_MANAGER_PROM_JITTER;
+		}
+		if(options.inlineVerify) {
+			flags |= EVR_MANAGER_PROM_INLINE_VERIFY;
+		}
+		if(options.postedBuffer) {
+			flags |= EVR_MANAGER_PROM_POSTED_BUFFER;
+		}
+		
+		const char *calibPath = options.calibPath.empty() ? NULL : options.calibPath.c_str();
+		
+		if(options.plan) {
+			return evrManagerPromPlan(api.handle, virtDevName.c_str(), flags, calibPath) == 0;
+		} else if(options.rt) {
+			RealTimeScope rt(options.rtCpu, options.rtPriority);
+			return evrManagerPromLoadEx(api.handle, virtDevName.c_str(), NULL, NULL, flags, 
+										calibPath) == 0;
 		} else {
-			return vDevData.id;
+			return evrManagerPromLoadEx(api.handle, virtDevName.c_str(), NULL, NULL, flags, 
+										calibPath) == 0;
 		}
-	}
-	
-	int ioctl(unsigned long request, void *data = NULL)
-	{
-		int ret = ::ioctl(fd, request, data);
-		if(ret < 0) {
-			ADBG("IOCTL failed, errno=%d", errno);
+		
+	} else if(command == "create") {
+		
+		r = evrManagerCreate(api.handle, virtDevName.c_str());
+		
+	} else if(command == "destroy") {
+		
+		IdleWait wait(virtDevNode(api.handle, virtDevName), virtDevName, 
+					  options.wait, options.waitTimeoutMs);
+		
+		do {
+			r = evrManagerDestroy(api.handle, virtDevName.c_str());
+		} while(retry(wait, r));
+		
+		wait.report();
+		
+	} else if(command == "alloc") {
+		
+		if(argc < argc_used + 1) {
+			AERR("arg[%d]->resName", argc_used);
+			return false;
 		}
 		
-		return ret;
-	}
-	
-	bool ioConfig(int what);
-	bool ioPrtVersion(void);
-	bool promLoad(string filePath);
-	bool ioPrtTemperature(void);
-
-private:
-	
-	int fd;
-	IoRegion ioRegion;
-	
-};
-
-	
-bool EvrManager::ioConfig(int what)
-{
-	bool ret = true;
+		std::string resName = argv[argc_used ++];
 		
-	
-	
-	if(what == IOCFG_INIT) {
-
-		// the dbuf is initially off; will be set by the subscriptions
-		ioRegion.write32(EVR_REG_DATA_BUF_CTRL, 0); 
-
-		ioRegion.write32(EVR_REG_FRAC_DIV, EVR_CLOCK_119000_MHZ);
-		ioRegion.write32(EVR_REG_CTRL, 0x0);
-		ioRegion.write32(EVR_REG_IRQEN, 0x0);
-		ioRegion.write32(EVR_REG_CTRL, (1 << C_EVR_CTRL_RESET_EVENTFIFO));
-		ioRegion.write32(EVR_REG_IRQFLAG, 0xFFFFFFFF);
-		ioRegion.write32(EVR_REG_EV_CNT_PRESC, 1);
-		
-		struct mngdev_ioctl_hw_header dummyHeader = {
-			-1,
-			{
-				{
-					MODAC_RES_TYPE_NONE
-				},
-				{
-					MODAC_RES_TYPE_NONE
-				},
+		IdleWait wait(virtDevNode(api.handle, virtDevName), virtDevName, 
+					  options.wait, options.waitTimeoutMs);
+		
+		if(resName == "pulsegen") {
+			
+			int prescalerLength = 0;
+			int delayLength = 32;
+			int widthLength = 16;
+			
+			if(argc >= argc_used + 1) {
+				prescalerLength = ::atoi(argv[argc_used ++]);
+			}
+			if(argc >= argc_used + 1) {
+				delayLength = ::atoi(argv[argc_used ++]);
+			}
+			if(argc >= argc_used + 1) {
+				widthLength = ::atoi(argv[argc_used ++]);
 			}
-		};
+			
+			do {
+				r = evrManagerAllocPulsegen(api.handle, virtDevName.c_str(), 
+											prescalerLength, delayLength, widthLength);
+			} while(retry(wait, r));
+			
+		} else if(resName == "output") {
+			
+			if(argc < argc_used + 1) {
+				AERR("arg[%d]->absOutputNum", argc_used);
+				return false;
+			}
+			
+			int absOutputNum = ::atoi(argv[argc_used ++]);
+			
+			do {
+				r = evrManagerAllocOutput(api.handle, virtDevName.c_str(), absOutputNum);
+			} while(retry(wait, r));
+			
+		} else {
+			AERR("Unknown resName: %s", resName.c_str());
+			return false;
+		}
 		
-		int res = this->ioctl(MNG_DEV_EVR_IOC_INIT, &dummyHeader);
-	
-		if(res < 0) {
-			AERR("MNG_DEV_EVR_IOC_INIT failed");
+		wait.report();
+		
+		if(r >= 0) {
+			ADBG("allocated abs index: %d", r);
+		}
+		
+	} else if(command == "output") {
+		
+		if(argc < argc_used + 3) {
+			AERR("arg[%d, %d, %d]->outputIndex, [P/S], source", argc_used, argc_used+1, argc_used+2);
 			return false;
 		}
-
-		uint32_t regCtrl = ioRegion.read32(EVR_REG_CTRL);		
-		ioRegion.write32(EVR_REG_CTRL, regCtrl | (1 << C_EVR_CTRL_MASTER_ENABLE) | (1 << C_EVR_CTRL_RXLOOPBACK));
 		
-		// sleep a while for the card to start operating
-		sleep(1);
-
+		int outputIndex = ::atoi(argv[argc_used ++]);
+		std::string pOrS = argv[argc_used ++];
+		int source = ::atoi(argv[argc_used ++]);
+		
+		IdleWait wait(virtDevNode(api.handle, virtDevName), virtDevName, 
+					  options.wait, options.waitTimeoutMs);
+		
+		do {
+			r = evrManagerOutputSet(api.handle, virtDevName.c_str(), outputIndex, 
+									pOrS != "S", source);
+		} while(retry(wait, r));
+		
+		wait.report();
 	}
 	
-	return ret;
-}
-
-
-bool EvrManager::ioPrtVersion(void)
-{
-	bool ret = false;
-
-	uint32_t fw_ver[2];
-
-	fw_ver[0] = ioRegion.read32(EVR_REG_FW_VERSION);
-	fw_ver[1] = ioRegion.read32(EVR_REG_FW_VERSION_SLAC);
-
-	printf("FW_VERSION: 0x%08X\n", fw_ver[0]);
-/*
-	if(fw_ver[1]) {
-		printf(", SLAC FW_VERION: 0x%08X\n", bswap32(fw_ver[1]));
-	} else {
-		printf("\n");
+	if(r < 0) {
+		AERR("%s '%s' failed: %s", command.c_str(), virtDevName.c_str(), evrManagerStrError(r));
+		return false;
 	}
-*/
-
-	return ret;	
-}
-
-
-bool EvrManager::promLoad(string filePath)
-{
-	bool ret = false;
-
-	printf("%p %s\n", ioRegion.ptr, filePath.c_str());
-	ret = PromLoad(ioRegion.ptr, filePath);
-
-	return ret;
-}
-
-bool EvrManager::ioPrtTemperature(void)
-{
-	bool ret = false;
-
-	uint32_t raw_temp[2];
-	double   temp[2];
-	int      i;
-
-	if(!ioRegion.read32(EVR_REG_FW_VERSION_SLAC)) {
-		ret = true;
-		printf("The temperature register is not available for this module\n");
-		return ret;
-	}
-
-	raw_temp[0] = bswap32(ioRegion.read32(AXIXADC_REG_TEMPERATURE))>>4;
-	raw_temp[1] = bswap32(ioRegion.read32(AXIXADC_REG_MAXTEMPERATURE))>>4;
-
-
-	for(i=0;i<2;i++) temp[i] = double(unsigned(raw_temp[i])) * (503.975/4096.) - 273.15;
-
-	printf("Temperature: (current) %6.2lf degC / 0x%04x, (max) %6.2lf degC / 0x%04x\n", 
-	temp[0], raw_temp[0], temp[1], raw_temp[1]);
-
 	
-	
-
-	return ret;
+	return true;
 }
 
-
-
-
-bool run(int argc, const char *argv[])
+// 'exitCode' is set by the commands with more outcomes than success
+// and failure (regdiff: REG_DIFF_xxx), left alone by the others
+bool run(int argc, const char *argv[], int *exitCode)
 {
 	bool ret = false;
 	
 	int argc_used = 1; // the command itself
 	
+	Options options;
+	
+	while(argc > argc_used && strncmp(argv[argc_used], "--", 2) == 0) {
+		
+		std::string opt = argv[argc_used ++];
+		
+		if(opt == "--all") {
+			options.all = true;
+		} else if(opt == "--timing") {
+			options.timing = true;
+		} else if(opt.compare(0, 15, "--init-timeout=") == 0) {
+			options.readyTimeoutMs = ::atoi(opt.c_str() + 15);
+		} else if(opt == "--dry-run") {
+			options.dryRun = true;
+		} else if(opt == "--wait") {
+			options.wait = true;
+		} else if(opt.compare(0, 7, "--wait=") == 0) {
+			options.wait = true;
+			options.waitTimeoutMs = ::atoi(opt.c_str() + 7);
+		} else if(opt == "--inline-verify") {
+			options.inlineVerify = true;
+		} else if(opt == "--posted-buffer") {
+			options.postedBuffer = true;
+		} else if(opt == "--plan") {
+			options.plan = true;
+		} else if(opt.compare(0, 8, "--calib=") == 0) {
+			options.calibPath = opt.substr(8);
+		} else if(opt.compare(0, 13, "--scrub-rate=") == 0) {
+			options.scrubRate = ::strtoul(opt.c_str() + 13, NULL, 0);
+		} else if(opt.compare(0, 13, "--scrub-time=") == 0) {
+			options.scrubTimeS = ::atoi(opt.c_str() + 13);
+		} else if(opt.compare(0, 12, "--placement=") == 0) {
+			if(!parsePlacement(opt.substr(12), &options.placement)) {
+				AERR("Invalid option: %s", opt.c_str());
+				return false;
+			}
+			options.placementSet = true;
+		} else if(opt.compare(0, 8, "--trace=") == 0) {
+			if(!traceStart(opt.substr(8))) {
+				return false;
+			}
+		} else if(opt.compare(0, 6, "--log=") == 0) {
+			if(!evrLogConfigure(opt.c_str() + 6)) {
+				AERR("Invalid option: %s", opt.c_str());
+				return false;
+			}
+		} else if(opt == "--rt") {
+			options.rt = true;
+		} else if(opt.compare(0, 5, "--rt=") == 0) {
+			options.rt = true;
+			if(sscanf(opt.c_str() + 5, "%d,%d", &options.rtCpu, &options.rtPriority) < 1) {
+				AERR("Invalid option: %s", opt.c_str());
+				return false;
+			}
+		} else {
+			AERR("Unknown option: %s", opt.c_str());
+			return false;
+		}
+	}
+	
+	if(options.all) {
+		
+		// each card's thread next to its card unless told otherwise
+		if(!options.placementSet) {
+			options.placement = PLACEMENT_LOCAL;
+		}
+		
+		if(argc < argc_used + 1) {
+			AERR("arg[%d]->command", argc_used);
+			return false;
+		}
+		
+		std::string command = argv[argc_used ++];
+		
+		if(!isMultiCardCommand(command)) {
+			AERR("Command '%s' is not supported with --all", command.c_str());
+			return false;
+		}
+		
+		std::string arg = argc >= argc_used + 1 ? argv[argc_used ++] : ".";
+		
+		return runOnAllCards(command, arg, options);
+	}
+	
 	if(argc < argc_used + 2) {
 		AERR("arg[%d, %d]->mngDevNodeName, command", argc_used, argc_used+1);
 		goto LErr;
@@ -278,208 +386,207 @@ LErr:
 	std::string command = argv[argc_used ++];
 	
 	
-	uint8_t virtNumber = 0;
-	std::string virtDevName;
-	
 	try {
 		
-		EvrManager manager(mngDevNodeName);
+		// with --placement, on the CPUs next to the card before anything is
+		// allocated; left alone if the card isn't found (e.g. the emulator)
+		CardLocality locality;
+		bool located = locality.find(mngDevNodeName);
+		PlacementScope place(locality, located ? options.placement : PLACEMENT_NONE);
 		
-		if(command == "init" || command == "version" || command == "sleep" 
-		   || command == "temperature" ) {
-			// no virt_DEV param
-		} else {
-
+		// as an application would, through the C interface of libevrmanager
+		if(isApiCommand(command)) {
+			return runApi(options, mngDevNodeName, command, argc, argv, argc_used);
+		}
+		
+		// before the card is opened, so a failure to open it exits with 2
+		// (not 1, "differ"); two snapshot files don't need the card at all
+		if(command == "regdiff") {
+			
+			*exitCode = REG_DIFF_ERROR;
+			
 			if(argc < argc_used + 1) {
-				// all commands need this at the moment
-				AERR("arg[%d]->virtDevName", argc_used);
-				goto LErr;
+				AERR("arg[%d]->snapshotFile, [arg[%d]->snapshotFile]", argc_used, argc_used+1);
+				throw std::runtime_error("error");
 			}
-
-			virtDevName = argv[argc_used ++];
 			
-			virtNumber = manager.getVirtDevId(virtDevName);
+			std::string oldPath = argv[argc_used ++];
+			std::string newPath = argc >= argc_used + 1 ? argv[argc_used ++] : "";
 			
-			if(command == "create" || command == "promload") {
-				if(virtNumber > 0) {
-					// will leave as this but will fail later because
-				}
+			if(newPath.empty()) {
+				EvrManager manager(mngDevNodeName);
+				CardLock lock(mngDevNodeName);
+				*exitCode = regDiff(&manager, oldPath, newPath);
 			} else {
-				if(virtNumber < 1) {
-					AERR("Can't proceed '%s' with invalid VIRT_DEV '%s'", command.c_str(), virtDevName.c_str());
-					goto LErr;
-				}
+				*exitCode = regDiff(NULL, oldPath, newPath);
 			}
+			
+			return *exitCode != REG_DIFF_ERROR;
 		}
-
-		if(command == "promload") {
-
-			ret = manager.promLoad(virtDevName);
-
-		} else if(command == "temperature") {
-
-			ret = manager.ioPrtTemperature();	
 		
-		} else if(command == "create") {
-
-			struct mngdev_ioctl_vdev_ids vDevData = {
-				virtNumber,
-				"",
-			};
+		EvrManager manager(mngDevNodeName);
+		
+		// the long running read-only commands don't block the others
+		CardLock lock(mngDevNodeName, command != "monitor" && command != "regwatch" 
+					  && command != "evbench");
+		
+		if(command == "promscrub") {
+			
+			if(argc < argc_used + 1) {
+				AERR("arg[%d]->reference.mcs, [arg[%d]->stateFile]", argc_used, argc_used+1);
+				throw std::runtime_error("error");
+			}
+			
+			PromScrubConfig config;
+			config.referencePath = argv[argc_used ++];
+			config.statePath = argc >= argc_used + 1 ? argv[argc_used ++] 
+													 : promScrubStatePath(mngDevNodeName);
+			config.rateWords = options.scrubRate;
+			config.timeLimitS = options.scrubTimeS;
+			
+			ret = manager.promScrub(config, scrubPause, &lock);
 			
-			strncpy(vDevData.name, virtDevName.c_str(), sizeof(vDevData.name));
+		} else if(command == "monitor") {
 			
-			ret = manager.ioctl(MNG_DEV_IOC_CREATE, &vDevData) == 0;
+			int periodMs = EVR_MON_PERIOD_MS_DEFAULT;
+			int capacity = EVR_MON_CAPACITY_DEFAULT;
+			
+			if(argc >= argc_used + 1) {
+				periodMs = ::atoi(argv[argc_used ++]);
+			}
+			
+			if(argc >= argc_used + 1) {
+				capacity = ::atoi(argv[argc_used ++]);
+			}
+			
+			ret = runMonitor(manager, mngDevNodeName, periodMs, capacity);
 		
-			if(!ret) {
-				AERR("Virtual dev creation failed: '%s', %d", vDevData.name, vDevData.id);
+		} else if(command == "regdump") {
+			
+			if(argc < argc_used + 1) {
+				AERR("arg[%d]->snapshotFile|-, [arg[%d]->regNames]", argc_used, argc_used+1);
 				throw std::runtime_error("error");
 			}
 			
-		} else if(command == "destroy") {
-
-			struct mngdev_ioctl_destroy vDevData = {
-				virtNumber
-			};
+			std::string filePath = argv[argc_used ++];
+			std::string regList = argc >= argc_used + 1 ? argv[argc_used ++] : "";
 			
-			ret = manager.ioctl(MNG_DEV_IOC_DESTROY, &vDevData) == 0;
-		
-			if(!ret) {
-				AERR("Virtual dev destruction failed: %d", vDevData.id);
+			ret = regDump(manager, filePath, regList);
+			
+		} else if(command == "regwatch") {
+			
+			if(argc < argc_used + 2) {
+				AERR("arg[%d, %d]->interval_ms, count, [arg[%d]->regNames]", 
+					 argc_used, argc_used+1, argc_used+2);
 				throw std::runtime_error("error");
 			}
 			
-		} else if(command == "alloc") {
+			int intervalMs = ::atoi(argv[argc_used ++]);
+			int count = ::atoi(argv[argc_used ++]);
+			std::string regList = argc >= argc_used + 1 ? argv[argc_used ++] : "";
 			
-			if(argc < argc_used + 1) {
-				AERR("arg[%d]->resName", argc_used);
-				goto LErr;
+			ret = regWatch(manager, intervalMs, count, regList);
+			
+		} else if(command == "mmiobench") {
+			
+			int iterations = MMIO_BENCH_ITERATIONS_DEFAULT;
+			uint32_t imageBytes = MMIO_BENCH_IMAGE_BYTES_DEFAULT;
+			
+			if(argc >= argc_used + 1) {
+				iterations = ::atoi(argv[argc_used ++]);
 			}
-
-			std::string resName = argv[argc_used ++];
-			
-			struct mngdev_ioctl_res vDevData;
-			
-			if(resName == "pulsegen") {
-			
-				int prescalerLength = 0;
-				int delayLength = 32;
-				int widthLength = 16;
-				
-				if(argc < argc_used + 1) {
-// 					AINFO("Could set also: arg[%d]->prescalerLength", argc_used);
-				} else {
-					prescalerLength = ::atoi(argv[argc_used ++]);
-				}
-				
-				if(argc < argc_used + 1) {
-// 					AINFO("Could set also: arg[%d]->delayLength", argc_used);
-				} else {
-					delayLength = ::atoi(argv[argc_used ++]);
-				}
-				
-				if(argc < argc_used + 1) {
-// 					AINFO("Could set also: arg[%d]->widthLength", argc_used);
-				} else {
-					widthLength = ::atoi(argv[argc_used ++]);
-				}
-				
-
-				struct mngdev_ioctl_res vDevDataPulsegen = {
-					virtNumber,
-					"pulsegen",
-					-1,
-					{
-						prescalerLength,
-						delayLength,
-						widthLength
-					}
-				};
-				
-				vDevData = vDevDataPulsegen;
-				
-			} else if(resName == "output") {
-				
-				int absOutputNum;
-				
-				if(argc < argc_used + 1) {
-					AERR("arg[%d]->absOutputNum", argc_used);
-					goto LErr;
-				} else {
-					absOutputNum = ::atoi(argv[argc_used ++]);
-				}
-				
-
-				struct mngdev_ioctl_res vDevDataOutput = {
-					virtNumber,
-					"output",
-					absOutputNum,
-				};
-				
-				vDevData = vDevDataOutput;
-				
-			} else {
-				AERR("Unknown resName: %s", resName.c_str());
+			
+			if(argc >= argc_used + 1) {
+				imageBytes = ::strtoul(argv[argc_used ++], NULL, 0);
+			}
+			
+			ret = mmioBench(manager, iterations, imageBytes);
+			
+		} else if(command == "placebench") {
+			
+			int iterations = MMIO_BENCH_ITERATIONS_DEFAULT;
+			
+			if(argc >= argc_used + 1) {
+				iterations = ::atoi(argv[argc_used ++]);
+			}
+			
+			ret = mmioPlacementBench(manager, locality, iterations);
+			
+		} else if(command == "ioctlbench") {
+			
+			int iterations = IOCTL_BENCH_ITERATIONS_DEFAULT;
+			int threads = IOCTL_BENCH_THREADS_DEFAULT;
+			std::string hitName;
+			
+			if(argc >= argc_used + 1) {
+				iterations = ::atoi(argv[argc_used ++]);
+			}
+			
+			if(argc >= argc_used + 1) {
+				threads = ::atoi(argv[argc_used ++]);
+			}
+			
+			if(argc >= argc_used + 1) {
+				hitName = argv[argc_used ++];
+			}
+			
+			ret = ioctlBench(manager, iterations, threads, hitName);
+			
+		} else if(command == "evbench") {
+			
+			if(argc < argc_used + 2) {
+				AERR("arg[%d, %d...]->seconds, vevrNames|synthetic[:<rate>]", 
+					 argc_used, argc_used+1);
 				throw std::runtime_error("error");
 			}
-
-			int ainx = manager.ioctl(MNG_DEV_IOC_ALLOC, &vDevData);
-		
-			if(ainx < 0) {
-				AERR("Virtual dev alloc failed: %d", vDevData.id_vdev);
+			
+			int seconds = ::atoi(argv[argc_used ++]);
+			std::vector<std::string> names(argv + argc_used, argv + argc);
+			argc_used = argc;
+			
+			ret = eventBench(manager, seconds, names);
+			
+		} else if(command == "plan") {
+			
+			if(argc < argc_used + 1) {
+				AERR("arg[%d]->requirementsFile", argc_used);
 				throw std::runtime_error("error");
-			} else {
-				ADBG("allocated abs index: %d", ainx);
-				ret = true;
 			}
 			
-		} else if(command == "output") {
+			ret = planAllocations(manager, argv[argc_used ++], options.dryRun);
+			
+		} else if(command == "snapshot" || command == "restore") {
 			
-			if(argc < argc_used + 3) {
-				AERR("arg[%d, %d, %d]->outputIndex, [P/S], source", argc_used, argc_used+1, argc_used+2);
+			if(argc < argc_used + 1) {
+				AERR("arg[%d]->snapshotFile", argc_used);
 				throw std::runtime_error("error");
 			}
 			
-			int outputIndex = ::atoi(argv[argc_used ++]);
-			std::string pOrS = argv[argc_used ++];
-			int source = ::atoi(argv[argc_used ++]);
-			
-			struct mngdev_evr_output_set outSetArgs = {
-				{
-					virtNumber,
-					{
-						{
-							EVR_RES_TYPE_OUTPUT,
-							outputIndex
-						},
-						{
-							EVR_RES_TYPE_PULSEGEN,
-							source
-						}
-					}
-				},
-				source
-			};
-			
-			if(pOrS == "S") {
-				outSetArgs.header.vres[1].type = MODAC_RES_TYPE_NONE;
+			std::string filePath = argv[argc_used ++];
+			std::string summary;
+			
+			if(command == "snapshot") {
+				ret = snapshotConfig(manager, mngDevNodeName, filePath, &summary);
+			} else {
+				ret = restoreConfig(manager, filePath, &summary);
 			}
-
-			ret = manager.ioctl(MNG_DEV_EVR_IOC_OUTSET, &outSetArgs) == 0;
-		
-			if(!ret) {
-				AERR("MNG_DEV_EVR_IOC_OUTSET failed, errno=%d", errno);
-				throw std::runtime_error("error");
+			
+			if(!summary.empty()) {
+				printf("%s: %s\n", command == "snapshot" ? "SNAPSHOT" : "RESTORE", 
+					   summary.c_str());
 			}
 			
 		} else if(command == "init") {
 			
+			manager.setReadyTimeout(options.readyTimeoutMs);
+			
 			ret = manager.ioConfig(IOCFG_INIT);
-
-		} else if(command == "version") {
-		
-			ret = manager.ioPrtVersion();
 			
+			if(options.timing) {
+				printf("TIMING: init_ready_ms=%.3f polls=%u\n", 
+					   manager.getReadyTimeMs(), manager.getReadyPolls());
+			}
+
 		} else {
 			AERR("Unknown cmd: %s", command.c_str());
 		}
@@ -498,6 +605,15 @@ LErr:
 
 int main(int argc, const char *argv[])
 {
-	return run(argc, argv) ? 0 : 1;
+	int exitCode = -1;
+	bool ok = run(argc, argv, &exitCode);
+	
+	// after run(), which joined its threads
+	ok = traceStop() && ok;
+	
+	if(exitCode >= 0) {
+		return ok ? exitCode : REG_DIFF_ERROR;
+	}
+	return ok ? 0 : 1;
 }
 
@@ -12,6 +12,8 @@
 
 #include <endian.h>
 
+#include "Log.h"
+
 #if BYTE_ORDER == BIG_ENDIAN
 # define be16_to_cpu(x) (x)
 # define be32_to_cpu(x) (x)
@@ -30,9 +32,21 @@
 #define cpu_to_be32(x) be32_to_cpu(x)
 #define bswap32(x)     be32_to_cpu(x)
 
-#define ADBG(FORMAT, ...) printf("DBG: " FORMAT "\n", ## __VA_ARGS__)
-#define AINFO(FORMAT, ...) printf("INFO: " FORMAT "\n", ## __VA_ARGS__)
-#define AERR(FORMAT, ...) printf("ERROR: " FORMAT "\n", ## __VA_ARGS__)
+// see Log.h; the levels above EVR_LOG_LEVEL are compiled out (still
+// type checked, so they don't rot)
+#if EVR_LOG_LEVEL >= LOG_LEVEL_DBG
+# define ADBG(FORMAT, ...) evrLog(LOG_LEVEL_DBG, FORMAT, ## __VA_ARGS__)
+#else
+# define ADBG(FORMAT, ...) do { if(0) evrLog(LOG_LEVEL_DBG, FORMAT, ## __VA_ARGS__); } while(0)
+#endif
+
+#if EVR_LOG_LEVEL >= LOG_LEVEL_INFO
+# define AINFO(FORMAT, ...) evrLog(LOG_LEVEL_INFO, FORMAT, ## __VA_ARGS__)
+#else
+# define AINFO(FORMAT, ...) do { if(0) evrLog(LOG_LEVEL_INFO, FORMAT, ## __VA_ARGS__); } while(0)
+#endif
+
+#define AERR(FORMAT, ...) evrLog(LOG_LEVEL_ERR, FORMAT, ## __VA_ARGS__)
 
 
 